@@ -4,58 +4,20 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
-
-greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
-
-TARGET = Painter
-TEMPLATE = app
-
-# The following define makes your compiler emit warnings if you use
-# any feature of Qt which has been marked as deprecated (the exact warnings
-# depend on your compiler). Please consult the documentation of the
-# deprecated API in order to know how to port your code away from it.
-DEFINES += QT_DEPRECATED_WARNINGS
-
-# You can also make your code fail to compile if you use deprecated APIs.
-# In order to do so, uncomment the following line.
-# You can also select to disable deprecated APIs only up to a certain version of Qt.
-#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
-
-CONFIG += c++11
-
-SOURCES += \
-        main.cpp \
-        mainwindow.cpp \
-    shape.cpp \
-    painter.cpp \
-    line.cpp \
-    polygon.cpp \
-    ellipse.cpp \
-    curve.cpp \
-    qsizedialog.cpp \
-    utils.cpp \
-    paintercli.cpp
-
-HEADERS += \
-        mainwindow.h \
-    shape.h \
-    painter.h \
-    line.h \
-    polygon.h \
-    ellipse.h \
-    curve.h \
-    qsizedialog.h \
-    utils.h \
-    paintercli.h
-
-# Default rules for deployment.
-qnx: target.path = /tmp/$${TARGET}/bin
-else: unix:!android: target.path = /opt/$${TARGET}/bin
-!isEmpty(target.path): INSTALLS += target
-
-RESOURCES += \
-    painter.qrc
-
-FORMS += \
-    qsizedialog.ui
+# core: the cg:: shapes, the canvas and the headless PainterCLI, built
+#       as a static library linking only QtCore and QtGui.
+# cli:  PainterCLI, the command line alone without the widget stack.
+# gui:  Painter, the graphical interface, which also runs the command
+#       line interface when given arguments.
+# tests: PainterCheck, the regression check, which "make check" runs.
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    core \
+    cli \
+    gui \
+    tests
+
+cli.depends = core
+gui.depends = core
+tests.depends = core
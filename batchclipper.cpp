@@ -0,0 +1,102 @@
+#include "batchclipper.h"
+#include "line.h"
+#include "trace.h"
+
+namespace cg {
+
+BatchClipper::BatchClipper(const QPointF &p1, const QPointF &p2)
+    : window(QRectF(p1, p2).normalized())
+{
+
+}
+
+QVector<cg::Shape *> BatchClipper::clip(const QVector<cg::Shape *> &shapes,
+                                        const QString &alg)
+{
+    TRACE_SCOPE("BatchClipper::clip");
+    QVector<cg::Shape *> result(shapes.size(), nullptr);
+    QVector<int> lineIndices;
+
+    lines.clear();
+    x1.clear();
+    y1.clear();
+    x2.clear();
+    y2.clear();
+
+    for (int i = 0; i < shapes.size(); ++i) {
+        cg::Line *line = dynamic_cast<cg::Line *>(shapes[i]);
+        if (line) {
+            gather(line);
+            lineIndices.append(i);
+        }
+        else if (shapes[i]) {
+            result[i] = shapes[i]->clip(window.topLeft(),
+                                        window.bottomRight(), alg);
+        }
+    }
+
+    clipLines();
+
+    for (int j = 0; j < lines.size(); ++j) {
+        if (visible[j] == 0.0)
+            continue;
+        lines[j]->setPoints(QPointF(x1[j], y1[j]), QPointF(x2[j], y2[j]));
+        result[lineIndices[j]] = lines[j];
+    }
+    return result;
+}
+
+void BatchClipper::gather(cg::Line *line)
+{
+    QPointF p1 = line->getPoint1(), p2 = line->getPoint2();
+    lines.append(line);
+    x1.append(p1.x());
+    y1.append(p1.y());
+    x2.append(p2.x());
+    y2.append(p2.y());
+}
+
+/* One Liang-Barsky boundary test written with selects instead of
+ * branches. p == 0 means the line is parallel to the boundary, in which
+ * case it is rejected iff it lies outside (q < 0). */
+static inline void clipEdge(double p, double q, double &u1, double &u2)
+{
+    double r = q / (p == 0.0 ? 1.0 : p);
+    double lower = p < 0.0 ? r : 0.0;
+    double upper = p > 0.0 ? r : 1.0;
+    double reject = (p == 0.0) & (q < 0.0) ? 2.0 : 0.0;
+    u1 = qMax(qMax(u1, lower), reject);
+    u2 = qMin(u2, upper);
+}
+
+void BatchClipper::clipLines()
+{
+    int n = lines.size();
+    visible.resize(n);
+
+    double *px1 = x1.data(), *py1 = y1.data();
+    double *px2 = x2.data(), *py2 = y2.data();
+    double *pvisible = visible.data();
+    double left = window.left(), right = window.right();
+    double top = window.top(), bottom = window.bottom();
+
+#pragma omp simd
+    for (int i = 0; i < n; ++i) {
+        double dx = px2[i] - px1[i];
+        double dy = py2[i] - py1[i];
+        double u1 = 0.0, u2 = 1.0;
+
+        clipEdge(-dx, px1[i] - left, u1, u2);
+        clipEdge(dx, right - px1[i], u1, u2);
+        clipEdge(-dy, py1[i] - top, u1, u2);
+        clipEdge(dy, bottom - py1[i], u1, u2);
+
+        pvisible[i] = u1 <= u2 ? 1.0 : 0.0;
+        px2[i] = px1[i] + dx * u2;
+        py2[i] = py1[i] + dy * u2;
+        px1[i] = px1[i] + dx * u1;
+        py1[i] = py1[i] + dy * u1;
+    }
+}
+
+}
@@ -0,0 +1,43 @@
+#ifndef BATCHCLIPPER_H
+#define BATCHCLIPPER_H
+
+#include "shape.h"
+
+#include <QVector>
+#include <QRectF>
+
+namespace cg {
+
+class Line;
+
+/* Clips a whole scene against one window.
+ *
+ * Line endpoints are gathered into structure-of-arrays buffers and
+ * clipped by a branch-free Liang-Barsky loop that the compiler can
+ * vectorize, so several lines are handled by one instruction. Lines are
+ * updated in place; other shapes fall back to Shape::clip. */
+class BatchClipper
+{
+public:
+    BatchClipper(const QPointF &p1, const QPointF &p2);
+
+    /* Returns one entry per input shape: the shape itself if it was
+     * clipped in place, a new shape if it was replaced, or nullptr if
+     * nothing of it is left. Replaced shapes are not deleted. */
+    QVector<cg::Shape *> clip(const QVector<cg::Shape *> &shapes,
+                              const QString &alg);
+
+private:
+    void gather(cg::Line *line);
+    void clipLines();
+
+    QRectF window;
+
+    QVector<cg::Line *> lines;
+    QVector<double> x1, y1, x2, y2;
+    QVector<double> visible;   /* 1.0 or 0.0, to keep the loop in doubles */
+};
+
+}
+
+#endif // BATCHCLIPPER_H
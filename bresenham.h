@@ -0,0 +1,284 @@
+#ifndef BRESENHAM_H
+#define BRESENHAM_H
+
+#include "fixedpoint.h"
+
+#include <QtGlobal>
+
+namespace cg {
+
+namespace bresenham {
+
+/* After ordering the endpoints so that the major axis increases, a line
+ * falls into one of four octant pairs, named by its major axis and the
+ * direction of its minor axis. */
+enum {
+    X_MAJOR_INC,
+    X_MAJOR_DEC,
+    Y_MAJOR_INC,
+    Y_MAJOR_DEC
+};
+
+/* Lines whose major axis is at least this long and whose runs average at
+ * least RUN_SLICE_MIN_RUN pixels are drawn span by span. */
+enum {
+    RUN_SLICE_MIN_LENGTH = 64,
+    RUN_SLICE_MIN_RUN = 4
+};
+
+template <int Octant>
+struct OctantTraits
+{
+    static const bool xMajor = Octant == X_MAJOR_INC || Octant == X_MAJOR_DEC;
+    static const int minorStep =
+            Octant == X_MAJOR_INC || Octant == Y_MAJOR_INC ? 1 : -1;
+    /* Lines stepping to a decreasing minor coordinate stay on the current
+     * one when the decision parameter ties. */
+    static const int tieBias = minorStep > 0 ? 0 : 1;
+};
+
+template <int Octant, typename Sink>
+inline void plot(Sink &sink, int major, int minor)
+{
+    if (OctantTraits<Octant>::xMajor)
+        sink.plot(major, minor);
+    else
+        sink.plot(minor, major);
+}
+
+template <int Octant, typename Sink>
+inline void span(Sink &sink, int majorBegin, int majorEnd, int minor)
+{
+    if (OctantTraits<Octant>::xMajor)
+        sink.hspan(majorBegin, majorEnd, minor);
+    else
+        sink.vspan(minor, majorBegin, majorEnd);
+}
+
+/* Draws a + 1 pixels starting at (major, minor). The minor axis steps
+ * whenever the remainder, which starts at r and grows by incr each major
+ * step, reaches d, with 0 <= r < d and 0 <= incr <= d. The decision
+ * parameter is the remainder after the next step less d, and is updated
+ * without branches. Integer is int for lines between pixel centers and
+ * qint64 for subpixel ones. */
+template <int Octant, typename Integer, typename Sink>
+void drawByStep(Sink &sink, int major, int minor, int a,
+                Integer r, Integer incr, Integer d)
+{
+    typedef OctantTraits<Octant> Traits;
+
+    const int signBit = static_cast<int>(sizeof(Integer)) * 8 - 1;
+    Integer decisionParam = r + incr - d;
+    const int majorEnd = major + a;
+
+    for (; major <= majorEnd; ++major) {
+        plot<Octant>(sink, major, minor);
+        Integer mask = ~(decisionParam >> signBit); /* All ones iff decisionParam >= 0 */
+        minor += static_cast<int>(mask & Traits::minorStep);
+        decisionParam += incr - (mask & d);
+    }
+}
+
+/* Draws the same pixels as drawByStep() one run at a time. The minor
+ * offset after k major steps is floor((r + k incr) / d), so the run on
+ * minor offset m begins at ceil((m d - r) / incr). */
+template <int Octant, typename Sink>
+void drawByRunSlice(Sink &sink, int major, int minor, int a,
+                    qint64 r, qint64 incr, qint64 d)
+{
+    typedef OctantTraits<Octant> Traits;
+
+    Q_ASSERT(incr > 0);
+
+    qint64 numerator = d - r + incr - 1;
+    int begin = 0;
+
+    while (begin <= a) {
+        int end = static_cast<int>(qMin<qint64>(numerator / incr, a + 1)) - 1;
+        span<Octant>(sink, major + begin, major + end, minor);
+        begin = end + 1;
+        minor += Traits::minorStep;
+        numerator += d;
+    }
+}
+
+/* Draws a 45 degree line of a + 1 pixels starting at (major, minor). */
+template <int Octant, typename Sink>
+inline void diagonal(Sink &sink, int major, int minor, int a)
+{
+    typedef OctantTraits<Octant> Traits;
+
+    if (Traits::xMajor)
+        sink.diagonal(major, minor, a + 1, Traits::minorStep);
+    else if (Traits::minorStep > 0)
+        sink.diagonal(minor, major, a + 1, 1);
+    else
+        sink.diagonal(minor - a, major + a, a + 1, -1); /* From the far end */
+}
+
+/* Horizontal, vertical and diagonal lines never or always step the minor
+ * axis, so they skip the decision parameter and become a single span.
+ * Between pixel centers, the minor offset after k steps of a line of
+ * lengths a and b is floor((2bk + a - tieBias) / 2a). */
+template <int Octant, typename Sink>
+inline void drawOctant(Sink &sink, int major, int minor, int a, int b)
+{
+    typedef OctantTraits<Octant> Traits;
+
+    if (b == 0)
+        span<Octant>(sink, major, major + a, minor);
+    else if (b == a)
+        diagonal<Octant>(sink, major, minor, a);
+    else if (a >= RUN_SLICE_MIN_LENGTH && b * RUN_SLICE_MIN_RUN <= a)
+        drawByRunSlice<Octant>(sink, major, minor, a, a - Traits::tieBias,
+                               2 * static_cast<qint64>(b),
+                               2 * static_cast<qint64>(a));
+    else
+        drawByStep<Octant, int>(sink, major, minor, a, a - Traits::tieBias,
+                                2 * b, 2 * a);
+}
+
+/* Draws the line starting at the subpixel point (major1, minor1), in
+ * 24.8 fixed point, that extends a along the major axis and b along the
+ * minor one, with 0 <= b <= a and a > 0. Every pixel from the one the
+ * start falls on to the one the end falls on gets the pixel the line
+ * crosses at its center, so that lines between pixel centers come out
+ * as drawOctant() draws them. */
+template <int Octant, typename Sink>
+void drawFixedOctant(Sink &sink, int major1, int minor1, qint64 a, qint64 b)
+{
+    typedef OctantTraits<Octant> Traits;
+
+    int first = fixed::toPixel(major1);
+    int last = fixed::toPixel(static_cast<int>(major1 + a));
+    /* Mirror a decreasing minor axis, so that the line climbs it. */
+    int minor = Traits::minorStep > 0 ? minor1 : -minor1;
+
+    /* At the center of the first pixel the line is on minor offset
+     * floor(n / d) from row, with d = a ONE and
+     *     n = a (fraction + HALF) + (first ONE - major1) b - tieBias.
+     * The center is within half a pixel of major1, so 0 <= n < 2d. */
+    int row = minor >> fixed::SHIFT;
+    const qint64 d = a * fixed::ONE;
+    qint64 n = a * ((minor & fixed::FRACTION) + fixed::HALF)
+             + (static_cast<qint64>(first) * fixed::ONE - major1) * b
+             - Traits::tieBias;
+    Q_ASSERT(n >= 0);
+    if (n >= d) {
+        ++row;
+        n -= d;
+    }
+    if (Traits::minorStep < 0)
+        row = -row;
+
+    int count = last - first;
+    const qint64 incr = b * fixed::ONE;
+    if (b == 0)
+        span<Octant>(sink, first, last, row);
+    else if (b == a)
+        diagonal<Octant>(sink, first, row, count);
+    else if (count >= RUN_SLICE_MIN_LENGTH && b * RUN_SLICE_MIN_RUN <= a)
+        drawByRunSlice<Octant>(sink, first, row, count, n, incr, d);
+    else
+        drawByStep<Octant, qint64>(sink, first, row, count, n, incr, d);
+}
+
+/* Draws the line from (x1, y1) to (x2, y2) into sink. The octant is
+ * resolved once here, so the kernels run without per-pixel dispatch.
+ * A line whose endpoints coincide draws nothing. */
+template <typename Sink>
+void drawLine(Sink &sink, int x1, int y1, int x2, int y2)
+{
+    int deltaX = x2 - x1;
+    int deltaY = y2 - y1;
+
+    /* |m| <= 1 */
+    if (qAbs(deltaY) <= qAbs(deltaX)) {
+        if (deltaX == 0)
+            return;
+
+        if (x1 > x2) {
+            qSwap(x1, x2);
+            qSwap(y1, y2);
+        }
+        int dx = x2 - x1;
+        int dy = y2 - y1;
+
+        if (dy >= 0)
+            drawOctant<X_MAJOR_INC>(sink, x1, y1, dx, dy);
+        else
+            drawOctant<X_MAJOR_DEC>(sink, x1, y1, dx, -dy);
+    }
+    /* |m| > 1 */
+    else {
+        Q_ASSERT(deltaY != 0);
+
+        if (y1 > y2) {
+            qSwap(x1, x2);
+            qSwap(y1, y2);
+        }
+        int dx = x2 - x1;
+        int dy = y2 - y1;
+
+        if (dx >= 0)
+            drawOctant<Y_MAJOR_INC>(sink, y1, x1, dy, dx);
+        else
+            drawOctant<Y_MAJOR_DEC>(sink, y1, x1, dy, -dx);
+    }
+}
+
+/* Draws the line between two points in 24.8 fixed point. Lines between
+ * pixel centers are left to drawLine(), which draws the same pixels in
+ * 32-bit arithmetic. A line whose endpoints coincide draws nothing. */
+template <typename Sink>
+void drawFixedLine(Sink &sink, int x1, int y1, int x2, int y2)
+{
+    if (fixed::isWhole(x1 | y1 | x2 | y2)) {
+        drawLine(sink, x1 >> fixed::SHIFT, y1 >> fixed::SHIFT,
+                 x2 >> fixed::SHIFT, y2 >> fixed::SHIFT);
+        return;
+    }
+
+    qint64 deltaX = static_cast<qint64>(x2) - x1;
+    qint64 deltaY = static_cast<qint64>(y2) - y1;
+
+    /* |m| <= 1 */
+    if (qAbs(deltaY) <= qAbs(deltaX)) {
+        if (deltaX == 0)
+            return;
+
+        if (x1 > x2) {
+            qSwap(x1, x2);
+            qSwap(y1, y2);
+        }
+        qint64 dx = static_cast<qint64>(x2) - x1;
+        qint64 dy = static_cast<qint64>(y2) - y1;
+
+        if (dy >= 0)
+            drawFixedOctant<X_MAJOR_INC>(sink, x1, y1, dx, dy);
+        else
+            drawFixedOctant<X_MAJOR_DEC>(sink, x1, y1, dx, -dy);
+    }
+    /* |m| > 1 */
+    else {
+        Q_ASSERT(deltaY != 0);
+
+        if (y1 > y2) {
+            qSwap(x1, x2);
+            qSwap(y1, y2);
+        }
+        qint64 dx = static_cast<qint64>(x2) - x1;
+        qint64 dy = static_cast<qint64>(y2) - y1;
+
+        if (dx >= 0)
+            drawFixedOctant<Y_MAJOR_INC>(sink, y1, x1, dy, dx);
+        else
+            drawFixedOctant<Y_MAJOR_DEC>(sink, y1, x1, dy, -dx);
+    }
+}
+
+}
+
+}
+
+#endif // BRESENHAM_H
@@ -0,0 +1,27 @@
+#include "regressioncheck.h"
+#include "trace.h"
+
+#include <QStringList>
+
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+/* The regression check, built by the tests subproject apart from the
+ * programs that ship. Without arguments it checks the corpus the build
+ * points it at, writing the outputs to regression. */
+int main(int argc, char *argv[])
+{
+    QString traceFile = cg::Trace::startFromArguments(argc, argv);
+
+    QStringList args;
+    for (int i = 1; i < argc; ++i)
+        args.append(argv[i]);
+    if (args.isEmpty())
+        args << GOLDEN_MANIFEST << "regression";
+    int status = RegressionCheck().exec(args);
+
+    if (!traceFile.isEmpty() && !cg::Trace::stop())
+        cerr << "Fail to write trace: " << qPrintable(traceFile) << endl;
+    return status;
+}
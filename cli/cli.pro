@@ -0,0 +1,19 @@
+# The command line interface without QtWidgets, so that short scripts
+# don't pay for loading the widget stack and its plugins.
+QT = core gui
+
+TARGET = PainterCLI
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+include(../common.pri)
+include(../core/core.pri)
+
+SOURCES += \
+    ../climain.cpp
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
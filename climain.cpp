@@ -0,0 +1,21 @@
+#include "paintercli.h"
+#include "trace.h"
+
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+/* The command line interface alone. Unlike main.cpp it never starts a
+ * QApplication, so it only links QtCore and QtGui and doesn't load the
+ * widget stack or its plugins. */
+int main(int argc, char *argv[])
+{
+    QString traceFile = cg::Trace::startFromArguments(argc, argv);
+
+    PainterCLI cliApp;
+    int status = cliApp.exec(argc, argv);
+
+    if (!traceFile.isEmpty() && !cg::Trace::stop())
+        cerr << "Fail to write trace: " << qPrintable(traceFile) << endl;
+    return status;
+}
@@ -0,0 +1,23 @@
+# Settings shared by every subproject.
+
+# The following define makes your compiler emit warnings if you use
+# any feature of Qt which has been marked as deprecated (the exact warnings
+# depend on your compiler). Please consult the documentation of the
+# deprecated API in order to know how to port your code away from it.
+DEFINES += QT_DEPRECATED_WARNINGS
+
+# You can also make your code fail to compile if you use deprecated APIs.
+# In order to do so, uncomment the following line.
+# You can also select to disable deprecated APIs only up to a certain version of Qt.
+#DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
+
+CONFIG += c++11
+
+# Let the compiler vectorize loops marked with "#pragma omp simd"
+# without pulling in the OpenMP runtime. Branch-free selects on
+# doubles are only if-converted when FP compares may not trap.
+gcc|clang: QMAKE_CXXFLAGS += -fopenmp-simd -fno-trapping-math
+
+# The sources stay in the top directory.
+INCLUDEPATH += $$PWD
+DEPENDPATH += $$PWD
@@ -0,0 +1,12 @@
+# Links a subproject against the core library.
+
+win32:CONFIG(release, debug|release): COREDIR = $$OUT_PWD/../core/release
+else:win32:CONFIG(debug, debug|release): COREDIR = $$OUT_PWD/../core/debug
+else: COREDIR = $$OUT_PWD/../core
+
+LIBS += -L$$COREDIR -lpaintercore
+win32-g++|!win32: PRE_TARGETDEPS += $$COREDIR/libpaintercore.a
+else: PRE_TARGETDEPS += $$COREDIR/paintercore.lib
+
+# The CLI reads the peak working set for --mem-report.
+win32: LIBS += -lpsapi
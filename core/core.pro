@@ -0,0 +1,53 @@
+# The rendering core shared by the command line and the graphical
+# interface. It must not use QtWidgets.
+QT = core gui
+
+TARGET = paintercore
+TEMPLATE = lib
+CONFIG += staticlib
+
+include(../common.pri)
+
+SOURCES += \
+    ../shape.cpp \
+    ../line.cpp \
+    ../polygon.cpp \
+    ../ellipse.cpp \
+    ../curve.cpp \
+    ../polyline.cpp \
+    ../batchclipper.cpp \
+    ../tiledcanvas.cpp \
+    ../shapestore.cpp \
+    ../scenefile.cpp \
+    ../svgexporter.cpp \
+    ../utils.cpp \
+    ../paintercli.cpp \
+    ../linebenchmark.cpp \
+    ../renderserver.cpp \
+    ../scriptexecutor.cpp \
+    ../scriptgenerator.cpp \
+    ../trace.cpp
+
+HEADERS += \
+    ../shape.h \
+    ../line.h \
+    ../polygon.h \
+    ../ellipse.h \
+    ../curve.h \
+    ../polyline.h \
+    ../batchclipper.h \
+    ../tiledcanvas.h \
+    ../shapestore.h \
+    ../scenefile.h \
+    ../svgexporter.h \
+    ../bresenham.h \
+    ../fixedpoint.h \
+    ../pixelsink.h \
+    ../viewport.h \
+    ../utils.h \
+    ../paintercli.h \
+    ../linebenchmark.h \
+    ../renderserver.h \
+    ../scriptexecutor.h \
+    ../scriptgenerator.h \
+    ../trace.h
@@ -1,72 +1,80 @@
 #include "curve.h"
+#include "fixedpoint.h"
 #include "line.h"
+#include "polyline.h"
+#include "shapestore.h"
+#include "tiledcanvas.h"
 #include "utils.h"
 
 #include <QImage>
+#include <QVarLengthArray>
 #include <QtMath>
 #include <QtDebug>
 
 namespace cg {
 
-Curve::Curve(const QVector<QPoint> &points,
+Curve::Curve(const QVector<QPointF> &points,
              const QColor &color, const QString &algorithm)
-    : vp(points), c(color), alg(algorithm)
+    : Shape(color, algorithm), vp(fixed::fromReal(points))
 {
     Q_ASSERT(vp.size() >= 2);
 }
 
-void Curve::beginTransaction()
+void Curve::swapState(Shape &other)
 {
-    oldvp = vp;
-    Shape::beginTransaction();
+    Curve &o = static_cast<Curve &>(other);
+    qSwap(vp, o.vp);
+    Shape::swapState(other);
 }
 
-void Curve::commitTransaction()
+void Curve::appendTo(ShapeStore &store)
 {
-    Shape::commitTransaction();
+    store.addCurve(vp, rgb, alg);
 }
 
-void Curve::rollbackTransaction()
+void Curve::draw(QImage &canvas)
 {
-    vp = oldvp;
-    Shape::rollbackTransaction();
+    rasterizeFixed(canvas, vp.constData(), vp.size(), rgb, alg);
 }
 
-void Curve::draw(QImage &canvas)
+template <typename Canvas>
+void Curve::rasterizeFixed(Canvas &canvas, const QPoint *controls, int n,
+                           QRgb rgb, Algorithm alg)
 {
-    if (alg == "Bezier")
-        drawByBezier(canvas);
-    else if (alg == "B-spline")
-        drawByBspline(canvas);
-    else
-        drawByDefault(canvas);
+    QVarLengthArray<QPointF, 16> real(n);
+    for (int i = 0; i < n; ++i)
+        real[i] = fixed::toReal(controls[i]);
+    QVector<QPoint> points = flatten(real.constData(), n, alg);
+    Polyline::rasterize(canvas, points.constData(), points.size(),
+                        rgb, Algorithm::DEFAULT);
 }
 
-void Curve::drawByDefault(QImage &canvas)
+QVector<QPoint> Curve::flatten(const QPointF *controls, int n,
+                               Algorithm alg, double step)
 {
-    drawByBezier(canvas);
+    if (alg == Algorithm::B_SPLINE)
+        return flattenByBspline(controls, n, step);
+    return flattenByBezier(controls, n, step);
 }
 
-void Curve::drawByBezier(QImage &canvas)
+QVector<QPoint> Curve::flattenByBezier(const QPointF *controls, int n,
+                                       double step)
 {
-    Q_ASSERT(vp.size() >= 2);
+    Q_ASSERT(n >= 2);
 
-    QPoint prev = calcDeCasteljauPoint(0.0, vp);
-    QPoint cur;
+    QVector<QPoint> points;
+    points.append(calcDeCasteljauPoint(0.0, controls, n));
 
-    double step = 0.001;
-    for (double u = step; u <= 1; u += step) {
-        cur = calcDeCasteljauPoint(u, vp);
-        Line(prev, cur, c, "").draw(canvas);
-        prev = cur;
-    }
+    for (double u = step; u <= 1; u += step)
+        points.append(calcDeCasteljauPoint(u, controls, n));
+    return points;
 }
 
-QPoint Curve::calcDeCasteljauPoint(double u, const QVector<QPoint> &points)
+QPoint Curve::calcDeCasteljauPoint(double u, const QPointF *points, int nPoint)
 {
     QVector<QPointF> vp;
-    for (auto &point : points)
-        vp.append(QPointF(point));
+    for (int i = 0; i < nPoint; ++i)
+        vp.append(points[i]);
 
     int n = vp.size() - 1;
     for (int r = 0; r < n; ++r)
@@ -89,27 +97,22 @@ double Curve::calcLength(const QVector<QPoint> &points)
     return length;
 }
 
-void Curve::drawByBspline(QImage &canvas)
+QVector<QPoint> Curve::flattenByBspline(const QPointF *controls, int nControl,
+                                        double step)
 {
-    Q_ASSERT(vp.size() >= 2);
-    if (vp.size() == 2) {
-        cg::Line(vp[0], vp[1], c, "").draw(canvas);
-        return;
-    }
+    Q_ASSERT(nControl >= 2);
+    if (nControl == 2)
+        return QVector<QPoint>{ controls[0].toPoint(), controls[1].toPoint() };
 
-    int nControl = vp.size();
     int order = 3;
     QVector<double> knots = createKnots(nControl, order);
 
-    QPoint prev = calcDeBoorPoint(0.0, order, vp, knots);
-    QPoint cur;
+    QVector<QPoint> points;
+    points.append(calcDeBoorPoint(0.0, order, controls, nControl, knots));
 
-    double step = 0.001;
-    for (double u = step; u <= 1; u += step) {
-        cur = calcDeBoorPoint(u, order, vp, knots);
-        Line(prev, cur, c, "").draw(canvas);
-        prev = cur;
-    }
+    for (double u = step; u <= 1; u += step)
+        points.append(calcDeBoorPoint(u, order, controls, nControl, knots));
+    return points;
 }
 
 QVector<double> Curve::createKnots(int nControl, int order)
@@ -132,14 +135,14 @@ QVector<double> Curve::createKnots(int nControl, int order)
 }
 
 QPoint Curve::calcDeBoorPoint(double u, int order,
-                              const QVector<QPoint> &controls,
+                              const QPointF *controls, int nControl,
                               const QVector<double> &knots)
 {
     QVector<QPointF> cp;
-    for (auto &controlPoint : controls)
-        cp.append(controlPoint);
+    for (int i = 0; i < nControl; ++i)
+        cp.append(controls[i]);
 
-    int n = controls.size() - 1;
+    int n = nControl - 1;
     for (int r = 1; r <= order - 1; ++r) {
         for (int i = n; i >= r; --i) {
             double lamda = (u - knots[i]) / (knots[i + order - r] - knots[i]);
@@ -147,7 +150,7 @@ QPoint Curve::calcDeBoorPoint(double u, int order,
         }
     }
 
-    int knotIndex = calcKnotIndex(u, controls.size(), order);
+    int knotIndex = calcKnotIndex(u, nControl, order);
     Q_ASSERT(u >= knots[knotIndex]);
     Q_ASSERT(u <= knots[knotIndex + 1]);
     const QPointF &deBoorPoint = cp[knotIndex];
@@ -163,58 +166,60 @@ int Curve::calcKnotIndex(double u, int nControl, int order)
     return knotIndex;
 }
 
-void Curve::translate(const QPoint &d)
+void Curve::translate(const QPointF &d)
 {
-    if (duringTransaction) {
-        Q_ASSERT(vp.size() == oldvp.size());
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = oldvp[i] + d;
-    }
-    else {
-        for (auto &p : vp)
-            p += d;
-    }
+    const Curve &old = backup ? static_cast<const Curve &>(*backup) : *this;
+    Q_ASSERT(vp.size() == old.vp.size());
+    QPoint offset = fixed::fromReal(d);
+    for (int i = 0; i < vp.size(); ++i)
+        vp[i] = old.vp[i] + offset;
 }
 
-void Curve::scale(const QPoint &c, double s)
+void Curve::scale(const QPointF &c, double s)
 {
-    if (duringTransaction) {
-        Q_ASSERT(vp.size() == oldvp.size());
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::scalePoint(oldvp[i], c, s);
-    }
-    else {
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::scalePoint(vp[i], c, s);
-    }
+    const Curve &old = backup ? static_cast<const Curve &>(*backup) : *this;
+    Q_ASSERT(vp.size() == old.vp.size());
+    for (int i = 0; i < vp.size(); ++i)
+        vp[i] = fixed::fromReal(utils::scalePoint(fixed::toReal(old.vp[i]), c, s));
 }
 
-void Curve::rotate(const QPoint &c, double r)
+void Curve::rotate(const QPointF &c, double r)
 {
-    if (duringTransaction) {
-        Q_ASSERT(vp.size() == oldvp.size());
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::rotatePoint(oldvp[i], c, r);
-    }
-    else {
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::rotatePoint(vp[i], c, r);
-    }
+    const Curve &old = backup ? static_cast<const Curve &>(*backup) : *this;
+    Q_ASSERT(vp.size() == old.vp.size());
+    for (int i = 0; i < vp.size(); ++i)
+        vp[i] = fixed::fromReal(utils::rotatePoint(fixed::toReal(old.vp[i]), c, r));
+}
+
+cg::Shape *Curve::clip(const QPointF &p1, const QPointF &p2, const QString &alg)
+{
+    QRectF window = QRectF(p1, p2).normalized();
+    QVector<QPointF> controls = fixed::toReal(vp);
+    QRectF hull = utils::boundingRect(controls.constData(), controls.size());
+
+    if (utils::contains(window, hull))
+        return new Curve(controls, QColor(rgb), algorithmName(this->alg));
+    if (!utils::intersects(window, hull))
+        return nullptr;
+
+    /* The curve lies within the hull of its control points, so the
+     * checks above are conservative. Otherwise clip its flattening. */
+    QVector<QVector<QPointF>> runs{
+        utils::toPointF(flatten(controls.constData(), controls.size(), this->alg))
+    };
+    return cg::Polyline(runs, QColor(rgb), "").clip(p1, p2, alg);
 }
 
 QRect Curve::getRectHull()
 {
     Q_ASSERT(vp.size() >= 2);
-    QPoint topLeft = vp[0];
-    QPoint bottomRight = vp[0];
-    for (int i = 1; i < vp.size(); ++i) {
-        const QPoint &p = vp[i];
-        topLeft.rx() = qMin(topLeft.x(), p.x());
-        topLeft.ry() = qMin(topLeft.y(), p.y());
-        bottomRight.rx() = qMax(bottomRight.x(), p.x());
-        bottomRight.ry() = qMax(bottomRight.y(), p.y());
-    }
-    return QRect(topLeft, bottomRight);
+    QVector<QPointF> controls = fixed::toReal(vp);
+    return utils::pixelRect(utils::boundingRect(controls.constData(), controls.size()));
 }
 
+template void Curve::rasterizeFixed(QImage &, const QPoint *, int,
+                                    QRgb, Algorithm);
+template void Curve::rasterizeFixed(TiledCanvas &, const QPoint *, int,
+                                    QRgb, Algorithm);
+
 }
@@ -11,41 +11,49 @@ namespace cg {
 class Curve : public Shape
 {
 public:
-    Curve(const QVector<QPoint> &points,
+    Curve(const QVector<QPointF> &points,
           const QColor &color, const QString &algorithm);
     ~Curve() = default;
 
     QString shapeName() { return "Curve"; }
-
-    void beginTransaction();
-    void commitTransaction();
-    void rollbackTransaction();
+    Shape *clone() const { return new Curve(*this); }
+    void swapState(Shape &other);
+    qint64 sizeInBytes() const
+    { return sizeof(Curve) + vp.size() * sizeof(QPoint); }
+    void appendTo(ShapeStore &store);
 
     void draw(QImage &canvas);
-    void translate(const QPoint &d);
-    void scale(const QPoint &c, double s);
-    void rotate(const QPoint &c, double r);
+    void translate(const QPointF &d);
+    void scale(const QPointF &c, double s);
+    void rotate(const QPointF &c, double r);
+    cg::Shape *clip(const QPointF &p1, const QPointF &p2, const QString &alg);
 
     QRect getRectHull();
 
+    /* Draws the curve of controls in 24.8 fixed point. */
+    template <typename Canvas>
+    static void rasterizeFixed(Canvas &canvas, const QPoint *controls, int n,
+                               QRgb rgb, Algorithm alg);
+    /* Samples the curve at parameter steps of the given size, rounded
+     * to pixels. */
+    static QVector<QPoint> flatten(const QPointF *controls, int n,
+                                   Algorithm alg, double step = 0.001);
+
 private:
-    void drawByDefault(QImage &canvas);
-    void drawByBezier(QImage &canvas);
-    static QPoint calcDeCasteljauPoint(double u, const QVector<QPoint> &points);
+    static QVector<QPoint> flattenByBezier(const QPointF *controls, int n,
+                                           double step);
+    static QPoint calcDeCasteljauPoint(double u, const QPointF *points, int n);
     static double calcLength(const QVector<QPoint> &points);
 
-    void drawByBspline(QImage &canvas);
+    static QVector<QPoint> flattenByBspline(const QPointF *controls, int n,
+                                            double step);
     static QPoint calcDeBoorPoint(double u, int order,
-                                  const QVector<QPoint> &controls,
+                                  const QPointF *controls, int nControl,
                                   const QVector<double> &knots);
     static QVector<double> createKnots(int nControl, int k);
     static int calcKnotIndex(double u, int nControl, int order);
 
-    QVector<QPoint> vp;
-    QColor c;
-    QString alg;
-
-    QVector<QPoint> oldvp;
+    QVector<QPoint> vp;     /* 24.8 fixed point */
 };
 
 }
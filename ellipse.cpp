@@ -1,190 +1,422 @@
 #include "ellipse.h"
+#include "fixedpoint.h"
 #include "utils.h"
 #include "line.h"
+#include "polyline.h"
+#include "shapestore.h"
+#include "pixelsink.h"
+#include "tiledcanvas.h"
 
 #include <QImage>
 #include <QtMath>
 #include <QtDebug>
 
+#include <cmath>
+
 namespace cg {
 
-Ellipse::Ellipse(const QPoint &center, int rx, int ry,
-                 const QColor &color, const QString &algorithm)
-    : p(center), c(color), alg(algorithm)
+namespace {
+
+template <typename Sink>
+inline void setSymmetricPixel(Sink &sink, const QPoint &p, int x, int y)
 {
-    this->rx = rx;
-    this->ry = ry;
+    Q_ASSERT(x >= 0);
+    Q_ASSERT(y >= 0);
+    sink.plot(p.x() + x, p.y() + y);
+    sink.plot(p.x() + x, p.y() - y);
+    sink.plot(p.x() - x, p.y() + y);
+    sink.plot(p.x() - x, p.y() - y);
 }
 
-Ellipse::Ellipse(const QPoint &topleft, const QPoint &bottomRight,
-                 const QColor &color, const QString &algorithm)
-    : c(color), alg(algorithm)
+struct PointKernel
 {
-    p = (topleft + bottomRight) / 2;
-    rx = qAbs(p.x() - topleft.x());
-    ry = qAbs(p.y() - topleft.y());
+    explicit PointKernel(const QPoint &p) : p(p) {}
+
+    template <typename Sink>
+    void operator()(Sink &sink) const
+    {
+        sink.plot(p.x(), p.y());
+    }
+
+    QPoint p;
+};
+
+/* Traces a non-degenerate ellipse by the midpoint algorithm into whichever
+ * sink withPixelSink() picks. */
+struct BresenhamKernel
+{
+    BresenhamKernel(const QPoint &p, int rx, int ry) : p(p), rx(rx), ry(ry) {}
+
+    template <typename Sink>
+    void operator()(Sink &sink) const
+    {
+        int x = 0, y = ry;
+        int rxSquared = rx * rx, rySquared = ry * ry;
+
+        int decisionParam = 4 * (rySquared - rxSquared * ry) + rxSquared;
+        int deltaDecisionParamIfLe = 4 * (rySquared * (2 * x + 1));
+        int deltaDecisionParamIfG = 4 * (rySquared * (2 * x + 1) - rxSquared * 2 * y);
+        while (rySquared * x < rxSquared * y) {
+            setSymmetricPixel(sink, p, x, y);
+            if (decisionParam <= 0) {
+                ++x;
+                deltaDecisionParamIfLe += 8 * rySquared;
+                deltaDecisionParamIfG += 8 * rySquared;
+                decisionParam += deltaDecisionParamIfLe;
+            }
+            else {
+                ++x;
+                --y;
+                deltaDecisionParamIfLe += 8 * rySquared;
+                deltaDecisionParamIfG += 8 * (rySquared + rxSquared);
+                decisionParam += deltaDecisionParamIfG;
+            }
+        }
+
+        decisionParam = rySquared * (2 * x + 1) * (2 * x + 1)
+                + 4 * (rxSquared * (y - 1) * (y - 1) - rxSquared * rySquared);
+        deltaDecisionParamIfLe = 4 * (rySquared * 2 * x - rxSquared * (2 * y - 1));
+        deltaDecisionParamIfG = 4 * (-rxSquared * (2 * y - 1));
+        while (y >= 0) {
+            setSymmetricPixel(sink, p, x, y);
+            if (decisionParam <= 0) {
+                ++x;
+                --y;
+                deltaDecisionParamIfLe += 8 * (rySquared + rxSquared);
+                deltaDecisionParamIfG += 8 * rxSquared;
+                decisionParam += deltaDecisionParamIfLe;
+            }
+            else {
+                --y;
+                deltaDecisionParamIfLe += 8 * rxSquared;
+                deltaDecisionParamIfG += 8 * rxSquared;
+                decisionParam += deltaDecisionParamIfG;
+            }
+        }
+    }
+
+    QPoint p;
+    int rx, ry;
+};
+
+/* Traces a rotated, non-degenerate ellipse one scanline at a time into
+ * whichever sink withPixelSink() picks.
+ *
+ * Relative to the center the ellipse is A x^2 + B xy + C y^2 = rx^2 ry^2
+ * with A = hy^2 and C = hx^2, where hx and hy are the half extents of its
+ * hull. Solving for x gives its left and right branches
+ *     x = (-B y -+ 2 rx ry sqrt(hy^2 - y^2)) / 2A.
+ * Row y covers the band [y - 1/2, y + 1/2], and each branch contributes
+ * the span of x it sweeps within the band. Consecutive rows share the
+ * branches at their common band edge, so the outline is connected and
+ * each row costs one square root. The ellipse is symmetric about its
+ * center, so row -y is row y mirrored. */
+struct RotatedKernel
+{
+    RotatedKernel(const QPoint &p, int rx, int ry, double theta)
+        : p(p)
+    {
+        double cosTheta = qCos(theta), sinTheta = qSin(theta);
+        double rxSquared = static_cast<double>(rx) * rx;
+        double rySquared = static_cast<double>(ry) * ry;
+        double a = rySquared * cosTheta * cosTheta + rxSquared * sinTheta * sinTheta;
+        double b = 2 * sinTheta * cosTheta * (rySquared - rxSquared);
+        hx = qSqrt(rxSquared * cosTheta * cosTheta + rySquared * sinTheta * sinTheta);
+        hy = qSqrt(a);
+        slope = -b / (2 * a);
+        spread = static_cast<double>(rx) * ry / a;
+        yLeft = b / (2 * hx);
+    }
+
+    template <typename Sink>
+    void operator()(Sink &sink) const
+    {
+        /* Copied to locals, as the sink's stores may alias members. */
+        const int cx = p.x(), cy = p.y();
+        const double halfWidth = hx, halfHeight = hy;
+        const double s = slope, k = spread, turn = yLeft;
+
+        /* Branch offsets are at least -hx. Shifting them positive lets
+         * rounding truncate without a sign test. */
+        const int shift = qFloor(halfWidth) + 1;
+        const double bias = shift + 0.5;
+
+        /* The branches at the lower edge of the current band */
+        double y0 = qMax(-0.5, -halfHeight);
+        double d0 = k * qSqrt(qMax(0.0, halfHeight * halfHeight - y0 * y0));
+        double left0 = s * y0 - d0, right0 = s * y0 + d0;
+
+        int rows = qFloor(halfHeight + 0.5);
+        for (int y = 0; y <= rows; ++y) {
+            double y1 = qMin(y + 0.5, halfHeight);
+            double d1 = k * qSqrt(qMax(0.0, halfHeight * halfHeight - y1 * y1));
+            double left1 = s * y1 - d1, right1 = s * y1 + d1;
+
+            /* The leftmost point lies on row yLeft, the rightmost
+             * on row -yLeft. */
+            double leftMin = qMin(left0, left1), leftMax = qMax(left0, left1);
+            if (y0 <= turn && turn <= y1)
+                leftMin = -halfWidth;
+            double rightMin = qMin(right0, right1), rightMax = qMax(right0, right1);
+            if (y0 <= -turn && -turn <= y1)
+                rightMax = halfWidth;
+
+            int l0 = static_cast<int>(leftMin + bias) - shift;
+            int l1 = static_cast<int>(leftMax + bias) - shift;
+            int r0 = static_cast<int>(rightMin + bias) - shift;
+            int r1 = static_cast<int>(rightMax + bias) - shift;
+            sink.hspan(cx + l0, cx + l1, cy + y);
+            sink.hspan(cx + r0, cx + r1, cy + y);
+            if (y > 0) {
+                sink.hspan(cx - r1, cx - r0, cy - y);
+                sink.hspan(cx - l1, cx - l0, cy - y);
+            }
+
+            y0 = y1;
+            left0 = left1;
+            right0 = right1;
+        }
+    }
+
+    QPoint p;
+    double hx, hy;
+    double slope, spread;   /* branches are slope * y -+ spread * sqrt(...) */
+    double yLeft;
+};
+
+/* Orientations differ by multiples of pi, which map an ellipse onto
+ * itself, so keep them within [0, pi). */
+double normalizeAngle(double theta)
+{
+    theta = std::fmod(theta, M_PI);
+    return theta < 0 ? theta + M_PI : theta;
 }
 
-void Ellipse::beginTransaction()
+/* The half extents of the ellipse's hull along the x and y axes. */
+QPointF halfExtents(double rx, double ry, double theta)
 {
-    oldp = p;
-    oldrx = rx;
-    oldry = ry;
-    Shape::beginTransaction();
+    double cosTheta = qCos(theta), sinTheta = qSin(theta);
+    double rxSquared = rx * rx, rySquared = ry * ry;
+    return QPointF(qSqrt(rxSquared * cosTheta * cosTheta + rySquared * sinTheta * sinTheta),
+                   qSqrt(rxSquared * sinTheta * sinTheta + rySquared * cosTheta * cosTheta));
+}
+
 }
 
-void Ellipse::commitTransaction()
+Ellipse::Ellipse(const QPointF &center, double rx, double ry,
+                 const QColor &color, const QString &algorithm, double theta)
+    : Shape(color, algorithm), p(fixed::fromReal(center))
 {
-    Shape::commitTransaction();
+    this->rx = fixed::fromReal(rx);
+    this->ry = fixed::fromReal(ry);
+    this->theta = normalizeAngle(theta);
 }
 
-void Ellipse::rollbackTransaction()
+Ellipse::Ellipse(const QPointF &topleft, const QPointF &bottomRight,
+                 const QColor &color, const QString &algorithm)
+    : Shape(color, algorithm), theta(0.0)
 {
-    p = oldp;
-    rx = oldrx;
-    ry = oldry;
-    Shape::rollbackTransaction();
+    QPointF center = (topleft + bottomRight) / 2;
+    p = fixed::fromReal(center);
+    rx = fixed::fromReal(qAbs(center.x() - topleft.x()));
+    ry = fixed::fromReal(qAbs(center.y() - topleft.y()));
+}
+
+void Ellipse::swapState(Shape &other)
+{
+    Ellipse &o = static_cast<Ellipse &>(other);
+    qSwap(p, o.p);
+    qSwap(rx, o.rx);
+    qSwap(ry, o.ry);
+    qSwap(theta, o.theta);
+    Shape::swapState(other);
+}
+
+void Ellipse::appendTo(ShapeStore &store)
+{
+    store.addEllipse(p, rx, ry, theta, rgb);
 }
 
 void Ellipse::draw(QImage &canvas)
 {
-    drawByBresenham(canvas);
+    rasterizeFixed(canvas, p, rx, ry, theta, rgb);
+}
+
+template <typename Canvas>
+void Ellipse::rasterize(Canvas &canvas, const QPoint &center,
+                        int rx, int ry, QRgb rgb)
+{
+    drawByDefault(canvas, center, rx, ry, rgb);
 }
 
-void Ellipse::drawByDefault(QImage &canvas)
+template <typename Canvas>
+void Ellipse::rasterize(Canvas &canvas, const QPoint &center,
+                        int rx, int ry, double theta, QRgb rgb)
 {
-    drawByBresenham(canvas);
+    /* Within half a pixel of a multiple of 90 degrees the ellipse is
+     * drawn axis-aligned, which also keeps theta == 0 pixel-exact. */
+    int quarters = qRound(theta / M_PI_2);
+    double delta = theta - quarters * M_PI_2;
+    if (qMax(rx, ry) * qAbs(qSin(delta)) < 0.5) {
+        if (quarters % 2 != 0)
+            qSwap(rx, ry);
+        drawByDefault(canvas, center, rx, ry, rgb);
+        return;
+    }
+
+    if (rx == 0 || ry == 0) {
+        QPoint d = rx == 0
+                ? QPoint(qRound(-ry * qSin(theta)), qRound(ry * qCos(theta)))
+                : QPoint(qRound(rx * qCos(theta)), qRound(rx * qSin(theta)));
+        Line::rasterize(canvas, center - d, center + d, rgb, Algorithm::DEFAULT);
+        return;
+    }
+
+    withPixelSink(canvas, rgb, RotatedKernel(center, rx, ry, theta));
 }
 
-void Ellipse::drawByBresenham(QImage &canvas)
+template <typename Canvas>
+void Ellipse::rasterizeFixed(Canvas &canvas, const QPoint &center,
+                             int rx, int ry, double theta, QRgb rgb)
+{
+    rasterize(canvas, fixed::toPixel(center), fixed::toPixel(rx),
+              fixed::toPixel(ry), theta, rgb);
+}
+
+template <typename Canvas>
+void Ellipse::drawByDefault(Canvas &canvas, const QPoint &p,
+                            int rx, int ry, QRgb rgb)
+{
+    drawByBresenham(canvas, p, rx, ry, rgb);
+}
+
+template <typename Canvas>
+void Ellipse::drawByBresenham(Canvas &canvas, const QPoint &p,
+                              int rx, int ry, QRgb rgb)
 {
     if (rx == 0 && ry == 0) {
-        canvas.setPixel(p, c.rgb());
+        withPixelSink(canvas, rgb, PointKernel(p));
         return;
     }
     if (rx == 0) {
         QPoint p1 = p + QPoint(0, ry);
         QPoint p2 = p - QPoint(0, ry);
-        cg::Line(p1, p2, c, "").draw(canvas);
+        Line::rasterize(canvas, p1, p2, rgb, Algorithm::DEFAULT);
         return;
     }
     if (ry == 0) {
         QPoint p1 = p + QPoint(rx, 0);
         QPoint p2 = p - QPoint(rx, 0);
-        cg::Line(p1, p2, c, "").draw(canvas);
+        Line::rasterize(canvas, p1, p2, rgb, Algorithm::DEFAULT);
         return;
     }
 
-    int x = 0, y = ry;
-    int rxSquared = rx * rx, rySquared = ry * ry;
-
-    int decisionParam = 4 * (rySquared - rxSquared * ry) + rxSquared;
-    int deltaDecisionParamIfLe = 4 * (rySquared * (2 * x + 1));
-    int deltaDecisionParamIfG = 4 * (rySquared * (2 * x + 1) - rxSquared * 2 * y);
-    while (rySquared * x < rxSquared * y) {
-        setSymmetricPixel(canvas, x, y);
-        if (decisionParam <= 0) {
-            ++x;
-            deltaDecisionParamIfLe += 8 * rySquared;
-            deltaDecisionParamIfG += 8 * rySquared;
-            decisionParam += deltaDecisionParamIfLe;
-        }
-        else {
-            ++x;
-            --y;
-            deltaDecisionParamIfLe += 8 * rySquared;
-            deltaDecisionParamIfG += 8 * (rySquared + rxSquared);
-            decisionParam += deltaDecisionParamIfG;
-        }
-    }
+    withPixelSink(canvas, rgb, BresenhamKernel(p, rx, ry));
+}
 
-    decisionParam = rySquared * (2 * x + 1) * (2 * x + 1)
-            + 4 * (rxSquared * (y - 1) * (y - 1) - rxSquared * rySquared);
-    deltaDecisionParamIfLe = 4 * (rySquared * 2 * x - rxSquared * (2 * y - 1));
-    deltaDecisionParamIfG = 4 * (-rxSquared * (2 * y - 1));
-    while (y >= 0) {
-        setSymmetricPixel(canvas, x, y);
-        if (decisionParam <= 0) {
-            ++x;
-            --y;
-            deltaDecisionParamIfLe += 8 * (rySquared + rxSquared);
-            deltaDecisionParamIfG += 8 * rxSquared;
-            decisionParam += deltaDecisionParamIfLe;
-        }
-        else {
-            --y;
-            deltaDecisionParamIfLe += 8 * rxSquared;
-            deltaDecisionParamIfG += 8 * rxSquared;
-            decisionParam += deltaDecisionParamIfG;
-        }
-    }
+void Ellipse::translate(const QPointF &d)
+{
+    const Ellipse &old = backup ? static_cast<const Ellipse &>(*backup) : *this;
+    p = old.p + fixed::fromReal(d);
 }
 
-void Ellipse::setSymmetricPixel(QImage &canvas, int x, int y)
+void Ellipse::scale(const QPointF &c, double s)
 {
-    Q_ASSERT(x >= 0);
-    Q_ASSERT(y >= 0);
-    canvas.setPixel(p.x() + x, p.y() + y, c.rgb());
-    canvas.setPixel(p.x() + x, p.y() - y, c.rgb());
-    canvas.setPixel(p.x() - x, p.y() + y, c.rgb());
-    canvas.setPixel(p.x() - x, p.y() - y, c.rgb());
+    const Ellipse &old = backup ? static_cast<const Ellipse &>(*backup) : *this;
+    p = fixed::fromReal(utils::scalePoint(fixed::toReal(old.p), c, s));
+    rx = fixed::fromReal(qAbs(fixed::toReal(old.rx) * s));
+    ry = fixed::fromReal(qAbs(fixed::toReal(old.ry) * s));
 }
 
-void Ellipse::translate(const QPoint &d)
+void Ellipse::rotate(const QPointF &c, double r)
 {
-    if (duringTransaction) {
-        p = oldp + d;
-    }
-    else {
-        p += d;
-    }
+    const Ellipse &old = backup ? static_cast<const Ellipse &>(*backup) : *this;
+    p = fixed::fromReal(utils::rotatePoint(fixed::toReal(old.p), c, r));
+    theta = normalizeAngle(old.theta + r);
 }
 
-void Ellipse::scale(const QPoint &c, double s)
+cg::Shape *Ellipse::clip(const QPointF &p1, const QPointF &p2,
+                         const QString &alg)
 {
-    if (duringTransaction) {
-        p = utils::scalePoint(oldp, c, s);
-        rx = qAbs(static_cast<int>(oldrx * s));
-        ry = qAbs(static_cast<int>(oldry * s));
-    }
-    else {
-        p = utils::scalePoint(p, c, s);
-        rx = qAbs(static_cast<int>(rx * s));
-        ry = qAbs(static_cast<int>(ry * s));
+    QRectF window = QRectF(p1, p2).normalized();
+    QPointF center = fixed::toReal(p);
+    double rx = fixed::toReal(this->rx), ry = fixed::toReal(this->ry);
+    QPointF h = halfExtents(rx, ry, theta);
+    QRectF hull(center - h, center + h);
+
+    if (utils::contains(window, hull))
+        return new Ellipse(center, rx, ry, QColor(rgb), algorithmName(this->alg), theta);
+    if (!utils::intersects(window, hull))
+        return nullptr;
+
+    /* A degenerate ellipse is drawn as a line, so clip it as a line. */
+    if (rx == 0 || ry == 0) {
+        double cosTheta = qCos(theta), sinTheta = qSin(theta);
+        QPointF d = rx == 0 ? QPointF(-ry * sinTheta, ry * cosTheta)
+                            : QPointF(rx * cosTheta, rx * sinTheta);
+        return cg::Line(center - d, center + d, QColor(rgb), "").clip(p1, p2, alg);
     }
+
+    /* Clipping the outline as a polygon would add edges along the window
+     * that were never part of the ellipse, so clip it as a closed run. */
+    QVector<QPointF> outline = flatten();
+    outline.append(outline.first());
+    QVector<QVector<QPointF>> runs{ outline };
+    return cg::Polyline(runs, QColor(rgb), "").clip(p1, p2, alg);
 }
 
-void Ellipse::rotate(const QPoint &c, double r)
+QVector<QPointF> Ellipse::flatten()
 {
-    static const double aTheta[] = { -M_PI_2, 0.0, M_PI_2, M_PI };
-    static const int aThetaSize = sizeof(aTheta) / sizeof(aTheta[0]);
+    QPointF center = fixed::toReal(p);
+    double rx = fixed::toReal(this->rx), ry = fixed::toReal(this->ry);
+    /* Roughly one vertex every two pixels along the perimeter. */
+    int n = qMax(16, qRound(M_PI * (rx + ry) / 2));
 
-    for (int i = 0; i < aThetaSize; ++i) {
-        if (qAbs(aTheta[i] - r) <= 0.1) {
-            if (duringTransaction) {
-                p = utils::rotatePoint(oldp, c, r);
-                if (i % 2 == 0) {
-                    rx = oldry;
-                    ry = oldrx;
-                }
-                else {
-                    rx = oldrx;
-                    ry = oldry;
-                }
-            }
-            else {
-                p = utils::rotatePoint(p, c, r);
-                if (i % 2 == 0) {
-                    std::swap(rx, ry);
-                }
-            }
-        }
+    double cosTheta = qCos(theta), sinTheta = qSin(theta);
+
+    QVector<QPointF> points;
+    points.reserve(n);
+    for (int i = 0; i < n; ++i) {
+        double t = 2 * M_PI * i / n;
+        double x = rx * qCos(t), y = ry * qSin(t);
+        QPointF point(center.x() + x * cosTheta - y * sinTheta,
+                      center.y() + x * sinTheta + y * cosTheta);
+        if (points.isEmpty() || points.back() != point)
+            points.append(point);
     }
+    return points;
 }
 
 QRect Ellipse::getRectHull()
 {
-    return QRect(p.x() - rx, p.y() - ry, 2 * rx, 2 * ry);
+    return rectHullFixed(p, rx, ry, theta);
 }
 
+QRect Ellipse::rectHull(const QPoint &center, int rx, int ry, double theta)
+{
+    QPointF extents = halfExtents(rx, ry, theta);
+
+    /* Don't let rounding error grow an axis-aligned hull. */
+    int w = qCeil(extents.x() - 1e-9), h = qCeil(extents.y() - 1e-9);
+    return QRect(center.x() - w, center.y() - h, 2 * w, 2 * h);
+}
+
+QRect Ellipse::rectHullFixed(const QPoint &center, int rx, int ry,
+                             double theta)
+{
+    return rectHull(fixed::toPixel(center), fixed::toPixel(rx),
+                    fixed::toPixel(ry), theta);
+}
+
+template void Ellipse::rasterize(QImage &, const QPoint &, int, int, QRgb);
+template void Ellipse::rasterize(TiledCanvas &, const QPoint &, int, int, QRgb);
+template void Ellipse::rasterize(QImage &, const QPoint &, int, int,
+                                 double, QRgb);
+template void Ellipse::rasterize(TiledCanvas &, const QPoint &, int, int,
+                                 double, QRgb);
+template void Ellipse::rasterizeFixed(QImage &, const QPoint &, int, int,
+                                      double, QRgb);
+template void Ellipse::rasterizeFixed(TiledCanvas &, const QPoint &, int, int,
+                                      double, QRgb);
+
 }
@@ -4,44 +4,64 @@
 #include "shape.h"
 
 #include <QColor>
+#include <QVector>
 
 namespace cg {
 
 class Ellipse : public Shape
 {
 public:
-    Ellipse(const QPoint &center, int rx, int ry,
-            const QColor &color, const QString &algorithm);
-    Ellipse(const QPoint &topleft, const QPoint &bottomRight,
+    /* theta is the angle in radians from the x axis to the rx axis. */
+    Ellipse(const QPointF &center, double rx, double ry,
+            const QColor &color, const QString &algorithm,
+            double theta = 0.0);
+    Ellipse(const QPointF &topleft, const QPointF &bottomRight,
             const QColor &color, const QString &algorithm);
     ~Ellipse() = default;
 
     QString shapeName() { return "Ellipse"; }
-
-    void beginTransaction();
-    void commitTransaction();
-    void rollbackTransaction();
+    Shape *clone() const { return new Ellipse(*this); }
+    void swapState(Shape &other);
+    qint64 sizeInBytes() const { return sizeof(Ellipse); }
+    void appendTo(ShapeStore &store);
 
     void draw(QImage &canvas);
-    void translate(const QPoint &d);
-    void scale(const QPoint &c, double s);
-    void rotate(const QPoint &c, double r);
+    void translate(const QPointF &d);
+    void scale(const QPointF &c, double s);
+    void rotate(const QPointF &c, double r);
+    cg::Shape *clip(const QPointF &p1, const QPointF &p2, const QString &alg);
 
     QRect getRectHull();
 
+    template <typename Canvas>
+    static void rasterize(Canvas &canvas, const QPoint &center,
+                          int rx, int ry, QRgb rgb);
+    template <typename Canvas>
+    static void rasterize(Canvas &canvas, const QPoint &center,
+                          int rx, int ry, double theta, QRgb rgb);
+    /* The same for a center and radii in 24.8 fixed point. The midpoint
+     * kernel relies on the symmetry of the ellipse about a pixel, so
+     * they are rounded to whole pixels first. */
+    template <typename Canvas>
+    static void rasterizeFixed(Canvas &canvas, const QPoint &center,
+                               int rx, int ry, double theta, QRgb rgb);
+    static QRect rectHull(const QPoint &center, int rx, int ry, double theta);
+    static QRect rectHullFixed(const QPoint &center, int rx, int ry,
+                               double theta);
+
 private:
-    void drawByDefault(QImage &canvas);
-    void drawByBresenham(QImage &canvas);
-    void setSymmetricPixel(QImage &canvas, int x, int y);
+    template <typename Canvas>
+    static void drawByDefault(Canvas &canvas, const QPoint &p,
+                              int rx, int ry, QRgb rgb);
+    template <typename Canvas>
+    static void drawByBresenham(Canvas &canvas, const QPoint &p,
+                                int rx, int ry, QRgb rgb);
 
-    QPoint p;
-    int rx, ry;
-    QColor c;
-    QString alg;
+    QVector<QPointF> flatten();
 
-    /* for transaction */
-    QPoint oldp;
-    int oldrx, oldry;
+    QPoint p;           /* 24.8 fixed point, as are the radii */
+    int rx, ry;
+    double theta;
 };
 
 }
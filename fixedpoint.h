@@ -0,0 +1,104 @@
+#ifndef FIXEDPOINT_H
+#define FIXEDPOINT_H
+
+#include <QPoint>
+#include <QPointF>
+#include <QVector>
+#include <QtGlobal>
+
+namespace cg {
+
+/* 24.8 fixed point coordinates, which the store keeps shapes in and the
+ * line kernels step in. Pixels are centered on whole numbers, so a
+ * coordinate falls on the pixel it rounds to, with halves rounding up.
+ * Right shifts of negative numbers floor, as they do on every compiler
+ * Painter builds with. */
+namespace fixed {
+
+enum { SHIFT = 8, ONE = 1 << SHIFT, HALF = ONE / 2, FRACTION = ONE - 1 };
+
+/* Coordinates are clamped to some four million pixels either way, which
+ * leaves the differences of two coordinates room in an int. */
+enum { LIMIT = (1 << 30) - 1 };
+
+inline int fromReal(double v)
+{
+    return qRound(qBound(-static_cast<double>(LIMIT), v * ONE,
+                         static_cast<double>(LIMIT)));
+}
+
+inline QPoint fromReal(const QPointF &p)
+{
+    return QPoint(fromReal(p.x()), fromReal(p.y()));
+}
+
+inline QVector<QPoint> fromReal(const QVector<QPointF> &points)
+{
+    QVector<QPoint> result(points.size());
+    for (int i = 0; i < points.size(); ++i)
+        result[i] = fromReal(points[i]);
+    return result;
+}
+
+inline QPoint fromPixel(const QPoint &p)
+{
+    return QPoint(p.x() * ONE, p.y() * ONE);
+}
+
+inline double toReal(int v)
+{
+    return static_cast<double>(v) / ONE;
+}
+
+inline QPointF toReal(const QPoint &p)
+{
+    return QPointF(toReal(p.x()), toReal(p.y()));
+}
+
+inline QVector<QPointF> toReal(const QVector<QPoint> &points)
+{
+    QVector<QPointF> result(points.size());
+    for (int i = 0; i < points.size(); ++i)
+        result[i] = toReal(points[i]);
+    return result;
+}
+
+/* The pixel v falls on. */
+inline int toPixel(int v)
+{
+    return (v + HALF) >> SHIFT;
+}
+
+inline QPoint toPixel(const QPoint &p)
+{
+    return QPoint(toPixel(p.x()), toPixel(p.y()));
+}
+
+/* The pixel a real coordinate falls on, rounded the way the store
+ * rounds it. */
+inline int roundToPixel(double v)
+{
+    return toPixel(fromReal(v));
+}
+
+inline QPoint roundToPixel(const QPointF &p)
+{
+    return toPixel(fromReal(p));
+}
+
+/* Whether v lies on the center of a pixel. */
+inline bool isWhole(int v)
+{
+    return (v & FRACTION) == 0;
+}
+
+inline bool isWhole(const QPoint &p)
+{
+    return isWhole(p.x() | p.y());
+}
+
+}
+
+}
+
+#endif // FIXEDPOINT_H
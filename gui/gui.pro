@@ -0,0 +1,37 @@
+QT       += core gui
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = Painter
+TEMPLATE = app
+
+include(../common.pri)
+include(../core/core.pri)
+
+SOURCES += \
+        ../main.cpp \
+        ../mainwindow.cpp \
+    ../painter.cpp \
+    ../renderworker.cpp \
+    ../shapelistmodel.cpp \
+    ../journal.cpp \
+    ../qsizedialog.cpp
+
+HEADERS += \
+        ../mainwindow.h \
+    ../painter.h \
+    ../renderworker.h \
+    ../shapelistmodel.h \
+    ../journal.h \
+    ../qsizedialog.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
+
+RESOURCES += \
+    ../painter.qrc
+
+FORMS += \
+    ../qsizedialog.ui
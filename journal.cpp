@@ -0,0 +1,230 @@
+#include "journal.h"
+
+#include <QSet>
+#include <QtAlgorithms>
+
+namespace cg {
+
+Journal::Journal(QList<Shape *> &shapes, qint64 budget)
+    : shapes(shapes), applied(0), budget(budget), usage(0)
+{
+
+}
+
+Journal::~Journal()
+{
+    clear();
+}
+
+void Journal::setBudget(qint64 bytes)
+{
+    budget = bytes;
+    trim();
+}
+
+void Journal::recordTranslate(Shape *shape, const QPoint &d)
+{
+    Entry entry;
+    entry.kind = TRANSLATE;
+    entry.shape = shape;
+    entry.to = d;
+    entry.size = sizeof(Entry);
+    record(entry);
+}
+
+void Journal::recordSetCenter(Shape *shape, const QPoint &oldCenter,
+                              const QPoint &newCenter)
+{
+    Entry entry;
+    entry.kind = SET_CENTER;
+    entry.shape = shape;
+    entry.from = oldCenter;
+    entry.to = newCenter;
+    entry.size = sizeof(Entry);
+    record(entry);
+}
+
+void Journal::recordChange(Shape *shape, Shape *snapshot)
+{
+    Entry entry;
+    entry.kind = CHANGE;
+    entry.shape = shape;
+    entry.other = snapshot;
+    entry.size = sizeof(Entry) + snapshot->sizeInBytes();
+    record(entry);
+}
+
+void Journal::recordReplace(Shape *removed, int removedIndex,
+                            Shape *added, int addedIndex)
+{
+    Entry entry;
+    entry.kind = REPLACE;
+    entry.shape = removed;
+    entry.shapeIndex = removedIndex;
+    entry.other = added;
+    entry.otherIndex = addedIndex;
+    entry.size = sizeof(Entry) + (removed ? removed->sizeInBytes() : 0);
+    record(entry);
+}
+
+void Journal::recordReplaceAll(const QList<Shape *> &before,
+                               const QList<Shape *> &after)
+{
+    Entry entry;
+    entry.kind = REPLACE_ALL;
+    entry.before = before;
+    entry.after = after;
+    entry.size = sizeof(Entry)
+            + (before.size() + after.size()) * sizeof(Shape *)
+            + sizeOf(subtract(before, after));
+    record(entry);
+}
+
+void Journal::undo(QList<Shape *> &removed, QList<Shape *> &added,
+                   QList<Shape *> &changed)
+{
+    if (!canUndo())
+        return;
+    apply(entries[--applied], false, removed, added, changed);
+}
+
+void Journal::redo(QList<Shape *> &removed, QList<Shape *> &added,
+                   QList<Shape *> &changed)
+{
+    if (!canRedo())
+        return;
+    apply(entries[applied++], true, removed, added, changed);
+}
+
+void Journal::clear()
+{
+    for (int i = 0; i < entries.size(); ++i)
+        dropEntry(entries[i], i < applied);
+    entries.clear();
+    applied = 0;
+    usage = 0;
+}
+
+void Journal::record(Entry &entry)
+{
+    /* A new operation ends the redo history. */
+    while (entries.size() > applied) {
+        dropEntry(entries.last(), false);
+        usage -= entries.last().size;
+        entries.removeLast();
+    }
+
+    entries.append(entry);
+    ++applied;
+    usage += entry.size;
+    trim();
+}
+
+void Journal::apply(Entry &entry, bool forward, QList<Shape *> &removed,
+                    QList<Shape *> &added, QList<Shape *> &changed)
+{
+    switch (entry.kind) {
+    case TRANSLATE:
+        entry.shape->translate(forward ? entry.to : -entry.to);
+        changed.append(entry.shape);
+        break;
+    case SET_CENTER:
+        entry.shape->setCenter(forward ? entry.to : entry.from);
+        changed.append(entry.shape);
+        break;
+    case CHANGE:
+        entry.shape->swapState(*entry.other);
+        changed.append(entry.shape);
+        break;
+    case REPLACE:
+        if (forward) {
+            if (entry.shape) {
+                Q_ASSERT(shapes[entry.shapeIndex] == entry.shape);
+                shapes.removeAt(entry.shapeIndex);
+                removed.append(entry.shape);
+            }
+            if (entry.other) {
+                shapes.insert(entry.otherIndex, entry.other);
+                added.append(entry.other);
+            }
+        }
+        else {
+            if (entry.other) {
+                Q_ASSERT(shapes[entry.otherIndex] == entry.other);
+                shapes.removeAt(entry.otherIndex);
+                removed.append(entry.other);
+            }
+            if (entry.shape) {
+                shapes.insert(entry.shapeIndex, entry.shape);
+                added.append(entry.shape);
+            }
+        }
+        break;
+    case REPLACE_ALL: {
+        const QList<Shape *> &from = forward ? entry.before : entry.after;
+        const QList<Shape *> &to = forward ? entry.after : entry.before;
+        removed.append(subtract(from, to));
+        added.append(subtract(to, from));
+        shapes = to;
+        break;
+    }
+    default:
+        Q_ASSERT(0); /* Should not reach here */
+        break;
+    }
+}
+
+void Journal::dropEntry(Entry &entry, bool isApplied)
+{
+    /* Delete the shapes only this entry still refers to: the ones it
+     * removed if it is applied, or would add if it is not. */
+    switch (entry.kind) {
+    case CHANGE:
+        delete entry.other;
+        break;
+    case REPLACE:
+        delete (isApplied ? entry.shape : entry.other);
+        break;
+    case REPLACE_ALL:
+        qDeleteAll(isApplied ? subtract(entry.before, entry.after)
+                             : subtract(entry.after, entry.before));
+        break;
+    default:
+        break;
+    }
+}
+
+void Journal::trim()
+{
+    while (usage > budget && applied > 0 && entries.size() > 1) {
+        dropEntry(entries.first(), true);
+        usage -= entries.first().size;
+        entries.removeFirst();
+        --applied;
+    }
+}
+
+QList<Shape *> Journal::subtract(const QList<Shape *> &a,
+                                 const QList<Shape *> &b)
+{
+    QSet<Shape *> excluded;
+    excluded.reserve(b.size());
+    for (Shape *shape : b)
+        excluded.insert(shape);
+
+    QList<Shape *> result;
+    for (Shape *shape : a)
+        if (!excluded.contains(shape))
+            result.append(shape);
+    return result;
+}
+
+qint64 Journal::sizeOf(const QList<Shape *> &shapes)
+{
+    qint64 size = 0;
+    for (Shape *shape : shapes)
+        size += shape->sizeInBytes();
+    return size;
+}
+
+}
@@ -0,0 +1,93 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "shape.h"
+
+#include <QList>
+#include <QPoint>
+
+namespace cg {
+
+/* A multi-level undo/redo history for a list of shapes.
+ *
+ * Operations are recorded after they have been applied to the list.
+ * Those that can be inverted exactly, translations and moves of the
+ * center, are kept as their parameters. Others keep a snapshot: a clone
+ * of the shape taken before the operation, whose vertex arrays are
+ * shared with the shape until it changes them. Undoing or redoing such
+ * an operation just exchanges the states of the shape and its snapshot.
+ *
+ * Shapes removed from the list stay alive in the journal until the
+ * operation removing them is dropped. The journal keeps its memory
+ * under a budget by dropping the oldest operations, but always keeps
+ * the newest one. */
+class Journal
+{
+public:
+    explicit Journal(QList<Shape *> &shapes, qint64 budget = DEFAULT_BUDGET);
+    ~Journal();
+
+    qint64 getBudget() const { return budget; }
+    void setBudget(qint64 bytes);
+    qint64 getUsage() const { return usage; }
+
+    bool canUndo() const { return applied > 0; }
+    bool canRedo() const { return applied < entries.size(); }
+
+    void recordTranslate(Shape *shape, const QPoint &d);
+    void recordSetCenter(Shape *shape, const QPoint &oldCenter,
+                         const QPoint &newCenter);
+    void recordChange(Shape *shape, Shape *snapshot);
+    void recordReplace(Shape *removed, int removedIndex,
+                       Shape *added, int addedIndex);
+    void recordReplaceAll(const QList<Shape *> &before,
+                          const QList<Shape *> &after);
+
+    /* The shapes leaving and entering the list are appended to
+     * removed and added, and those changed in place to changed. */
+    void undo(QList<Shape *> &removed, QList<Shape *> &added,
+              QList<Shape *> &changed);
+    void redo(QList<Shape *> &removed, QList<Shape *> &added,
+              QList<Shape *> &changed);
+
+    void clear();
+
+    enum { DEFAULT_BUDGET = 128 * 1024 * 1024 };
+
+private:
+    // enum for Entry::kind
+    enum { TRANSLATE, SET_CENTER, CHANGE, REPLACE, REPLACE_ALL };
+
+    struct Entry {
+        Entry() : kind(TRANSLATE), shape(nullptr), other(nullptr),
+            shapeIndex(-1), otherIndex(-1), size(0) {}
+
+        int kind;
+        Shape *shape;       /* TRANSLATE, SET_CENTER, CHANGE; removed for REPLACE */
+        Shape *other;       /* CHANGE: the snapshot; REPLACE: added */
+        QPoint from, to;    /* TRANSLATE: (0, 0) and d; SET_CENTER: centers */
+        int shapeIndex, otherIndex;     /* REPLACE */
+        QList<Shape *> before, after;   /* REPLACE_ALL */
+        qint64 size;
+    };
+
+    void record(Entry &entry);
+    void apply(Entry &entry, bool forward, QList<Shape *> &removed,
+               QList<Shape *> &added, QList<Shape *> &changed);
+    void dropEntry(Entry &entry, bool isApplied);
+    void trim();
+
+    static QList<Shape *> subtract(const QList<Shape *> &a,
+                                   const QList<Shape *> &b);
+    static qint64 sizeOf(const QList<Shape *> &shapes);
+
+    QList<Shape *> &shapes;
+    QList<Entry> entries;
+    int applied;        /* entries[0, applied) are applied */
+    qint64 budget;
+    qint64 usage;
+};
+
+}
+
+#endif // JOURNAL_H
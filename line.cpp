@@ -1,4 +1,9 @@
 #include "line.h"
+#include "bresenham.h"
+#include "fixedpoint.h"
+#include "pixelsink.h"
+#include "shapestore.h"
+#include "tiledcanvas.h"
 #include "utils.h"
 
 #include <QImage>
@@ -6,235 +11,182 @@
 
 namespace cg {
 
-Line::Line(const QPoint &point1, const QPoint &point2,
-           const QColor &color, const QString &algorithm)
-    : p1(point1), p2(point2), c(color), alg(algorithm)
+namespace {
+
+/* Draws one line by DDA into whichever sink withPixelSink() picks.
+ * The endpoints are in 24.8 fixed point. */
+struct DDAKernel
+{
+    DDAKernel(const QPoint &p1, const QPoint &p2) : p1(p1), p2(p2) {}
+
+    template <typename Sink>
+    void operator()(Sink &sink) const
+    {
+        int x1 = p1.x(), x2 = p2.x();
+        int y1 = p1.y(), y2 = p2.y();
+        int deltaX = x2 - x1;
+        int deltaY = y2 - y1;
+
+        /* Pixels run from the one the start falls on, and the line is
+         * first taken at that pixel's center. */
+        if (qAbs(deltaY) <= qAbs(deltaX)) {
+            if (deltaX == 0)
+                return;
+
+            int xBegin = qMin(x1, x2);
+            int x = fixed::toPixel(xBegin);
+            int xEnd = fixed::toPixel(qMax(x1, x2));
+            double dy = static_cast<double>(deltaY) / deltaX;
+            double y = fixed::toReal(x1 < x2 ? y1 : y2)
+                    + (x - fixed::toReal(xBegin)) * dy;
+
+            while (x != xEnd) {
+                sink.plot(x, qRound(y));
+                y += dy;
+                x++;
+            }
+        }
+        else {
+            Q_ASSERT(deltaY != 0);
+
+            int yBegin = qMin(y1, y2);
+            int y = fixed::toPixel(yBegin);
+            int yEnd = fixed::toPixel(qMax(y1, y2));
+            double dx = static_cast<double>(deltaX) / deltaY;
+            double x = fixed::toReal(y1 < y2 ? x1 : x2)
+                    + (y - fixed::toReal(yBegin)) * dx;
+
+            while (y != yEnd) {
+                sink.plot(qRound(x), y);
+                x += dx;
+                y++;
+            }
+        }
+    }
+
+    QPoint p1, p2;
+};
+
+/* Draws one line by Bresenham into whichever sink withPixelSink() picks.
+ * The endpoints are in 24.8 fixed point. */
+struct BresenhamKernel
 {
+    BresenhamKernel(const QPoint &p1, const QPoint &p2) : p1(p1), p2(p2) {}
+
+    template <typename Sink>
+    void operator()(Sink &sink) const
+    {
+        bresenham::drawFixedLine(sink, p1.x(), p1.y(), p2.x(), p2.y());
+    }
+
+    QPoint p1, p2;
+};
 
 }
 
-void Line::beginTransaction()
+Line::Line(const QPointF &point1, const QPointF &point2,
+           const QColor &color, const QString &algorithm)
+    : Shape(color, algorithm),
+      p1(fixed::fromReal(point1)), p2(fixed::fromReal(point2))
 {
-    oldp1 = p1;
-    oldp2 = p2;
-    Shape::beginTransaction();
+
 }
 
-void Line::commitTransaction()
+void Line::swapState(Shape &other)
 {
-    Shape::commitTransaction();
+    Line &o = static_cast<Line &>(other);
+    qSwap(p1, o.p1);
+    qSwap(p2, o.p2);
+    Shape::swapState(other);
 }
 
-void Line::rollbackTransaction()
+void Line::appendTo(ShapeStore &store)
 {
-    p1 = oldp1;
-    p2 = oldp2;
-    Shape::rollbackTransaction();
+    store.addLine(p1, p2, rgb, alg);
 }
 
 void Line::draw(QImage &canvas)
 {
-    if (alg == "DDA")
-        drawByDDA(canvas);
-    else if (alg == "Bresenham")
-        drawByBresenham(canvas);
-    else
-        drawByDefault(canvas);
+    rasterizeFixed(canvas, p1, p2, rgb, alg);
 }
 
-void Line::drawByDefault(QImage &canvas)
+template <typename Canvas>
+void Line::rasterize(Canvas &canvas, const QPoint &p1, const QPoint &p2,
+                     QRgb rgb, Algorithm alg)
 {
-    drawByBresenham(canvas);
+    rasterizeFixed(canvas, fixed::fromPixel(p1), fixed::fromPixel(p2),
+                   rgb, alg);
 }
 
-void Line::drawByDDA(QImage &canvas)
+template <typename Canvas>
+void Line::rasterizeFixed(Canvas &canvas, const QPoint &p1, const QPoint &p2,
+                          QRgb rgb, Algorithm alg)
 {
-    int x1 = p1.x(), x2 = p2.x();
-    int y1 = p1.y(), y2 = p2.y();
-    int deltaX = x2 - x1;
-    int deltaY = y2 - y1;
-
-    if (qAbs(deltaY) <= qAbs(deltaX)) {
-        if (deltaX == 0)
-            return;
-
-        int x = qMin(x1, x2);
-        int xEnd = qMax(x1, x2);
-        double y = static_cast<double>(x1 < x2 ? y1 : y2);
-        double dy = static_cast<double>(deltaY) / deltaX;
-
-        while (x != xEnd) {
-            setPixel(canvas, x, qRound(y));
-            y += dy;
-            x++;
-        }
-    }
-    else {
-        Q_ASSERT(deltaY != 0);
-
-        int y = qMin(y1, y2);
-        int yEnd = qMax(y1, y2);
-        double x = static_cast<double>(y1 < y2 ? x1 : x2);
-        double dx = static_cast<double>(deltaX) / deltaY;
-
-        while (y != yEnd) {
-            setPixel(canvas, qRound(x), y);
-            x += dx;
-            y++;
-        }
-    }
+    if (alg == Algorithm::DDA)
+        drawByDDA(canvas, p1, p2, rgb);
+    else if (alg == Algorithm::BRESENHAM)
+        drawByBresenham(canvas, p1, p2, rgb);
+    else
+        drawByDefault(canvas, p1, p2, rgb);
 }
 
-void Line::drawByBresenham(QImage &canvas)
+template <typename Canvas>
+void Line::drawByDefault(Canvas &canvas, const QPoint &p1,
+                         const QPoint &p2, QRgb rgb)
 {
-    /* Let y = mx + b be the line determined by p1 and p2. */
-    int x1 = p1.x(), x2 = p2.x();
-    int y1 = p1.y(), y2 = p2.y();
-    int deltaX = x2 - x1;
-    int deltaY = y2 - y1;
-
-
-    /* |m| <= 1 */
-    if (qAbs(deltaY) <= qAbs(deltaX)) {
-        if (deltaX == 0)
-            return;
-
-        if (x1 > x2) {
-            qSwap(x1, x2);
-            qSwap(y1, y2);
-        }
-        int x = x1, y = y1;
-        int dx = x2 - x1;
-        int dy = y2 - y1;
-
-        /* 0 <= m <= 1*/
-        if (dy >= 0) {
-            int decisionParam = 2 * dy - dx;
-            for (; x <= x2; ++x) {
-                setPixel(canvas, x, y);
-                if (decisionParam >= 0) {
-                    ++y;
-                    decisionParam += 2 * (dy - dx);
-                }
-                else {
-                    decisionParam += 2 * dy;
-                }
-            }
-        }
-        /* -1 <= m < 0 */
-        else {
-            int decisionParam = 2 * dy + dx;
-            for (; x <= x2; ++x) {
-                setPixel(canvas, x, y);
-                if (decisionParam >= 0) {
-                    decisionParam += 2 * dy;
-                }
-                else {
-                    --y;
-                    decisionParam += 2 * (dy + dx);
-                }
-            }
-        }
-    }
-    /* |m| > 1 */
-    else {
-        Q_ASSERT(deltaY != 0);
+    drawByBresenham(canvas, p1, p2, rgb);
+}
 
-        if (y1 > y2) {
-            qSwap(x1, x2);
-            qSwap(y1, y2);
-        }
-        int x = x1, y = y1;
-        int dx = x2 - x1;
-        int dy = y2 - y1;
-
-        /* m > 1 */
-        if (dx >= 0) {
-            int decisionParam = - (2 * dx - dy);
-            for (; y <= y2; ++y) {
-                setPixel(canvas, x, y);
-                if (decisionParam <= 0) {
-                    ++x;
-                    decisionParam -= 2 * (dx - dy);
-                }
-                else {
-                    decisionParam -= 2 * dx;
-                }
-            }
-        }
-        /* m < -1 */
-        else {
-            int decisionParam = -(2 * dx + dy);
-            for (; y <= y2; ++y) {
-                setPixel(canvas, x, y);
-                if (decisionParam <= 0) {
-                    decisionParam -= 2 * dx;
-                }
-                else {
-                    --x;
-                    decisionParam -= 2 * (dx + dy);
-                }
-            }
-        }
-    }
+template <typename Canvas>
+void Line::drawByDDA(Canvas &canvas, const QPoint &p1,
+                     const QPoint &p2, QRgb rgb)
+{
+    withPixelSink(canvas, rgb, DDAKernel(p1, p2));
 }
 
-void Line::setPixel(QImage &canvas, int x, int y)
+template <typename Canvas>
+void Line::drawByBresenham(Canvas &canvas, const QPoint &p1,
+                           const QPoint &p2, QRgb rgb)
 {
-    canvas.setPixel(x, y, c.rgb());
+    withPixelSink(canvas, rgb, BresenhamKernel(p1, p2));
 }
 
-void Line::translate(const QPoint &d)
+void Line::translate(const QPointF &d)
 {
-    if (duringTransaction) {
-        p1 = oldp1 + d;
-        p2 = oldp2 + d;
-    }
-    else {
-        p1 += d;
-        p2 += d;
-    }
+    const Line &old = backup ? static_cast<const Line &>(*backup) : *this;
+    QPoint offset = fixed::fromReal(d);
+    p1 = old.p1 + offset;
+    p2 = old.p2 + offset;
 }
 
-void Line::scale(const QPoint &c, double s)
+void Line::scale(const QPointF &c, double s)
 {
-    if (duringTransaction) {
-        p1 = utils::scalePoint(oldp1, c, s);
-        p2 = utils::scalePoint(oldp2, c, s);
-    }
-    else {
-        p1 = utils::scalePoint(p1, c, s);
-        p2 = utils::scalePoint(p2, c, s);
-    }
+    const Line &old = backup ? static_cast<const Line &>(*backup) : *this;
+    p1 = fixed::fromReal(utils::scalePoint(fixed::toReal(old.p1), c, s));
+    p2 = fixed::fromReal(utils::scalePoint(fixed::toReal(old.p2), c, s));
 }
 
-void Line::rotate(const QPoint &c, double r)
+void Line::rotate(const QPointF &c, double r)
 {
-    if (duringTransaction) {
-        p1 = utils::rotatePoint(oldp1, c, r);
-        p2 = utils::rotatePoint(oldp2, c, r);
-    }
-    else {
-        p1 = utils::rotatePoint(p1, c, r);
-        p2 = utils::rotatePoint(p2, c, r);
-    }
+    const Line &old = backup ? static_cast<const Line &>(*backup) : *this;
+    p1 = fixed::fromReal(utils::rotatePoint(fixed::toReal(old.p1), c, r));
+    p2 = fixed::fromReal(utils::rotatePoint(fixed::toReal(old.p2), c, r));
 }
 
-cg::Shape *Line::clip(const QPoint &p1, const QPoint &p2, const QString &alg)
+cg::Shape *Line::clip(const QPointF &p1, const QPointF &p2, const QString &alg)
 {
-    QRect rect(p1, p2);
-    rect = rect.normalized();
+    QRectF window = QRectF(p1, p2).normalized();
 
     if (alg == "Cohen-Sutherland")
-        return clipByCohenSutherland(rect.topLeft(), rect.bottomRight());
+        return clipByCohenSutherland(window);
     if (alg == "Liang-Barsky")
-        return clipByLiangBarsky(rect.topLeft(), rect.bottomRight());
-    return clipByDefault(rect.topLeft(), rect.bottomRight());
+        return clipByLiangBarsky(window);
+    return clipByDefault(window);
 }
 
-cg::Shape *Line::clipByDefault(const QPoint &topLeft, const QPoint &bottomRight)
+cg::Shape *Line::clipByDefault(const QRectF &window)
 {
-    return clipByLiangBarsky(topLeft, bottomRight);
+    return clipByLiangBarsky(window);
 }
 
 #define TOP_MASK      0x8
@@ -244,15 +196,14 @@ cg::Shape *Line::clipByDefault(const QPoint &topLeft, const QPoint &bottomRight)
 #define IS_INSIDE_WINDOW(CODE1, CODE2)  (!((CODE1) | CODE2))
 #define IS_OUTSIDE_WINDOW(CODE1, CODE2) ((CODE1) & (CODE2))
 
-cg::Shape *Line::clipByCohenSutherland(const QPoint &topLeft,
-                                       const QPoint &bottomRight)
+cg::Shape *Line::clipByCohenSutherland(const QRectF &window)
 {
-    int top = topLeft.y(), bottom = bottomRight.y();
-    int left = topLeft.x(), right = bottomRight.x();
-    int x1 = p1.x(), y1 = p1.y();
-    int x2 = p2.x(), y2 = p2.y();
-    int outCode1 = calcOutCode(x1, y1, top, bottom, left, right);
-    int outCode2 = calcOutCode(x2, y2, top, bottom, left, right);
+    double top = window.top(), bottom = window.bottom();
+    double left = window.left(), right = window.right();
+    double x1 = fixed::toReal(p1.x()), y1 = fixed::toReal(p1.y());
+    double x2 = fixed::toReal(p2.x()), y2 = fixed::toReal(p2.y());
+    int outCode1 = calcOutCode(x1, y1, window);
+    int outCode2 = calcOutCode(x2, y2, window);
     bool clipAll = false;
 
     while (true) {
@@ -284,73 +235,81 @@ cg::Shape *Line::clipByCohenSutherland(const QPoint &topLeft,
             }
 
             if (outCodeSelected == outCode1) {
-                x1 = qRound(xNew);
-                y1 = qRound(yNew);
-                outCode1 = calcOutCode(x1, y1, top, bottom, left, right);
+                x1 = xNew;
+                y1 = yNew;
+                outCode1 = calcOutCode(x1, y1, window);
             } else {
-                x2 = qRound(xNew);
-                y2 = qRound(yNew);
-                outCode2 = calcOutCode(x2, y2, top, bottom, left, right);
+                x2 = xNew;
+                y2 = yNew;
+                outCode2 = calcOutCode(x2, y2, window);
             }
         }
     }
 
     if (clipAll)
         return nullptr;
-    return new Line(QPoint(x1, y1), QPoint(x2, y2), c, alg);
+    return new Line(QPointF(x1, y1), QPointF(x2, y2), QColor(rgb), algorithmName(alg));
 }
 
-int Line::calcOutCode(int x, int y, int top, int bottom, int left, int right)
+int Line::calcOutCode(double x, double y, const QRectF &window)
 {
-    Q_ASSERT(top < bottom);
-    Q_ASSERT(left < right);
+    Q_ASSERT(window.top() < window.bottom());
+    Q_ASSERT(window.left() < window.right());
 
     int outCode = 0;
 
-    if (y < top)
+    if (y < window.top())
         outCode |= TOP_MASK;
-    else if (y > bottom)
+    else if (y > window.bottom())
         outCode |= BOTTOM_MASK;
-    if (x < left)
+    if (x < window.left())
         outCode |= LEFT_MASK;
-    else if (x > right)
+    else if (x > window.right())
         outCode |= RIGHT_MASK;
 
     return outCode;
 }
 
-cg::Shape *Line::clipByLiangBarsky(const QPoint &topLeft,
-                                   const QPoint &bottomRight)
+cg::Shape *Line::clipByLiangBarsky(const QRectF &window)
+{
+    QPointF p1New = fixed::toReal(p1), p2New = fixed::toReal(p2);
+    if (!clipSegment(p1New, p2New, window.topLeft(), window.bottomRight()))
+        return nullptr;
+    return new Line(p1New, p2New, QColor(rgb), algorithmName(alg));
+}
+
+bool Line::clipSegment(QPointF &start, QPointF &end,
+                       const QPointF &topLeft, const QPointF &bottomRight)
 {
-    int top = topLeft.y(), bottom = bottomRight.y();
-    int left = topLeft.x(), right = bottomRight.x();
+    double top = topLeft.y(), bottom = bottomRight.y();
+    double left = topLeft.x(), right = bottomRight.x();
     Q_ASSERT(top < bottom);
     Q_ASSERT(left < right);
 
-    int x1 = p1.x(), y1 = p1.y();
-    int x2 = p2.x(), y2 = p2.y();
+    double x1 = start.x(), y1 = start.y();
+    double x2 = end.x(), y2 = end.y();
 
-    int p1 = -(x2 - x1);
-    int p2 = -p1;
-    int p3 = -(y2 - y1);
-    int p4 = -p3;
+    double p1 = -(x2 - x1);
+    double p2 = -p1;
+    double p3 = -(y2 - y1);
+    double p4 = -p3;
 
-    int q1 = x1 - left;
-    int q2 = right - x1;
-    int q3 = y1 - top;
-    int q4 = bottom - y1;
+    double q1 = x1 - left;
+    double q2 = right - x1;
+    double q3 = y1 - top;
+    double q4 = bottom - y1;
 
-    if ((p1 == 0 && q1 < 0) || (p3 == 0 && q3 < 0)) {
+    if ((p1 == 0 && (q1 < 0 || q2 < 0)) || (p3 == 0 && (q3 < 0 || q4 < 0))) {
         /* The line is parallel and outside to the clipping window. */
-        return nullptr;
+        return false;
     }
 
     double posarr[4], negarr[4];
     int posind = 0, negind = 0;
 
     if (p1 != 0) {
-        double r1 = static_cast<double>(q1) / p1;
-        double r2 = static_cast<double>(q2) / p2;
+        double r1 = q1 / p1;
+        double r2 = q2 / p2;
         if (p1 < 0) {
             negarr[negind++] = r1;
             posarr[posind++] = r2;
@@ -360,8 +319,8 @@ cg::Shape *Line::clipByLiangBarsky(const QPoint &topLeft,
         }
     }
     if (p3 != 0) {
-        double r3 = static_cast<double>(q3) / p3;
-        double r4 = static_cast<double>(q4) / p4;
+        double r3 = q3 / p3;
+        double r4 = q4 / p4;
         if (p3 < 0) {
             negarr[negind++] = r3;
             posarr[posind++] = r4;
@@ -375,12 +334,23 @@ cg::Shape *Line::clipByLiangBarsky(const QPoint &topLeft,
     double u2 = min(posarr, posind, 1.0);
 
     if (u1 > u2) {
-        return nullptr;
+        return false;
     }
 
-    QPoint p1New(static_cast<int>(x1 + p2 * u1) , static_cast<int>(y1 + p4 * u1));
-    QPoint p2New(static_cast<int>(x1 + p2 * u2), static_cast<int>(y1 + p4 * u2));
-    return new Line(p1New, p2New, c, alg);
+    start = QPointF(x1 + p2 * u1, y1 + p4 * u1);
+    end = QPointF(x1 + p2 * u2, y1 + p4 * u2);
+    return true;
+}
+
+bool Line::clipSegment(QPoint &start, QPoint &end,
+                       const QPoint &topLeft, const QPoint &bottomRight)
+{
+    QPointF startF = start, endF = end;
+    if (!clipSegment(startF, endF, topLeft, bottomRight))
+        return false;
+    start = QPoint(static_cast<int>(startF.x()), static_cast<int>(startF.y()));
+    end = QPoint(static_cast<int>(endF.x()), static_cast<int>(endF.y()));
+    return true;
 }
 
 double Line::max(double a[], int n, double defaultval)
@@ -403,7 +373,22 @@ double Line::min(double a[], int n, double defaultval)
 
 QRect Line::getRectHull()
 {
-    return QRect(p1, p2).normalized();
+    return utils::pixelRect(QRectF(fixed::toReal(p1), fixed::toReal(p2)).normalized());
 }
 
+void Line::setPoints(const QPointF &point1, const QPointF &point2)
+{
+    p1 = fixed::fromReal(point1);
+    p2 = fixed::fromReal(point2);
+}
+
+template void Line::rasterize(QImage &, const QPoint &, const QPoint &,
+                              QRgb, Algorithm);
+template void Line::rasterize(TiledCanvas &, const QPoint &, const QPoint &,
+                              QRgb, Algorithm);
+template void Line::rasterizeFixed(QImage &, const QPoint &, const QPoint &,
+                                   QRgb, Algorithm);
+template void Line::rasterizeFixed(TiledCanvas &, const QPoint &, const QPoint &,
+                                   QRgb, Algorithm);
+
 }
@@ -2,54 +2,73 @@
 #define LINE_H
 
 #include "shape.h"
+#include "fixedpoint.h"
 
 #include <QColor>
+#include <QRectF>
 
 namespace cg {
 
 class Line : public Shape
 {
 public:
-    Line(const QPoint &point1, const QPoint &point2,
+    Line(const QPointF &point1, const QPointF &point2,
          const QColor &color, const QString &algorithm);
     ~Line() = default;
 
     QString shapeName() { return "Line"; }
-
-    void beginTransaction();
-    void commitTransaction();
-    void rollbackTransaction();
+    Shape *clone() const { return new Line(*this); }
+    void swapState(Shape &other);
+    qint64 sizeInBytes() const { return sizeof(Line); }
+    void appendTo(ShapeStore &store);
 
     void draw(QImage &canvas);
-    void translate(const QPoint &d);
-    void scale(const QPoint &c, double s);
-    void rotate(const QPoint &c, double r);
-    cg::Shape *clip(const QPoint &p1, const QPoint &p2, const QString &alg);
+    void translate(const QPointF &d);
+    void scale(const QPointF &c, double s);
+    void rotate(const QPointF &c, double r);
+    cg::Shape *clip(const QPointF &p1, const QPointF &p2, const QString &alg);
 
     QRect getRectHull();
 
+    QPointF getPoint1() const { return fixed::toReal(p1); }
+    QPointF getPoint2() const { return fixed::toReal(p2); }
+    void setPoints(const QPointF &point1, const QPointF &point2);
+
+    static bool clipSegment(QPointF &start, QPointF &end,
+                            const QPointF &topLeft, const QPointF &bottomRight);
+    /* Truncates the clipped endpoints to whole pixels. */
+    static bool clipSegment(QPoint &start, QPoint &end,
+                            const QPoint &topLeft, const QPoint &bottomRight);
+
+    /* Canvas is a QImage or a TiledCanvas. */
+    template <typename Canvas>
+    static void rasterize(Canvas &canvas, const QPoint &p1, const QPoint &p2,
+                          QRgb rgb, Algorithm alg);
+    /* The same for endpoints in 24.8 fixed point. */
+    template <typename Canvas>
+    static void rasterizeFixed(Canvas &canvas, const QPoint &p1,
+                               const QPoint &p2, QRgb rgb, Algorithm alg);
+
 private:
-    void drawByDefault(QImage &canvas);
-    void drawByDDA(QImage &canvas);
-    void drawByBresenham(QImage &canvas);
-    void setPixel(QImage &canvas, int x, int y);
-
-    cg::Shape *clipByDefault(const QPoint &topLeft, const QPoint &bottomRight);
-    cg::Shape *clipByCohenSutherland(const QPoint &topLeft,
-                                     const QPoint &bottomRight);
-    static int calcOutCode(int x, int y, int top, int bottom, int left, int right);
-
-    cg::Shape *clipByLiangBarsky(const QPoint &topLeft,
-                                 const QPoint &bottomRight);
+    template <typename Canvas>
+    static void drawByDefault(Canvas &canvas, const QPoint &p1,
+                              const QPoint &p2, QRgb rgb);
+    template <typename Canvas>
+    static void drawByDDA(Canvas &canvas, const QPoint &p1,
+                          const QPoint &p2, QRgb rgb);
+    template <typename Canvas>
+    static void drawByBresenham(Canvas &canvas, const QPoint &p1,
+                                const QPoint &p2, QRgb rgb);
+
+    cg::Shape *clipByDefault(const QRectF &window);
+    cg::Shape *clipByCohenSutherland(const QRectF &window);
+    static int calcOutCode(double x, double y, const QRectF &window);
+
+    cg::Shape *clipByLiangBarsky(const QRectF &window);
     static double max(double a[], int n, double defaultval = 0.0);
     static double min(double a[], int n, double defaultval = 1.0);
 
-    QPoint p1, p2;
-    QColor c;
-    QString alg;
-
-    /* for transaction */
-    QPoint oldp1, oldp2;
+    QPoint p1, p2;      /* 24.8 fixed point */
 };
 
 }
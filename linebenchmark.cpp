@@ -0,0 +1,234 @@
+#include "linebenchmark.h"
+#include "line.h"
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QRandomGenerator>
+
+#include <iomanip>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+LineBenchmark::LineBenchmark()
+    : seed(1), lineCount(DEFAULT_LINES), runs(DEFAULT_RUNS),
+      canvasSize(2000, 2000)
+{
+
+}
+
+int LineBenchmark::exec(const QStringList &args)
+{
+    for (int i = 0; i < args.size(); ++i) {
+        const QString &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        bool ok = hasValue;
+        if (arg == "--seed" && hasValue) {
+            seed = args[++i].toUInt(&ok);
+        }
+        else if (arg == "--lines" && hasValue) {
+            lineCount = args[++i].toInt(&ok);
+            ok = ok && lineCount > 0;
+        }
+        else if (arg == "--runs" && hasValue) {
+            runs = args[++i].toInt(&ok);
+            ok = ok && runs > 0;
+        }
+        else if (arg == "--canvas" && hasValue) {
+            ok = parseCanvas(args[++i]);
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok) {
+            cerr << "Bench error: invalid argument: " << qPrintable(arg);
+            if (hasValue && arg.startsWith("--"))
+                cerr << ' ' << qPrintable(args[i]);
+            cerr << endl;
+            return 1;
+        }
+    }
+
+    /* The old loops plot every pixel from p1 to p2 along the major axis,
+     * and nothing for a line of no length. */
+    QRandomGenerator random(seed);
+    int width = canvasSize.width(), height = canvasSize.height();
+    points.clear();
+    colors.clear();
+    qint64 pixels = 0;
+    for (int i = 0; i < lineCount; ++i) {
+        QPoint p1(random.bounded(width), random.bounded(height));
+        QPoint p2(random.bounded(width), random.bounded(height));
+        int major = qMax(qAbs(p2.x() - p1.x()), qAbs(p2.y() - p1.y()));
+        if (major > 0)
+            pixels += major + 1;
+        points.append(p1);
+        points.append(p2);
+        colors.append(qRgb(random.bounded(256), random.bounded(256),
+                           random.bounded(256)));
+    }
+    if (pixels == 0) {
+        cerr << "Bench error: the lines have no pixels." << endl;
+        return 1;
+    }
+
+    QImage oldImage(canvasSize, QImage::Format_RGB32);
+    QImage newImage(canvasSize, QImage::Format_RGB32);
+    qint64 oldTime = bestTime(oldImage, true);
+    qint64 newTime = bestTime(newImage, false);
+
+    cout << "Line benchmark: " << lineCount << " lines, " << pixels
+         << " pixels on " << width << 'x' << height << ", seed " << seed
+         << ", best of " << runs << " runs" << endl;
+    cout << std::fixed << std::setprecision(2);
+    cout << "  old octant loops  " << std::setw(8)
+         << static_cast<double>(oldTime) / pixels << " ns/pixel" << endl;
+    cout << "  octant kernels    " << std::setw(8)
+         << static_cast<double>(newTime) / pixels << " ns/pixel" << endl;
+    cout << "  speedup           " << std::setw(8)
+         << static_cast<double>(oldTime) / newTime << 'x' << endl;
+    if (oldImage != newImage) {
+        cout << "  the kernels draw other pixels than the old loops" << endl;
+        return 1;
+    }
+    return 0;
+}
+
+bool LineBenchmark::parseCanvas(const QString &value)
+{
+    QStringList size = value.split('x');
+    if (size.size() != 2)
+        return false;
+
+    bool widthOk, heightOk;
+    int width = size[0].toInt(&widthOk);
+    int height = size[1].toInt(&heightOk);
+    if (!widthOk || !heightOk || width <= 0 || height <= 0)
+        return false;
+    canvasSize = QSize(width, height);
+    return true;
+}
+
+/* Draws every line on a white image once per run and returns the
+ * shortest run in nanoseconds. */
+qint64 LineBenchmark::bestTime(QImage &image, bool oldLoops) const
+{
+    const QPoint *p = points.constData();
+    const QRgb *rgb = colors.constData();
+    qint64 best = 0;
+    for (int run = 0; run < runs; ++run) {
+        image.fill(Qt::white);
+        QElapsedTimer timer;
+        timer.start();
+        if (oldLoops) {
+            for (int i = 0; i < lineCount; ++i)
+                drawByOldLoops(image, p[2 * i], p[2 * i + 1], rgb[i]);
+        }
+        else {
+            for (int i = 0; i < lineCount; ++i)
+                cg::Line::rasterize(image, p[2 * i], p[2 * i + 1], rgb[i],
+                                    cg::Algorithm::BRESENHAM);
+        }
+        qint64 elapsed = timer.nsecsElapsed();
+        if (run == 0 || elapsed < best)
+            best = elapsed;
+    }
+    return best;
+}
+
+/* Line::drawByBresenham as it was before the octant kernels: one loop
+ * per octant pair and QImage::setPixel() for every pixel. */
+void LineBenchmark::drawByOldLoops(QImage &image, const QPoint &p1,
+                                   const QPoint &p2, QRgb rgb)
+{
+    int x1 = p1.x(), x2 = p2.x();
+    int y1 = p1.y(), y2 = p2.y();
+    int deltaX = x2 - x1;
+    int deltaY = y2 - y1;
+
+    /* |m| <= 1 */
+    if (qAbs(deltaY) <= qAbs(deltaX)) {
+        if (deltaX == 0)
+            return;
+
+        if (x1 > x2) {
+            qSwap(x1, x2);
+            qSwap(y1, y2);
+        }
+        int x = x1, y = y1;
+        int dx = x2 - x1;
+        int dy = y2 - y1;
+
+        /* 0 <= m <= 1*/
+        if (dy >= 0) {
+            int decisionParam = 2 * dy - dx;
+            for (; x <= x2; ++x) {
+                image.setPixel(x, y, rgb);
+                if (decisionParam >= 0) {
+                    ++y;
+                    decisionParam += 2 * (dy - dx);
+                }
+                else {
+                    decisionParam += 2 * dy;
+                }
+            }
+        }
+        /* -1 <= m < 0 */
+        else {
+            int decisionParam = 2 * dy + dx;
+            for (; x <= x2; ++x) {
+                image.setPixel(x, y, rgb);
+                if (decisionParam >= 0) {
+                    decisionParam += 2 * dy;
+                }
+                else {
+                    --y;
+                    decisionParam += 2 * (dy + dx);
+                }
+            }
+        }
+    }
+    /* |m| > 1 */
+    else {
+        Q_ASSERT(deltaY != 0);
+
+        if (y1 > y2) {
+            qSwap(x1, x2);
+            qSwap(y1, y2);
+        }
+        int x = x1, y = y1;
+        int dx = x2 - x1;
+        int dy = y2 - y1;
+
+        /* m > 1 */
+        if (dx >= 0) {
+            int decisionParam = - (2 * dx - dy);
+            for (; y <= y2; ++y) {
+                image.setPixel(x, y, rgb);
+                if (decisionParam <= 0) {
+                    ++x;
+                    decisionParam -= 2 * (dx - dy);
+                }
+                else {
+                    decisionParam -= 2 * dx;
+                }
+            }
+        }
+        /* m < -1 */
+        else {
+            int decisionParam = -(2 * dx + dy);
+            for (; y <= y2; ++y) {
+                image.setPixel(x, y, rgb);
+                if (decisionParam <= 0) {
+                    decisionParam -= 2 * dx;
+                }
+                else {
+                    --x;
+                    decisionParam -= 2 * (dx + dy);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef LINEBENCHMARK_H
+#define LINEBENCHMARK_H
+
+#include <QPoint>
+#include <QRgb>
+#include <QSize>
+#include <QStringList>
+#include <QVector>
+
+class QImage;
+
+/* Times the Bresenham line kernels against the octant loops they
+ * replaced, in nanoseconds per pixel.
+ *
+ * Both draw the same seeded random lines into a 32-bit QImage, so the
+ * same seed and options always give the same work. Each kernel is timed
+ * over several runs and the best is reported, divided by the pixels the
+ * old loops plot. */
+class LineBenchmark
+{
+public:
+    LineBenchmark();
+
+    int exec(const QStringList &args);
+
+private:
+    enum { DEFAULT_LINES = 200000, DEFAULT_RUNS = 5 };
+
+    bool parseCanvas(const QString &value);
+
+    qint64 bestTime(QImage &image, bool oldLoops) const;
+
+    static void drawByOldLoops(QImage &image, const QPoint &p1,
+                               const QPoint &p2, QRgb rgb);
+
+    quint32 seed;
+    int lineCount;
+    int runs;
+    QSize canvasSize;
+
+    QVector<QPoint> points;     /* two per line */
+    QVector<QRgb> colors;
+};
+
+#endif // LINEBENCHMARK_H
@@ -1,18 +1,32 @@
 #include "mainwindow.h"
 #include "paintercli.h"
+#include "trace.h"
 
 #include <QApplication>
 
+#include <iostream>
+using std::cerr;
+using std::endl;
+
 int main(int argc, char *argv[])
 {
+    /* --trace <file> anywhere on the command line, or the PAINTER_TRACE
+     * environment variable, records a timeline of the run. */
+    QString traceFile = cg::Trace::startFromArguments(argc, argv);
+
+    int status;
     if (argc > 1) {
         PainterCLI cliApp;
-        return cliApp.exec(argc, argv);
+        status = cliApp.exec(argc, argv);
+    }
+    else {
+        QApplication app(argc, argv);
+        MainWindow win;
+        win.show();
+        status = app.exec();
     }
 
-    QApplication app(argc, argv);
-    MainWindow win;
-    win.show();
-
-    return app.exec();
+    if (!traceFile.isEmpty() && !cg::Trace::stop())
+        cerr << "Fail to write trace: " << qPrintable(traceFile) << endl;
+    return status;
 }
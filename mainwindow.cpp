@@ -1,5 +1,6 @@
 #include "mainwindow.h"
 #include "painter.h"
+#include "shapelistmodel.h"
 #include "qsizedialog.h"
 #include <QtWidgets>
 
@@ -8,6 +9,10 @@ MainWindow::MainWindow(QWidget *parent)
 {
     painter = new Painter(800, 600);
     setCentralWidget(painter);
+    shapeModel = new ShapeListModel(this);
+    connect(shapeModel, SIGNAL(modelReset()),
+            this, SLOT(restoreCurrentShapeForShapeList()),
+            Qt::QueuedConnection);
     connect(painter, SIGNAL(shapeAdded(cg::Shape *)),
             this, SLOT(addShape(cg::Shape *)));
     connect(painter, SIGNAL(shapeRemoved(cg::Shape *)),
@@ -50,6 +55,18 @@ void MainWindow::createActions()
     connect(saveAction, SIGNAL(triggered()),
             this, SLOT(save()));
 
+    openSceneAction = new QAction(tr("&Open Scene..."), this);
+    openSceneAction->setShortcut(QKeySequence::Open);
+    openSceneAction->setStatusTip(tr("Open a saved scene"));
+    connect(openSceneAction, SIGNAL(triggered()),
+            this, SLOT(openScene()));
+
+    saveSceneAction = new QAction(tr("Save Sc&ene..."), this);
+    saveSceneAction->setShortcut(tr("Ctrl+Shift+S"));
+    saveSceneAction->setStatusTip(tr("Save the shapes as a scene"));
+    connect(saveSceneAction, SIGNAL(triggered()),
+            this, SLOT(saveScene()));
+
     exitAction = new QAction(tr("E&xit"), this);
     exitAction->setIcon(QIcon(":/images/exit.png"));
     exitAction->setShortcut(tr("Ctrl+Q"));
@@ -100,6 +117,41 @@ void MainWindow::createActions()
     connect(clipAction, SIGNAL(triggered()),
             this, SLOT(clip()));
 
+    undoAction = new QAction(tr("&Undo"), this);
+    undoAction->setShortcut(QKeySequence::Undo);
+    undoAction->setStatusTip(tr("Undo the last operation"));
+    connect(undoAction, SIGNAL(triggered()),
+            painter, SLOT(undo()));
+
+    redoAction = new QAction(tr("&Redo"), this);
+    redoAction->setShortcut(QKeySequence::Redo);
+    redoAction->setStatusTip(tr("Redo the last undone operation"));
+    connect(redoAction, SIGNAL(triggered()),
+            painter, SLOT(redo()));
+
+    zoomInAction = new QAction(tr("Zoom &In"), this);
+    zoomInAction->setShortcut(QKeySequence::ZoomIn);
+    zoomInAction->setStatusTip(tr("Zoom in on the canvas"));
+    connect(zoomInAction, SIGNAL(triggered()),
+            painter, SLOT(zoomIn()));
+
+    zoomOutAction = new QAction(tr("Zoom &Out"), this);
+    zoomOutAction->setShortcut(QKeySequence::ZoomOut);
+    zoomOutAction->setStatusTip(tr("Zoom out of the canvas"));
+    connect(zoomOutAction, SIGNAL(triggered()),
+            painter, SLOT(zoomOut()));
+
+    resetZoomAction = new QAction(tr("&Actual Size"), this);
+    resetZoomAction->setShortcut(tr("Ctrl+0"));
+    resetZoomAction->setStatusTip(tr("Show the canvas at its actual size"));
+    connect(resetZoomAction, SIGNAL(triggered()),
+            painter, SLOT(resetZoom()));
+
+    clipAllAction = new QAction(tr("Clip All"), this);
+    clipAllAction->setStatusTip(tr("Clip all shapes to a window"));
+    connect(clipAllAction, SIGNAL(triggered()),
+            this, SLOT(clipAll()));
+
     aboutAction = new QAction(tr("&About"), this);
     aboutAction->setStatusTip(tr("Show the application's About box"));
     connect(aboutAction, SIGNAL(triggered()),
@@ -118,6 +170,9 @@ void MainWindow::createMenus()
     fileMenu->addAction(clearAction);
     fileMenu->addAction(saveAction);
     fileMenu->addSeparator();
+    fileMenu->addAction(openSceneAction);
+    fileMenu->addAction(saveSceneAction);
+    fileMenu->addSeparator();
     fileMenu->addAction(exitAction);
 
     toolsMenu = menuBar()->addMenu(tr("&Tools"));
@@ -129,10 +184,18 @@ void MainWindow::createMenus()
     toolsMenu->addAction(drawCurveAction);
 
     editMenu = menuBar()->addMenu(tr("&Edit"));
+    editMenu->addAction(undoAction);
+    editMenu->addAction(redoAction);
+    editMenu->addSeparator();
     editMenu->addAction(transformAction);
     editMenu->addAction(clipAction);
+    editMenu->addAction(clipAllAction);
 
     viewMenu = menuBar()->addMenu(tr("&View"));
+    viewMenu->addAction(zoomInAction);
+    viewMenu->addAction(zoomOutAction);
+    viewMenu->addAction(resetZoomAction);
+    viewMenu->addSeparator();
 
     menuBar()->addSeparator();
 
@@ -145,10 +208,13 @@ void MainWindow::createDockWindows()
 {
     QDockWidget *dock = new QDockWidget(tr("Shapes"), this);
     dock->setAllowedAreas(Qt::LeftDockWidgetArea | Qt::RightDockWidgetArea);
-    shapeList = new QListWidget(dock);
-    connect(shapeList, SIGNAL(currentItemChanged(QListWidgetItem *,
-                                                 QListWidgetItem *)),
-            this, SLOT(setCurrentShapeForPainter(QListWidgetItem *)));
+    shapeList = new QListView(dock);
+    shapeList->setModel(shapeModel);
+    /* Lets the view lay out only the visible rows. */
+    shapeList->setUniformItemSizes(true);
+    connect(shapeList->selectionModel(),
+            SIGNAL(currentChanged(QModelIndex, QModelIndex)),
+            this, SLOT(setCurrentShapeForPainter(QModelIndex)));
     dock->setWidget(shapeList);
     addDockWidget(Qt::RightDockWidgetArea, dock);
     viewMenu->addAction(dock->toggleViewAction());
@@ -191,8 +257,7 @@ void MainWindow::adjustCanvasSize()
 
 void MainWindow::clear()
 {
-    shapeManager.clear();
-    shapeList->clear();
+    shapeModel->clear();
     painter->clear();
 }
 
@@ -200,12 +265,38 @@ void MainWindow::save()
 {
     QString fileName = QFileDialog::getSaveFileName(
                 this, tr("Save File"), "untitled",
-                tr("BMP (*.bmp);;JPEG (*.jpg);;PNG (*.png)"));
+                tr("BMP (*.bmp);;JPEG (*.jpg);;PNG (*.png);;SVG (*.svg)"));
     if (!fileName.isEmpty()) {
         painter->saveCanvas(fileName);
     }
 }
 
+void MainWindow::openScene()
+{
+    QString fileName = QFileDialog::getOpenFileName(
+                this, tr("Open Scene"), QString(),
+                tr("Painter Scene (*.pscene)"));
+    if (fileName.isEmpty())
+        return;
+
+    QString error;
+    if (!painter->openScene(fileName, &error)) {
+        QMessageBox::warning(this, tr("Open Scene"),
+                             tr("Cannot open %1:\n%2").arg(fileName, error));
+    }
+}
+
+void MainWindow::saveScene()
+{
+    QString fileName = QFileDialog::getSaveFileName(
+                this, tr("Save Scene"), "untitled.pscene",
+                tr("Painter Scene (*.pscene)"));
+    if (!fileName.isEmpty() && !painter->saveScene(fileName)) {
+        QMessageBox::warning(this, tr("Save Scene"),
+                             tr("Cannot save %1").arg(fileName));
+    }
+}
+
 void MainWindow::setPenColor()
 {
     QColor color = QColorDialog::getColor(painter->getPenColor(),
@@ -246,6 +337,11 @@ void MainWindow::clip()
     painter->setCurrentMode(Painter::CLIP_MODE);
 }
 
+void MainWindow::clipAll()
+{
+    painter->setCurrentMode(Painter::CLIP_ALL_MODE);
+}
+
 void MainWindow::about()
 {
     QMessageBox::about(this, tr("About Painter"),
@@ -258,57 +354,32 @@ void MainWindow::about()
 
 void MainWindow::addShape(cg::Shape *shape)
 {
-    static int id = 1;
-    if (!shape) {
-        qDebug("addShape(nullptr)");
-        return;
-    }
-
-    QString text = shape->shapeName() + " " + QString::number(id++);
-    QListWidgetItem *item = new QListWidgetItem(text);
-    QVariant data = QVariant::fromValue(static_cast<void *>(shape));
-    item->setData(Qt::UserRole, data);
-
-    shapeList->insertItem(0, item);
-    shapeManager.insert(shape, item);
+    shapeModel->addShape(shape);
 }
 
 void MainWindow::removeShape(cg::Shape *shape)
 {
-    if (!shape) {
-        qDebug("removeShape(nullptr)");
-        return;
-    }
+    shapeModel->removeShape(shape);
+}
 
-    QListWidgetItem *item = shapeManager.take(shape);
-    if (!item) {
-        qDebug("Can't find shape to remove!");
+void MainWindow::setCurrentShapeForShapeList(cg::Shape *shape)
+{
+    QModelIndex index = shapeModel->indexOf(shape);
+    if (shape && !index.isValid()) {
+        qDebug("Shape list row not found");
         return;
     }
-    shapeList->removeItemWidget(item);
-    delete item;
+    shapeList->setCurrentIndex(index);
 }
 
-void MainWindow::setCurrentShapeForShapeList(cg::Shape *shape)
+void MainWindow::restoreCurrentShapeForShapeList()
 {
-    QListWidgetItem *item = nullptr;
-    if (shape) {
-       item = shapeManager.value(shape, nullptr);
-       if (!item) {
-           qDebug("List widget item not found");
-           return;
-       }
-    }
-    shapeList->setCurrentItem(item);
+    /* A reset clears the current row without telling the painter. */
+    setCurrentShapeForShapeList(painter->getCurrentShape());
 }
 
-void MainWindow::setCurrentShapeForPainter(QListWidgetItem *current)
+void MainWindow::setCurrentShapeForPainter(const QModelIndex &current)
 {
-    cg::Shape *shape = nullptr;
-    if (current) {
-        QVariant data = current->data(Qt::UserRole);
-        shape = static_cast<cg::Shape *>(data.value<void *>());
-    }
-    painter->setCurrentShape(shape);
+    painter->setCurrentShape(shapeModel->shapeAt(current));
 }
 
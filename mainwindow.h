@@ -7,14 +7,14 @@
 #include <QIcon>
 #include <QColor>
 #include <QSize>
-#include <QMap>
+#include <QModelIndex>
 
 class QAction;
 class QMenu;
 class QToolBar;
-class QListWidget;
-class QListWidgetItem;
+class QListView;
 class Painter;
+class ShapeListModel;
 
 class MainWindow : public QMainWindow
 {
@@ -28,6 +28,8 @@ private slots:
     void adjustCanvasSize();
     void clear();
     void save();
+    void openScene();
+    void saveScene();
     void setPenColor();
     void drawLine();
     void drawPolygon();
@@ -35,12 +37,14 @@ private slots:
     void drawCurve();
     void transform();
     void clip();
+    void clipAll();
     void about();
 
     void addShape(cg::Shape *shape);
     void removeShape(cg::Shape *shape);
     void setCurrentShapeForShapeList(cg::Shape *shape);
-    void setCurrentShapeForPainter(QListWidgetItem *current);
+    void setCurrentShapeForPainter(const QModelIndex &current);
+    void restoreCurrentShapeForShapeList();
 
 private:
     void createActions();
@@ -51,8 +55,8 @@ private:
     static QIcon createIconByColor(const QColor &color,
                                    const QSize &size = QSize(32, 32));
 
-    QListWidget *shapeList;
-    QMap<cg::Shape *, QListWidgetItem *> shapeManager;
+    QListView *shapeList;
+    ShapeListModel *shapeModel;
 
     Painter *painter;
 
@@ -67,6 +71,8 @@ private:
     QAction *adjustCanvasSizeAction;
     QAction *clearAction;
     QAction *saveAction;
+    QAction *openSceneAction;
+    QAction *saveSceneAction;
     QAction *exitAction;
     QAction *setPenColorAction;
     QAction *drawLineAction;
@@ -75,6 +81,12 @@ private:
     QAction *drawCurveAction;
     QAction *transformAction;
     QAction *clipAction;
+    QAction *clipAllAction;
+    QAction *undoAction;
+    QAction *redoAction;
+    QAction *zoomInAction;
+    QAction *zoomOutAction;
+    QAction *resetZoomAction;
     QAction *aboutAction;
     QAction *aboutQtAction;
 };
@@ -3,7 +3,14 @@
 #include "polygon.h"
 #include "ellipse.h"
 #include "curve.h"
+#include "polyline.h"
+#include "batchclipper.h"
+#include "renderworker.h"
+#include "journal.h"
+#include "scenefile.h"
+#include "svgexporter.h"
 #include "utils.h"
+#include "trace.h"
 
 #include <QtWidgets>
 #include <QtMath>
@@ -12,59 +19,137 @@
 using std::placeholders::_1;
 
 Painter::Painter(int width, int height, QWidget *parent)
-    : QWidget(parent)
+    : QWidget(parent), journal(shapes), sceneDirty(true), viewDirty(true),
+      panning(false),
+      dragSnapshot(nullptr), rubberBandFrame(0), rubberBandDirty(true),
+      hasPendingDrag(false),
+      droppedDragEvents(0), appliedDragEvents(0)
 {
     setAttribute(Qt::WA_StaticContents);
     setSizePolicy(QSizePolicy::Minimum, QSizePolicy::Minimum);
 
+    /* The render worker follows the store through its changes. */
+    store.setRecording(true);
+    renderWorker = new RenderWorker;
+    renderWorker->moveToThread(&renderThread);
+    connect(&renderThread, SIGNAL(finished()),
+            renderWorker, SLOT(deleteLater()));
+    connect(renderWorker, SIGNAL(frameReady()),
+            this, SLOT(update()));
+    renderThread.start();
+
+    dragTimer.setInterval(DRAG_FRAME_INTERVAL);
+    connect(&dragTimer, SIGNAL(timeout()),
+            this, SLOT(applyPendingDrag()));
+
     setCanvasSize(QSize(width, height));
-    clearCanvas(canvas);
     setPenColor(Qt::black);
     setCurrentMode(DRAW_LINE_MODE);
     setCurrentShape(nullptr);
     whatIsDoingNow = IDLE;
 }
 
+Painter::~Painter()
+{
+    renderThread.quit();
+    renderThread.wait();
+    delete dragSnapshot;
+}
+
 QSize Painter::sizeHint() const
 {
-    return canvas.size();
+    return canvasSize;
 }
 
 void Painter::clear()
 {
     setCurrentShape(nullptr);
     clearShapes();
-    update();
+    updateScene();
+}
+
+void Painter::undo()
+{
+    if (whatIsDoingNow != IDLE)
+        return;
+
+    QList<cg::Shape *> removed, added, changed;
+    journal.undo(removed, added, changed);
+    applyJournalChanges(removed, added, changed);
+}
+
+void Painter::redo()
+{
+    if (whatIsDoingNow != IDLE)
+        return;
+
+    QList<cg::Shape *> removed, added, changed;
+    journal.redo(removed, added, changed);
+    applyJournalChanges(removed, added, changed);
+}
+
+void Painter::setUndoBudget(qint64 bytes)
+{
+    journal.setBudget(bytes);
 }
 
 void Painter::paintEvent(QPaintEvent *event)
 {
-    clearCanvas(canvas);
-    drawShapes(canvas);
+    TRACE_SCOPE("paintEvent");
+    if (sceneDirty || viewDirty)
+        requestFrame();
+
+    /* Paint the newest completed frame; a newer one triggers another
+     * update() when it is ready. */
+    {
+        TRACE_SCOPE("clear");
+        renderWorker->takeFrame(frame);
+        if (frame.size() == size()) {
+            canvas = frame;
+        }
+        else {
+            canvas = QImage(size(), QImage::Format_RGB32);
+            clearCanvas(canvas);
+        }
+    }
 
-    switch (curMode) {
-    case DRAW_LINE_MODE:
-        paintEventOnDrawLineMode(event); break;
-    case DRAW_POLYGON_MODE:
-        paintEventOnDrawPolygonMode(event); break;
-    case DRAW_ELLIPSE_MODE:
-        paintEventOnDrawEllipseMode(event); break;
-    case DRAW_CURVE_MODE:
-        paintEventOnDrawCurveMode(event); break;
-    case TRANSFORM_MODE:
-        paintEventOnTransformMode(event); break;
-    case CLIP_MODE:
-        paintEventOnClipMode(event); break;
-    default:
-        qFatal("Should not reach here"); break;
+    {
+        TRACE_SCOPE("overlay");
+        switch (curMode) {
+        case DRAW_LINE_MODE:
+            paintEventOnDrawLineMode(event); break;
+        case DRAW_POLYGON_MODE:
+            paintEventOnDrawPolygonMode(event); break;
+        case DRAW_ELLIPSE_MODE:
+            paintEventOnDrawEllipseMode(event); break;
+        case DRAW_CURVE_MODE:
+            paintEventOnDrawCurveMode(event); break;
+        case TRANSFORM_MODE:
+            paintEventOnTransformMode(event); break;
+        case CLIP_MODE:     /* fall through */
+        case CLIP_ALL_MODE:
+            paintEventOnClipMode(event); break;
+        default:
+            qFatal("Should not reach here"); break;
+        }
     }
 
+    TRACE_SCOPE("blit");
     QPainter painter(this);
     painter.drawImage(0, 0, canvas);
 }
 
 void Painter::mousePressEvent(QMouseEvent *event)
 {
+    if (event->button() == Qt::MiddleButton) {
+        panning = true;
+        panStart = event->pos();
+        panOrigin = viewport.getOrigin();
+        cursorBeforePan = cursor();
+        setCursor(Qt::ClosedHandCursor);
+        return;
+    }
+
     switch (curMode) {
     case DRAW_LINE_MODE:
         mousePressEventOnDrawLineMode(event); break;
@@ -76,7 +161,8 @@ void Painter::mousePressEvent(QMouseEvent *event)
         mousePressEventOnDrawCurveMode(event); break;
     case TRANSFORM_MODE:
         mousePressEventOnTransformMode(event); break;
-    case CLIP_MODE:
+    case CLIP_MODE:     /* fall through */
+    case CLIP_ALL_MODE:
         mousePressEventOnClipMode(event); break;
     default:
         qFatal("Should not reach here"); break;
@@ -85,6 +171,13 @@ void Painter::mousePressEvent(QMouseEvent *event)
 
 void Painter::mouseMoveEvent(QMouseEvent *event)
 {
+    if (panning) {
+        QPointF d = QPointF(event->pos() - panStart) / viewport.getZoom();
+        viewport = cg::Viewport(panOrigin - d, viewport.getZoom());
+        updateView();
+        return;
+    }
+
     switch (curMode) {
     case DRAW_LINE_MODE:
         mouseMoveEventOnDrawLineMode(event); break;
@@ -96,7 +189,8 @@ void Painter::mouseMoveEvent(QMouseEvent *event)
         mouseMoveEventOnDrawCurveMode(event); break;
     case TRANSFORM_MODE:
         mouseMoveEventOnTransformMode(event); break;
-    case CLIP_MODE:
+    case CLIP_MODE:     /* fall through */
+    case CLIP_ALL_MODE:
         mouseMoveEventOnClipMode(event); break;
     default:
         qFatal("Should not reach here"); break;
@@ -105,6 +199,14 @@ void Painter::mouseMoveEvent(QMouseEvent *event)
 
 void Painter::mouseReleaseEvent(QMouseEvent *event)
 {
+    if (event->button() == Qt::MiddleButton) {
+        if (panning) {
+            panning = false;
+            setCursor(cursorBeforePan);
+        }
+        return;
+    }
+
     switch (curMode) {
     case DRAW_LINE_MODE:
         mouseReleaseEventOnDrawLineMode(event); break;
@@ -116,17 +218,65 @@ void Painter::mouseReleaseEvent(QMouseEvent *event)
         mouseReleaseEventOnDrawCurveMode(event); break;
     case TRANSFORM_MODE:
         mouseReleaseEventOnTransformMode(event); break;
-    case CLIP_MODE:
+    case CLIP_MODE:     /* fall through */
+    case CLIP_ALL_MODE:
         mouseReleaseEventOnClipMode(event); break;
     default:
         qFatal("Should not reach here"); break;
     }
 }
 
+void Painter::wheelEvent(QWheelEvent *event)
+{
+    int steps = event->angleDelta().y() / 120;
+    if (steps == 0) {
+        event->ignore();
+        return;
+    }
+    zoomAt(event->pos(), viewport.getZoom() * qPow(1.25, steps));
+}
+
+void Painter::resizeEvent(QResizeEvent * /* event */)
+{
+    updateView();
+}
+
+void Painter::zoomIn()
+{
+    zoomAt(rect().center(), viewport.getZoom() * 1.25);
+}
+
+void Painter::zoomOut()
+{
+    zoomAt(rect().center(), viewport.getZoom() / 1.25);
+}
+
+void Painter::resetZoom()
+{
+    viewport = cg::Viewport();
+    updateView();
+}
+
+void Painter::zoomAt(const QPoint &pos, double zoom)
+{
+    zoom = qBound(1.0 / ZOOM_LIMIT, zoom, static_cast<double>(ZOOM_LIMIT));
+
+    /* Keep the paper point under pos in place. */
+    QPointF anchor = viewport.getOrigin() + QPointF(pos) / viewport.getZoom();
+    viewport = cg::Viewport(anchor - QPointF(pos) / zoom, zoom);
+    updateView();
+}
+
+QPoint Painter::canvasPos(QMouseEvent *event) const
+{
+    return viewport.unmap(event->pos());
+}
+
 void Painter::paintEventOnDrawLineMode(QPaintEvent * /* event */)
 {
     if (whatIsDoingNow == DRAWING_LINE) {
-        cg::Line(pb, pe, penColor, "").draw(canvas);
+        cg::Line(viewport.map(pb), viewport.map(pe),
+                 penColor, "").draw(canvas);
     }
 }
 
@@ -135,14 +285,14 @@ void Painter::mousePressEventOnDrawLineMode(QMouseEvent *event)
     Q_ASSERT(whatIsDoingNow == IDLE);
     if (event->button() == Qt::LeftButton) {
         whatIsDoingNow = DRAWING_LINE;
-        pb = event->pos();
+        pb = canvasPos(event);
     }
 }
 
 void Painter::mouseMoveEventOnDrawLineMode(QMouseEvent *event)
 {
     if (whatIsDoingNow == DRAWING_LINE) {
-        pe = event->pos();
+        pe = canvasPos(event);
         update();
     }
 }
@@ -151,7 +301,7 @@ void Painter::mouseReleaseEventOnDrawLineMode(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         if (whatIsDoingNow == DRAWING_LINE) {
-            pe = event->pos();
+            pe = canvasPos(event);
             if (!utils::isClose(pb, pe, 10)) {
                 addShapeAndFocus(new cg::Line(pb, pe, penColor, ""));
             }
@@ -165,10 +315,15 @@ void Painter::paintEventOnDrawPolygonMode(QPaintEvent * /* event */)
 {
     if (whatIsDoingNow == DRAWING_POLYGON) {
         Q_ASSERT(points.size() >= 1);
-        for (int i = 0; i < points.size() - 1; ++i) {
-            cg::Line(points[i], points[i + 1], penColor, "").draw(canvas);
+        if (!reuseRubberBand()) {
+            for (int i = 0; i < points.size() - 1; ++i) {
+                cg::Line(viewport.map(points[i]), viewport.map(points[i + 1]),
+                         penColor, "").draw(canvas);
+            }
+            cacheRubberBand();
         }
-        cg::Line(points.back(), pe, penColor, "").draw(canvas);
+        cg::Line(viewport.map(points.back()), viewport.map(pe),
+                 penColor, "").draw(canvas);
     }
 }
 
@@ -183,13 +338,13 @@ void Painter::mouseMoveEventOnDrawPolygonMode(QMouseEvent *event)
         return;
 
     Q_ASSERT(whatIsDoingNow == DRAWING_POLYGON);
-    pe = event->pos();
+    pe = canvasPos(event);
     update();
 }
 
 void Painter::mouseReleaseEventOnDrawPolygonMode(QMouseEvent *event)
 {
-    QPoint mousePos = event->pos();
+    QPoint mousePos = canvasPos(event);
     if (whatIsDoingNow == IDLE) {
         if (event->button() == Qt::LeftButton) {
             whatIsDoingNow = DRAWING_POLYGON;
@@ -202,7 +357,7 @@ void Painter::mouseReleaseEventOnDrawPolygonMode(QMouseEvent *event)
         Q_ASSERT(points.size() > 0);
         if (event->button() == Qt::LeftButton) {
             if (points.size() >= 3 && utils::isClose(mousePos, points.first(), 8)) {
-                addShapeAndFocus(new cg::Polygon(points, penColor, ""));
+                addShapeAndFocus(new cg::Polygon(utils::toPointF(points), penColor, ""));
                 points.clear();
                 whatIsDoingNow = IDLE;
             }
@@ -221,6 +376,7 @@ void Painter::mouseReleaseEventOnDrawPolygonMode(QMouseEvent *event)
         else {
             Q_ASSERT(false); /* Should not reach here */
         }
+        rubberBandDirty = true;
         update();
     }
 }
@@ -228,7 +384,8 @@ void Painter::mouseReleaseEventOnDrawPolygonMode(QMouseEvent *event)
 void Painter::paintEventOnDrawEllipseMode(QPaintEvent * /* event */)
 {
     if (whatIsDoingNow == DRAWING_ELLIPSE) {
-        cg::Ellipse(pb, pe, penColor, "").draw(canvas);
+        cg::Ellipse(viewport.map(pb), viewport.map(pe),
+                    penColor, "").draw(canvas);
     }
 }
 
@@ -237,14 +394,14 @@ void Painter::mousePressEventOnDrawEllipseMode(QMouseEvent *event)
     Q_ASSERT(whatIsDoingNow == IDLE);
     if (event->button() == Qt::LeftButton) {
         whatIsDoingNow = DRAWING_ELLIPSE;
-        pb = event->pos();
+        pb = canvasPos(event);
     }
 }
 
 void Painter::mouseMoveEventOnDrawEllipseMode(QMouseEvent *event)
 {
     if (whatIsDoingNow == DRAWING_ELLIPSE) {
-        pe = event->pos();
+        pe = canvasPos(event);
         update();
     }
 }
@@ -253,7 +410,7 @@ void Painter::mouseReleaseEventOnDrawEllipseMode(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         if (whatIsDoingNow == DRAWING_ELLIPSE) {
-            pe = event->pos();
+            pe = canvasPos(event);
             if (!utils::isClose(pb, pe, 10)) {
                 addShapeAndFocus(new cg::Ellipse(pb, pe, penColor, ""));
             }
@@ -267,17 +424,104 @@ void Painter::paintEventOnDrawCurveMode(QPaintEvent * /* event */)
 {
     if (whatIsDoingNow == DRAWING_CURVE) {
         Q_ASSERT(points.size() >= 1);
-        QVector<QPoint> pointsToDraw = points;
-        pointsToDraw.append(pe);
+        if (!reuseRubberBand()) {
+            drawCurveRubberBand();
+            cacheRubberBand();
+        }
 
-        QPainter painter(&canvas);
-        painter.setPen(Qt::DashLine);
-        for (int i = 0; i < pointsToDraw.size() - 1; ++i)
-            painter.drawLine(pointsToDraw[i], pointsToDraw[i + 1]);
-        cg::Curve(pointsToDraw, penColor, "").draw(canvas);
+        QPoint last = viewport.map(points.back());
+        QPoint cursor = viewport.map(pe);
+        {
+            QPainter painter(&canvas);
+            painter.setPen(Qt::DashLine);
+            painter.drawLine(last, cursor);
+        }
+
+        QPointF d = cursor - last;
+        QVector<QPoint> tail;
+        tail.reserve(curveTail.size());
+        for (int i = 0; i < curveTail.size(); ++i) {
+            QPointF p = curveTail[i] + curveTailWeights[i] * d;
+            tail.append(QPoint(qRound(p.x()), qRound(p.y())));
+        }
+        if (!tail.isEmpty())
+            cg::Polyline::rasterize(canvas, tail.constData(), tail.size(),
+                                    penColor.rgb(), cg::Algorithm::DEFAULT);
     }
 }
 
+void Painter::drawCurveRubberBand()
+{
+    /* The preview is the Bezier curve of points and the cursor. Write it
+     * as B(t) = F(t) + t^n * (cursor - last), where F puts the cursor on
+     * the last point and n is the number of points. F is fixed, and
+     * t^n * |cursor - last| is below half a pixel for all t up to a
+     * split that is close to 1 when n is large. Only the curve past the
+     * split is redrawn as the cursor moves. */
+    QVector<QPoint> controls;
+    for (auto &p : points)
+        controls.append(viewport.map(p));
+    QPoint last = controls.back();
+
+    QPainter painter(&canvas);
+    painter.setPen(Qt::DashLine);
+    double length = 0.0;
+    for (int i = 0; i < controls.size() - 1; ++i) {
+        painter.drawLine(controls[i], controls[i + 1]);
+        QPoint d = controls[i + 1] - controls[i];
+        length += qSqrt(static_cast<double>(QPoint::dotProduct(d, d)));
+    }
+    painter.end();
+
+    /* The cursor stays on the widget, so it is never farther from the
+     * last point than the farthest corner. */
+    double reach = 0.0;
+    QPoint corners[4] = { rect().topLeft(), rect().topRight(),
+                          rect().bottomLeft(), rect().bottomRight() };
+    for (auto &corner : corners) {
+        QPoint d = corner - last;
+        reach = qMax(reach, qSqrt(static_cast<double>(QPoint::dotProduct(d, d))));
+    }
+
+    /* Sample about once every two pixels of the longest control polygon
+     * the cursor can make; the samples are joined by lines. */
+    int samples = qBound(8, qCeil((length + reach) / 2), 1000);
+    int n = controls.size();
+    controls.append(last);
+
+    QVector<QPoint> head;
+    QVector<QPointF> work(controls.size());
+    curveTail.clear();
+    curveTailWeights.clear();
+    for (int k = 0; k <= samples; ++k) {
+        double t = static_cast<double>(k) / samples;
+        double weight = qPow(t, n);
+
+        /* de Casteljau's algorithm on F's control points */
+        for (int i = 0; i < controls.size(); ++i)
+            work[i] = controls[i];
+        for (int r = controls.size() - 1; r > 0; --r)
+            for (int i = 0; i < r; ++i)
+                work[i] = (1 - t) * work[i] + t * work[i + 1];
+
+        if (curveTail.isEmpty() && weight * reach < 0.5) {
+            head.append(QPoint(qRound(work[0].x()), qRound(work[0].y())));
+        }
+        else {
+            if (curveTail.isEmpty() && !head.isEmpty()) {
+                /* Join the tail to the end of the cached curve. */
+                curveTail.append(head.back());
+                curveTailWeights.append(0.0);
+            }
+            curveTail.append(work[0]);
+            curveTailWeights.append(weight);
+        }
+    }
+    if (!head.isEmpty())
+        cg::Polyline::rasterize(canvas, head.constData(), head.size(),
+                                penColor.rgb(), cg::Algorithm::DEFAULT);
+}
+
 void Painter::mousePressEventOnDrawCurveMode(QMouseEvent * /*event*/)
 {
     /* Do nothing */
@@ -289,13 +533,13 @@ void Painter::mouseMoveEventOnDrawCurveMode(QMouseEvent *event)
         return;
 
     Q_ASSERT(whatIsDoingNow == DRAWING_CURVE);
-    pe = event->pos();
+    pe = canvasPos(event);
     update();
 }
 
 void Painter::mouseReleaseEventOnDrawCurveMode(QMouseEvent *event)
 {
-    QPoint mousePos = event->pos();
+    QPoint mousePos = canvasPos(event);
     if (whatIsDoingNow == IDLE) {
         if (event->button() == Qt::LeftButton) {
             whatIsDoingNow = DRAWING_CURVE;
@@ -308,7 +552,7 @@ void Painter::mouseReleaseEventOnDrawCurveMode(QMouseEvent *event)
         Q_ASSERT(points.size() > 0);
         if (event->button() == Qt::LeftButton) {
             if (points.size() >= 2 && utils::isClose(mousePos, points.last(), 8)) {
-                addShapeAndFocus(new cg::Curve(points, penColor, ""));
+                addShapeAndFocus(new cg::Curve(utils::toPointF(points), penColor, ""));
                 points.clear();
                 whatIsDoingNow = IDLE;
             }
@@ -324,25 +568,45 @@ void Painter::mouseReleaseEventOnDrawCurveMode(QMouseEvent *event)
         else {
             Q_ASSERT(false); /* Should not reach here */
         }
+        rubberBandDirty = true;
         update();
     }
 }
 
+/* Starts the canvas from the cached rubber band if it is still valid.
+ * Otherwise the caller draws the fixed parts and calls cacheRubberBand(). */
+bool Painter::reuseRubberBand()
+{
+    if (!rubberBandDirty && rubberBandFrame == canvas.cacheKey()) {
+        canvas = rubberBand;
+        return true;
+    }
+    rubberBandFrame = canvas.cacheKey();
+    return false;
+}
+
+void Painter::cacheRubberBand()
+{
+    rubberBand = canvas;
+    rubberBandDirty = false;
+}
+
 void Painter::paintEventOnTransformMode(QPaintEvent * /* event */)
 {
     if (curShape) {
         if (whatIsDoingNow == SCALING) {
-            drawRectHull(curShape->getRectHull());
-            drawCenter(fixedCenter);
+            drawRectHull(viewport.map(curShape->getRectHull()));
+            drawCenter(viewport.map(fixedCenter));
         }
         else if (whatIsDoingNow == ROTATING) {
             double r = calculateRotate(fixedCenter, pb, pe);
-            drawRectHull(fixedHull, fixedCenter, r);
-            drawCenter(fixedCenter);
+            drawRectHull(viewport.map(fixedHull),
+                         viewport.map(fixedCenter), r);
+            drawCenter(viewport.map(fixedCenter));
         }
         else {
-            drawRectHull(curShape->getRectHull());
-            drawCenter(curShape->getCenter());
+            drawRectHull(viewport.map(curShape->getRectHull()));
+            drawCenter(viewport.map(curShape->getCenter()));
         }
     }
 }
@@ -353,25 +617,33 @@ void Painter::mousePressEventOnTransformMode(QMouseEvent *event)
     if (event->button() == Qt::LeftButton && curShape) {
         QPoint center = curShape->getCenter();
         QRect hull = curShape->getRectHull();
-        QPoint mousePos = event->pos();
+        QPoint mousePos = canvasPos(event);
+
+        /* Handles are hit in screen pixels whatever the zoom. */
+        QPoint screenPos = event->pos();
+        QRect screenHull = viewport.map(hull);
 
         /* Judgement sequence matters! */
-        if (inMoveCenterArea(center, mousePos)) {
+        if (inMoveCenterArea(viewport.map(center), screenPos)) {
             whatIsDoingNow = MOVING_CENTER;
             pb = mousePos;
+            fixedCenter = center;
         }
-        else if (inScaleArea(hull, mousePos)) {
+        else if (inScaleArea(screenHull, screenPos)) {
             whatIsDoingNow = SCALING;
+            dragSnapshot = curShape->clone();
             curShape->beginTransaction();
             pb = mousePos;
             fixedCenter = center;
         }
-        else if (inTranslateArea(hull, mousePos)) {
+        else if (inTranslateArea(screenHull, screenPos)) {
             whatIsDoingNow = TRANSLATING;
             pb = mousePos;
+            dragOrigin = mousePos;
         }
         else if (inRotateArea(center, mousePos)) {
             whatIsDoingNow = ROTATING;
+            dragSnapshot = curShape->clone();
             curShape->beginTransaction();
             pb = mousePos;
             fixedCenter = center;
@@ -388,11 +660,13 @@ void Painter::mouseMoveEventOnTransformMode(QMouseEvent *event)
     if (!curShape)
         return;
 
-    QPoint mousePos = event->pos();
+    QPoint mousePos = canvasPos(event);
 
     if (whatIsDoingNow == IDLE) {
-        QRect hull = curShape->getRectHull();
-        QPoint center = curShape->getCenter();
+        /* Hover feedback is judged in screen pixels, like the press. */
+        QRect hull = viewport.map(curShape->getRectHull());
+        QPoint center = viewport.map(curShape->getCenter());
+        mousePos = event->pos();
 
         if (inMoveCenterArea(center, mousePos)) {
             setCursor(Qt::ArrowCursor);
@@ -416,25 +690,53 @@ void Painter::mouseMoveEventOnTransformMode(QMouseEvent *event)
             unsetCursor();
         }
     }
-    else if (whatIsDoingNow == MOVING_CENTER) {
+    else if (dragTimer.isActive()) {
+        /* Within a frame: keep only the newest position. */
+        if (hasPendingDrag)
+            ++droppedDragEvents;
+        dragPos = mousePos;
+        hasPendingDrag = true;
+    }
+    else {
+        /* First event of a frame: apply it at once for low latency. */
+        applyDrag(mousePos);
+        dragTimer.start();
+    }
+}
+
+void Painter::applyPendingDrag()
+{
+    if (!hasPendingDrag || !curShape || whatIsDoingNow == IDLE) {
+        /* The pointer rested for a whole frame. */
+        dragTimer.stop();
+        return;
+    }
+    hasPendingDrag = false;
+    applyDrag(dragPos);
+}
+
+void Painter::applyDrag(const QPoint &mousePos)
+{
+    ++appliedDragEvents;
+    if (whatIsDoingNow == MOVING_CENTER) {
         curShape->setCenter(mousePos);
-        update();
+        updateScene();
     }
     else if (whatIsDoingNow == SCALING) {
         double s = calculateScale(fixedCenter, pb, mousePos);
         curShape->scale(fixedCenter, s);
-        update();
+        updateShape(curShape);
     }
     else if (whatIsDoingNow == TRANSLATING) {
         curShape->translate(mousePos - pb);
         pb = mousePos;
-        update();
+        updateShape(curShape);
     }
     else if (whatIsDoingNow == ROTATING) {
         pe = mousePos;   /* for paint use */
         double r = calculateRotate(fixedCenter, pb, pe);
         curShape->rotate(fixedCenter, r);
-        update();
+        updateShape(curShape);
     }
     else {
         Q_ASSERT(false); /* Should not reach here. */
@@ -444,30 +746,48 @@ void Painter::mouseMoveEventOnTransformMode(QMouseEvent *event)
 void Painter::mouseReleaseEventOnTransformMode(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton && curShape) {
-        QPoint mousePos = event->pos();
+        QPoint mousePos = canvasPos(event);
 
+        /* The release position supersedes any pending drag. */
+        if (hasPendingDrag) {
+            ++droppedDragEvents;
+            hasPendingDrag = false;
+        }
+        dragTimer.stop();
+
+        /* Translations and moves of the center are journaled by their
+         * parameters; scaling and rotating round the vertices, so they
+         * are journaled by the snapshot taken when the drag began. */
         if (whatIsDoingNow == MOVING_CENTER) {
             curShape->setCenter(mousePos);
+            if (mousePos != fixedCenter)
+                journal.recordSetCenter(curShape, fixedCenter, mousePos);
         }
         else if (whatIsDoingNow == TRANSLATING) {
             curShape->translate(mousePos - pb);
+            if (mousePos != dragOrigin)
+                journal.recordTranslate(curShape, mousePos - dragOrigin);
         }
         else if (whatIsDoingNow == SCALING) {
             double s = calculateScale(fixedCenter, pb, mousePos);
             curShape->scale(fixedCenter, s);
             curShape->commitTransaction();
+            journal.recordChange(curShape, dragSnapshot);
+            dragSnapshot = nullptr;
         }
         else if (whatIsDoingNow == ROTATING) {
             pe = mousePos;
             double r = calculateRotate(fixedCenter, pb, pe);
             curShape->rotate(fixedCenter, r);
             curShape->commitTransaction();
+            journal.recordChange(curShape, dragSnapshot);
+            dragSnapshot = nullptr;
         }
         else {
             Q_ASSERT(false); /* Should not reach here. */
         }
         whatIsDoingNow = IDLE;
-        update();
+        updateShape(curShape);
     }
 }
 
@@ -476,7 +796,7 @@ void Painter::paintEventOnClipMode(QPaintEvent * /*event*/)
     if (whatIsDoingNow == CLIPPING) {
         QPainter painter(&canvas);
         painter.setPen(Qt::DashLine);
-        painter.drawRect(QRect(pb, pe));
+        painter.drawRect(QRect(viewport.map(pb), viewport.map(pe)));
     }
 }
 
@@ -485,14 +805,14 @@ void Painter::mousePressEventOnClipMode(QMouseEvent *event)
     Q_ASSERT(whatIsDoingNow == IDLE);
     if (event->button() == Qt::LeftButton) {
         whatIsDoingNow = CLIPPING;
-        pb = event->pos();
+        pb = canvasPos(event);
     }
 }
 
 void Painter::mouseMoveEventOnClipMode(QMouseEvent *event)
 {
     if (whatIsDoingNow == CLIPPING) {
-        pe = event->pos();
+        pe = canvasPos(event);
         update();
     }
 }
@@ -501,9 +821,12 @@ void Painter::mouseReleaseEventOnClipMode(QMouseEvent *event)
 {
     if (event->button() == Qt::LeftButton) {
         if (whatIsDoingNow == CLIPPING) {
-            pe = event->pos();
-            if (curShape && !utils::isClose(pb, pe, 10)) {
-                clipShapeAndRefocus(curShape);
+            pe = canvasPos(event);
+            if (!utils::isClose(pb, pe, 10)) {
+                if (curMode == CLIP_ALL_MODE)
+                    clipAllShapes();
+                else if (curShape)
+                    clipShapeAndRefocus(curShape);
             }
             whatIsDoingNow = IDLE;
             update();
@@ -513,31 +836,70 @@ void Painter::mouseReleaseEventOnClipMode(QMouseEvent *event)
 
 void Painter::setCanvasSize(const QSize &size)
 {
-    if (size != canvas.size()) {
-        canvas = QImage(size, QImage::Format_RGB32);
-        update();
+    if (size != canvasSize) {
+        canvasSize = size;
+        updateView();
         updateGeometry();
     }
 }
 
 bool Painter::saveCanvas(const QString &fileName)
 {
-    QImage image(canvas.size(), QImage::Format_RGB32);
-    clearCanvas(image);
+    if (fileName.endsWith(".svg", Qt::CaseInsensitive))
+        return cg::SvgExporter::save(fileName, store, canvasSize);
+
+    /* Render into tiles, so that a large, sparsely drawn canvas never
+     * needs one dense buffer when saved as BMP. */
+    cg::TiledCanvas image(canvasSize.width(), canvasSize.height());
     drawShapes(image);
 
-    return image.save(fileName);
+    if (fileName.endsWith(".bmp", Qt::CaseInsensitive))
+        return image.saveBmp(fileName);
+    return image.toImage().save(fileName);
+}
+
+bool Painter::saveScene(const QString &fileName)
+{
+    return cg::SceneFile::save(fileName, store, canvasSize);
+}
+
+bool Painter::openScene(const QString &fileName, QString *errorString)
+{
+    cg::SceneFile scene;
+    if (!scene.open(fileName)) {
+        if (errorString)
+            *errorString = scene.errorString();
+        return false;
+    }
+
+    setCurrentShape(nullptr);
+    QList<cg::Shape *> before = shapes;
+    for (auto shape : before) {
+        emit shapeRemoved(shape);
+    }
+    shapes = scene.createShapes();
+    for (auto shape : shapes) {
+        emit shapeAdded(shape);
+    }
+    /* The old shapes are kept alive by the journal. */
+    journal.recordReplaceAll(before, shapes);
+    storeShapes();
+    setCanvasSize(scene.getCanvasSize());
+    updateScene();
+    return true;
 }
 
 void Painter::setPenColor(const QColor &color)
 {
     penColor = color;
+    rubberBandDirty = true;
 }
 
 void Painter::setCurrentMode(int mode)
 {
     if (mode != curMode) {
         curMode = mode;
+        rubberBandDirty = true;
         switch (curMode) {
         case DRAW_LINE_MODE:    /* fall through */
         case DRAW_ELLIPSE_MODE:
@@ -553,7 +915,8 @@ void Painter::setCurrentMode(int mode)
             setMouseTracking(true);
             unsetCursor();
             break;
-        case CLIP_MODE:
+        case CLIP_MODE:     /* fall through */
+        case CLIP_ALL_MODE:
             setMouseTracking(false);
             // TODO: select a more appropriate cursor
             unsetCursor();
@@ -588,12 +951,15 @@ void Painter::addShape(cg::Shape *shape)
     /* It's better to check whether the shape added
      * is already in the shape list. */
     shapes.append(shape);
+    handles.insert(shape, store.append(*shape));
     emit shapeAdded(shape);
+    updateScene();
 }
 
 void Painter::addShapeAndFocus(cg::Shape *shape)
 {
     addShape(shape);
+    journal.recordReplace(nullptr, -1, shape, shapes.size() - 1);
     setCurrentShape(shape);
 }
 
@@ -606,7 +972,9 @@ void Painter::removeShape(cg::Shape *shape)
         qDebug("Can't find shape when removing");
         return;
     }
+    store.remove(handles.take(shape));
     emit shapeRemoved(shape);
+    updateScene();
 }
 
 void Painter::clipShapeAndRefocus(cg::Shape *shape)
@@ -614,38 +982,137 @@ void Painter::clipShapeAndRefocus(cg::Shape *shape)
     if (!shape)
         return;
 
-    cg::Line *line = dynamic_cast<cg::Line *>(shape);
-    if (line) {
-        cg::Shape *clippedShape = line->clip(pb, pe, "");
-        removeShape(line);
-        delete line;
-        if (clippedShape)
-            addShapeAndFocus(clippedShape);
-        else
-            setCurrentShape(nullptr);
+    int index = shapes.indexOf(shape);
+    cg::Shape *clippedShape = shape->clip(pb, pe, "");
+    removeShape(shape);
+    addShape(clippedShape);
+    /* The original shape is kept alive by the journal. */
+    journal.recordReplace(shape, index, clippedShape,
+                          clippedShape ? shapes.size() - 1 : -1);
+    setCurrentShape(clippedShape);
+}
+
+void Painter::clipAllShapes()
+{
+    cg::Shape *focusedShape = curShape;
+    setCurrentShape(nullptr);
+
+    /* Lines are clipped in place, so clip copies of them and keep the
+     * originals for undo. */
+    QList<cg::Shape *> before = shapes;
+    QVector<cg::Shape *> input = shapes.toVector();
+    for (auto &shape : input) {
+        if (dynamic_cast<cg::Line *>(shape))
+            shape = shape->clone();
     }
-    else {
-        /* Trick: The following code enables you to
-         * delete other shapes by clipping. */
-        removeShape(shape);
-        delete shape;
-        setCurrentShape(nullptr);
+    QVector<cg::Shape *> after = cg::BatchClipper(pb, pe).clip(input, "");
+
+    /* Rebuild the list in one pass to keep the drawing order and
+     * avoid a linear removeOne() per clipped shape. */
+    shapes.clear();
+    for (int i = 0; i < before.size(); ++i) {
+        if (input[i] != before[i] && after[i] != input[i])
+            delete input[i];    /* a copy clipped away entirely */
+        if (after[i] != before[i]) {
+            if (before[i] == focusedShape)
+                focusedShape = after[i];
+            emit shapeRemoved(before[i]);
+            if (after[i])
+                emit shapeAdded(after[i]);
+        }
+        if (after[i])
+            shapes.append(after[i]);
     }
+    journal.recordReplaceAll(before, shapes);
+    storeShapes();
+    setCurrentShape(focusedShape);
+    updateScene();
 }
 
-void Painter::drawShapes(QImage &image)
+void Painter::drawShapes(cg::TiledCanvas &image)
 {
+    store.draw(image);
+}
+
+/* Fills the store from shapes anew, after an operation on all of them.
+ * Other edits update it shape by shape. */
+void Painter::storeShapes()
+{
+    store.clear();
+    handles.clear();
     for (auto shape : shapes) {
-        shape->draw(image);
+        handles.insert(shape, store.append(*shape));
     }
 }
 
+/* The shape changed in place. */
+void Painter::updateShape(cg::Shape *shape)
+{
+    Q_ASSERT(handles.contains(shape));
+    store.update(handles.value(shape), *shape);
+    updateScene();
+}
+
+void Painter::updateScene()
+{
+    sceneDirty = true;
+    rubberBandDirty = true;
+    update();
+}
+
+/* Only the viewport or the widget changed, so the worker can draw the
+ * store it already has. */
+void Painter::updateView()
+{
+    viewDirty = true;
+    rubberBandDirty = true;
+    update();
+}
+
+void Painter::requestFrame()
+{
+    TRACE_SCOPE("drawShapes");
+    renderWorker->requestFrame(store.takeChanges(), size(), viewport,
+                               canvasSize);
+    sceneDirty = false;
+    viewDirty = false;
+}
+
 void Painter::clearShapes()
 {
-    for (auto shape : shapes) {
-        delete shape;
-    }
+    /* The shapes are kept alive by the journal. */
+    journal.recordReplaceAll(shapes, QList<cg::Shape *>());
     shapes.clear();
+    store.clear();
+    handles.clear();
+}
+
+void Painter::applyJournalChanges(const QList<cg::Shape *> &removed,
+                                  const QList<cg::Shape *> &added,
+                                  const QList<cg::Shape *> &changed)
+{
+    for (auto shape : removed) {
+        if (shape == curShape)
+            setCurrentShape(nullptr);
+        emit shapeRemoved(shape);
+    }
+    for (auto shape : added) {
+        emit shapeAdded(shape);
+    }
+
+    /* Only undoing or redoing an operation on all shapes adds several. */
+    if (added.size() > 1) {
+        storeShapes();
+    }
+    else {
+        for (auto shape : removed)
+            store.remove(handles.take(shape));
+        for (auto shape : added)
+            handles.insert(shape, store.insert(shapes.indexOf(shape), *shape));
+        for (auto shape : changed)
+            store.update(handles.value(shape), *shape);
+    }
+    updateScene();
 }
 
 void Painter::drawRectHull(const QRect &hull)
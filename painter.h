@@ -2,41 +2,66 @@
 #define PAINTER_H
 
 #include "shape.h"
+#include "shapestore.h"
+#include "journal.h"
+#include "tiledcanvas.h"
+#include "viewport.h"
 
 #include <QWidget>
+#include <QThread>
+#include <QTimer>
 #include <QImage>
 #include <QSize>
 #include <QPoint>
 #include <QColor>
+#include <QCursor>
+#include <QHash>
 #include <QList>
 #include <QVector>
 
+class RenderWorker;
+
 class Painter : public QWidget
 {
     Q_OBJECT
 public:
     explicit Painter(int width, int height, QWidget *parent = nullptr);
+    ~Painter();
 
     QSize sizeHint() const;
 
     void clear();
 
-    QSize getCanvasSize() const { return canvas.size(); }
+    QSize getCanvasSize() const { return canvasSize; }
     void setCanvasSize(const QSize &size);
     bool saveCanvas(const QString &fileName);
 
+    /* Scenes are saved as binary documents, see cg::SceneFile. Opening
+     * one replaces the shapes and the canvas size; it can be undone. */
+    bool saveScene(const QString &fileName);
+    bool openScene(const QString &fileName, QString *errorString = nullptr);
+
     QColor getPenColor() const { return penColor; }
     void setPenColor(const QColor &color);
 
     int getCurrentMode() const { return curMode; }
     void setCurrentMode(int mode);
 
+    cg::Shape *getCurrentShape() const { return curShape; }
     void setCurrentShape(cg::Shape *shape);
 
+    /* Memory the undo history may keep, in bytes. */
+    void setUndoBudget(qint64 bytes);
+
+    /* Pointer events of transform drags that were coalesced away
+     * versus applied to the shape. */
+    int getDroppedDragEvents() const { return droppedDragEvents; }
+    int getAppliedDragEvents() const { return appliedDragEvents; }
+
     // enum for curMode
     enum {
         DRAW_LINE_MODE, DRAW_POLYGON_MODE, DRAW_ELLIPSE_MODE,
-        DRAW_CURVE_MODE, TRANSFORM_MODE, CLIP_MODE,
+        DRAW_CURVE_MODE, TRANSFORM_MODE, CLIP_MODE, CLIP_ALL_MODE,
     };
 
 signals:
@@ -45,12 +70,23 @@ signals:
     void currentShapeChanged(cg::Shape *);
 
 public slots:
+    void undo();
+    void redo();
+
+    void zoomIn();
+    void zoomOut();
+    void resetZoom();
+
+private slots:
+    void applyPendingDrag();
 
 protected:
     void paintEvent(QPaintEvent *event);
     void mousePressEvent(QMouseEvent *event);
     void mouseMoveEvent(QMouseEvent *event);
     void mouseReleaseEvent(QMouseEvent *event);
+    void wheelEvent(QWheelEvent *event);
+    void resizeEvent(QResizeEvent *event);
 
 private:
     void paintEventOnDrawLineMode(QPaintEvent *event);
@@ -77,20 +113,37 @@ private:
     void mousePressEventOnTransformMode(QMouseEvent *event);
     void mouseMoveEventOnTransformMode(QMouseEvent *event);
     void mouseReleaseEventOnTransformMode(QMouseEvent *event);
+    void applyDrag(const QPoint &mousePos);
+
+    bool reuseRubberBand();
+    void cacheRubberBand();
+    void drawCurveRubberBand();
 
     void paintEventOnClipMode(QPaintEvent *event);
     void mousePressEventOnClipMode(QMouseEvent *event);
     void mouseMoveEventOnClipMode(QMouseEvent *event);
     void mouseReleaseEventOnClipMode(QMouseEvent *event);
 
+    QPoint canvasPos(QMouseEvent *event) const;
+    void zoomAt(const QPoint &pos, double zoom);
+
     static void clearCanvas(QImage &canvas);
     void addShape(cg::Shape *shape);
     void addShapeAndFocus(cg::Shape *shape);
     void removeShape(cg::Shape *shape);
     void clipShapeAndRefocus(cg::Shape *shape);
+    void clipAllShapes();
 
-    void drawShapes(QImage &canvas);
+    void storeShapes();
+    void updateShape(cg::Shape *shape);
+    void drawShapes(cg::TiledCanvas &canvas);
     void clearShapes();
+    void applyJournalChanges(const QList<cg::Shape *> &removed,
+                             const QList<cg::Shape *> &added,
+                             const QList<cg::Shape *> &changed);
+    void updateScene();
+    void updateView();
+    void requestFrame();
 
     void drawRectHull(const QRect &hull);
     void drawRectHull(const QRect &hull, const QPoint &center, double theta);
@@ -120,19 +173,64 @@ private:
         CLIPPING,
     };
 
-    QImage canvas;
+    QSize canvasSize;   /* the size of the paper the shapes are drawn on */
+    QImage canvas;      /* the latest frame plus the overlays of this paint */
+    QImage frame;       /* front buffer taken from the render worker */
     QColor penColor;
     int curMode;
     int whatIsDoingNow;
 
     QList<cg::Shape *> shapes;
     cg::Shape *curShape;
+    cg::Journal journal;    /* undo/redo history of shapes */
+    cg::ShapeStore store;   /* follows shapes edit by edit */
+    QHash<cg::Shape *, int> handles;    /* the store handle of each shape */
+
+    /* Shapes are rasterized by renderWorker in renderThread. The GUI
+     * thread only sends it snapshots and draws the overlays. */
+    QThread renderThread;
+    RenderWorker *renderWorker;
+    bool sceneDirty;    /* shapes changed since the last snapshot */
+    bool viewDirty;     /* viewport or widget size changed since then */
+
+    /* The widget shows the paper through viewport. Mouse positions are
+     * mapped to the paper as they arrive, so pb, pe, points, etc. are
+     * all in paper coordinates. */
+    enum { ZOOM_LIMIT = 64 };   /* zoom stays within [1/64, 64] */
+    cg::Viewport viewport;
+    bool panning;
+    QPoint panStart;
+    QPointF panOrigin;
+    QCursor cursorBeforePan;
 
     /* temporary varibles for drawing lines, transfroming, etc. */
     QPoint pb, pe;      /* pointBegin, pointEnd */
     QPoint fixedCenter; /* Remember the center when scaling and rotating. */
     QRect fixedHull;    /* Remember the hull when rotating. */
+    QPoint dragOrigin;  /* Remember where a translation began. */
+    cg::Shape *dragSnapshot;  /* The shape before scaling or rotating */
     QVector<QPoint> points;   /* for drawing polygons */
+
+    /* The rubber band of an in-progress polygon or curve. The parts that
+     * don't follow the cursor are drawn once over the frame and kept in
+     * rubberBand until the points, the frame or the viewport change. */
+    QImage rubberBand;
+    qint64 rubberBandFrame;     /* cacheKey() of the frame below it */
+    bool rubberBandDirty;
+    /* The end of the preview curve that the cursor still moves: where
+     * it would be with the cursor on the last point, and how far it
+     * follows the cursor, in screen coordinates. */
+    QVector<QPointF> curveTail;
+    QVector<double> curveTailWeights;
+
+    /* Transform drags are applied at most once per frame, using the
+     * newest pointer position seen since the last frame. */
+    enum { DRAG_FRAME_INTERVAL = 16 };  /* ms */
+    QTimer dragTimer;
+    QPoint dragPos;
+    bool hasPendingDrag;
+    int droppedDragEvents;
+    int appliedDragEvents;
 };
 
 #endif // PAINTER_H
@@ -1,20 +1,102 @@
 #include "paintercli.h"
-#include "line.h"
-#include "ellipse.h"
-#include "polygon.h"
-#include "curve.h"
+#include "batchclipper.h"
+#include "scenefile.h"
+#include "svgexporter.h"
+#include "linebenchmark.h"
+#include "renderserver.h"
+#include "scriptgenerator.h"
+#include "trace.h"
 
 #include <QFile>
 #include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
 #include <QTextStream>
 #include <QtDebug>
 #include <QtMath>
+#include <QtGlobal>
 
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
 #include <iostream>
 using std::cout;
 using std::cerr;
 using std::endl;
 
+namespace {
+
+/* The most memory the process has had resident; -1 if unknown. */
+qint64 peakResidentBytes()
+{
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return -1;
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return -1;
+#if defined(Q_OS_MACOS)
+    return usage.ru_maxrss;             /* in bytes */
+#else
+    return usage.ru_maxrss * 1024LL;    /* in kilobytes */
+#endif
+#endif
+}
+
+/* Draws a store into a canvas of its own at one scale and, given a file
+ * name, writes it. */
+class ScaledSave : public QRunnable
+{
+public:
+    ScaledSave(const cg::ShapeStore &store, cg::TiledCanvas &canvas,
+               double scale, cg::TiledCanvas::ImageFormat format,
+               const QString &fileName)
+        : store(store), canvas(canvas), scale(scale), format(format),
+          fileName(fileName), saved(false)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        cg::Trace::setThreadName("save worker");
+        save();
+    }
+
+    void save()
+    {
+        TRACE_SCOPE("save scaled canvas");
+        store.drawScaled(canvas, scale);
+        if (!fileName.isEmpty())
+            saved = canvas.save(fileName, format, true);
+    }
+
+    QString getFileName() const { return fileName; }
+    bool isSaved() const { return saved; }
+
+private:
+    const cg::ShapeStore &store;
+    cg::TiledCanvas &canvas;
+    double scale;
+    cg::TiledCanvas::ImageFormat format;
+    QString fileName;
+    bool saved;
+};
+
+}
+
 PainterCLI::~PainterCLI()
 {
     clearShapes();
@@ -22,29 +104,156 @@ PainterCLI::~PainterCLI()
 
 int PainterCLI::exec(int argc, char *argv[])
 {
-    if (argc != 3) {
-        cerr << "Usage: " << argv[0] << " <inFile> <outDir>" << endl;
-        return 1;
+    if (argc > 1 && QString(argv[1]) == "--generate") {
+        QStringList args;
+        for (int i = 2; i < argc; ++i)
+            args.append(argv[i]);
+        return ScriptGenerator().exec(args);
+    }
+    if (argc > 1 && QString(argv[1]) == "--bench") {
+        QStringList args;
+        for (int i = 2; i < argc; ++i)
+            args.append(argv[i]);
+        return LineBenchmark().exec(args);
+    }
+    if (argc > 1 && QString(argv[1]) == "--serve") {
+        QStringList args;
+        for (int i = 2; i < argc; ++i)
+            args.append(argv[i]);
+        return RenderServer().exec(args);
     }
 
-    /* initialize */
-    QFile inFile(argv[1]);
-    if (!inFile.open(QIODevice::ReadOnly)) {
-        cerr << "Cannot open file: " << qPrintable(inFile.errorString()) << endl;
+    bool memReport = false;
+    QString streamName;
+    bool valid = argc >= 3;
+    for (int i = 3; valid && i < argc; ++i) {
+        QString arg = argv[i];
+        if (arg == "--mem-report") {
+            memReport = true;
+        }
+        else if (arg == "--format" && i + 1 < argc) {
+            valid = parseFormat(argv[++i], format);
+        }
+        else if (arg == "--stream" && i + 1 < argc) {
+            streamName = argv[++i];
+        }
+        else {
+            valid = false;
+        }
+    }
+    if (!valid) {
+        cerr << "Usage: " << argv[0] << " <inFile> <outDir> "
+                "[--format bmp|qoi|ppm|raw] [--stream <file>] [--mem-report]" << endl;
+        cerr << "       " << argv[0] << " --generate <outFile> [--seed <n>] "
+                "[--shapes <n>] [--mix <l,p,e,c>] [--canvas <w>x<h>] "
+                "[--coords uniform|clustered] [--spill <percent>] "
+                "[--max-points <n>] [--transforms <density>] "
+                "[--saves <n>]" << endl;
+        cerr << "       " << argv[0] << " --bench [--seed <n>] [--lines <n>] "
+                "[--runs <n>] [--canvas <w>x<h>]" << endl;
+        cerr << "       " << argv[0] << " --serve [--jobs <n>]" << endl;
+        cerr << "<inFile> is a script or a scene document; - reads a script "
+                "from standard input." << endl;
+        cerr << "--trace <file> with any of these writes a timeline of the run."
+             << endl;
+        cerr << "--stream <file> writes every saved canvas to <file> as one "
+                "frame after another; - is standard output." << endl;
         return 1;
     }
+
+    QFile streamFile;
+    if (!streamName.isEmpty()) {
+        bool opened;
+        if (streamName == "-") {
+#if defined(Q_OS_WIN)
+            _setmode(_fileno(stdout), _O_BINARY);
+#endif
+            opened = streamFile.open(stdout, QIODevice::WriteOnly);
+        }
+        else {
+            streamFile.setFileName(streamName);
+            opened = streamFile.open(QIODevice::WriteOnly);
+        }
+        if (!opened) {
+            cerr << "Cannot open stream: " << qPrintable(streamFile.errorString()) << endl;
+            return 1;
+        }
+        stream = &streamFile;
+    }
+
     QDir outDir(argv[2]), dir;
     if (!outDir.exists() && !dir.mkdir(argv[2])) {
         cerr << "Fail to create output directory: " << argv[2] << endl;
         return 1;
     }
-    canvas = QImage(400, 300, QImage::Format_RGB32); /* default size */
+    int status = run(argv[1], outDir);
+    stream = nullptr;
+    /* Standard output may carry the frames. */
+    if (memReport)
+        printMemoryReport(streamName == "-" ? cerr : cout);
+    return status;
+}
+
+bool PainterCLI::parseFormat(const QString &name,
+                             cg::TiledCanvas::ImageFormat &format)
+{
+    if (name == "bmp")
+        format = cg::TiledCanvas::BMP;
+    else if (name == "ppm")
+        format = cg::TiledCanvas::PPM;
+    else if (name == "raw")
+        format = cg::TiledCanvas::RAW;
+    else if (name == "qoi")
+        format = cg::TiledCanvas::QOI;
+    else
+        return false;
+    return true;
+}
+
+void PainterCLI::setMaxThreadCount(int count)
+{
+    maxThreadCount = count;
+    executor.setMaxThreadCount(count);
+    savePool.setMaxThreadCount(qMax(1, count - 1));
+}
+
+int PainterCLI::run(const QString &fileName, const QDir &outDir)
+{
+    QFile inFile(fileName);
+    bool opened = fileName == "-" ? inFile.open(stdin, QIODevice::ReadOnly)
+                                  : inFile.open(QIODevice::ReadOnly);
+    if (!opened) {
+        cerr << "Cannot open file: " << qPrintable(inFile.errorString()) << endl;
+        return 1;
+    }
+    savedFiles.clear();
+    if (fileName != "-" && cg::SceneFile::isSceneFile(fileName))
+        return renderScene(fileName, outDir);
+    return runScript(&inFile, outDir);
+}
+
+int PainterCLI::run(QIODevice *script, const QDir &outDir)
+{
+    savedFiles.clear();
+    return runScript(script, outDir);
+}
+
+int PainterCLI::runScript(QIODevice *inFile, const QDir &outDir)
+{
+    TRACE_SCOPE("runScript");
+    /* initialize */
+    resetCanvas(400, 300); /* default size */
     curColor = Qt::black; /* default color */
 
     /* parse command */
-    QTextStream in(&inFile);
+    QTextStream in(inFile);
     while (!in.atEnd()) {
-        QStringList fields = in.readLine().split(' ');
+        QStringList fields;
+        {
+            /* Apart from the commands, which trace themselves. */
+            TRACE_SCOPE("parse");
+            fields = in.readLine().split(' ');
+        }
         if (fields.isEmpty()) {
             cerr << "Parse command error: too few arguments." << endl;
             return 1;
@@ -60,12 +269,49 @@ int PainterCLI::exec(int argc, char *argv[])
             resetCanvas(width, height);
         }
         else if (cmd == "saveCanvas") {
+            if (fields.isEmpty()) {
+                cerr << "Save canvas error: at least 1 argument expected." << endl;
+                return 1;
+            }
+            QString name = fields.takeFirst();
+            /* saveCanvas name scale... saves one bitmap per scale. */
+            QVector<double> scales;
+            while (!fields.isEmpty()) {
+                bool ok;
+                double scale = fields.first().toDouble(&ok);
+                if (!ok || scale <= 0.0) {
+                    cerr << "Save canvas error: invalid scale: "
+                         << qPrintable(fields.first()) << endl;
+                    return 1;
+                }
+                scales.append(scale);
+                fields.removeFirst();
+            }
+            /* saveCanvas name.svg exports the shapes, as the GUI does. */
+            bool svg = name.endsWith(".svg", Qt::CaseInsensitive);
+            if (svg && !scales.isEmpty()) {
+                cerr << "Save canvas error: an SVG takes no scales." << endl;
+                return 1;
+            }
+            if (!scales.isEmpty() && stream && format == cg::TiledCanvas::RAW) {
+                /* A reader couldn't tell where such frames end. */
+                cerr << "Save canvas error: scales can't be streamed as raw frames." << endl;
+                return 1;
+            }
+            if (svg)
+                saveSvg(outDir.filePath(name));
+            else if (scales.isEmpty())
+                saveCanvas(outDir.filePath(name));
+            else
+                saveCanvas(outDir.filePath(name), scales);
+        }
+        else if (cmd == "saveScene") {
             if (fields.size() != 1) {
-                cerr << "Save canvas error: 1 argument expected." << endl;
+                cerr << "Save scene error: 1 argument expected." << endl;
                 return 1;
             }
             QString name = fields.takeFirst();
-            saveCanvas(outDir.filePath(name));
+            saveScene(outDir.filePath(name));
         }
         else if (cmd == "setColor") {
             if (fields.size() != 3) {
@@ -83,12 +329,12 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             int id = fields.takeFirst().toInt();
-            int x1 = fields.takeFirst().toInt();
-            int y1 = fields.takeFirst().toInt();
-            int x2 = fields.takeFirst().toInt();
-            int y2 = fields.takeFirst().toInt();
+            double x1 = fields.takeFirst().toDouble();
+            double y1 = fields.takeFirst().toDouble();
+            double x2 = fields.takeFirst().toDouble();
+            double y2 = fields.takeFirst().toDouble();
             QString alg = fields.takeFirst();
-            drawLine(id, QPoint(x1, y1), QPoint(x2, y2), alg);
+            drawLine(id, QPointF(x1, y1), QPointF(x2, y2), alg);
         }
         else if (cmd == "drawPolygon") {
             if (fields.size() != 3) {
@@ -98,7 +344,7 @@ int PainterCLI::exec(int argc, char *argv[])
             int id = fields.takeFirst().toInt();
             int n = fields.takeFirst().toInt();
             QString alg = fields.takeFirst();
-            QVector<QPoint> points;
+            QVector<QPointF> points;
             fields = in.readLine().split(' ');
             if (fields.size() != 2 * n) {
                 cerr << "Draw polygon error: " << 2 * n <<
@@ -106,9 +352,9 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             while (!fields.isEmpty()) {
-                int x = fields.takeFirst().toInt();
-                int y = fields.takeFirst().toInt();
-                points.append(QPoint(x, y));
+                double x = fields.takeFirst().toDouble();
+                double y = fields.takeFirst().toDouble();
+                points.append(QPointF(x, y));
             }
             drawPolygon(id, points, alg);
         }
@@ -118,11 +364,11 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             int id = fields.takeFirst().toInt();
-            int x = fields.takeFirst().toInt();
-            int y = fields.takeFirst().toInt();
-            int rx = fields.takeFirst().toInt();
-            int ry = fields.takeFirst().toInt();
-            drawEllipse(id, QPoint(x, y), rx, ry);
+            double x = fields.takeFirst().toDouble();
+            double y = fields.takeFirst().toDouble();
+            double rx = fields.takeFirst().toDouble();
+            double ry = fields.takeFirst().toDouble();
+            drawEllipse(id, QPointF(x, y), rx, ry);
         }
         else if (cmd == "drawCurve") {
             if (fields.size() != 3) {
@@ -132,7 +378,7 @@ int PainterCLI::exec(int argc, char *argv[])
             int id = fields.takeFirst().toInt();
             int n = fields.takeFirst().toInt();
             QString alg = fields.takeFirst();
-            QVector<QPoint> points;
+            QVector<QPointF> points;
             fields = in.readLine().split(' ');
             if (fields.size() != 2 * n) {
                 cerr << "Draw curve error: " << 2 * n <<
@@ -140,9 +386,9 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             while (!fields.isEmpty()) {
-                int x = fields.takeFirst().toInt();
-                int y = fields.takeFirst().toInt();
-                points.append(QPoint(x, y));
+                double x = fields.takeFirst().toDouble();
+                double y = fields.takeFirst().toDouble();
+                points.append(QPointF(x, y));
             }
             drawCurve(id, points, alg);
         }
@@ -152,9 +398,9 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             int id = fields.takeFirst().toInt();
-            int dx = fields.takeFirst().toInt();
-            int dy = fields.takeFirst().toInt();
-            translate(id, QPoint(dx, dy));
+            double dx = fields.takeFirst().toDouble();
+            double dy = fields.takeFirst().toDouble();
+            translate(id, QPointF(dx, dy));
         }
         else if (cmd == "rotate") {
             if (fields.size() != 4) {
@@ -162,10 +408,10 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             int id = fields.takeFirst().toInt();
-            int x = fields.takeFirst().toInt();
-            int y = fields.takeFirst().toInt();
-            int r = fields.takeFirst().toInt();
-            rotate(id, QPoint(x, y), r);
+            double x = fields.takeFirst().toDouble();
+            double y = fields.takeFirst().toDouble();
+            double r = fields.takeFirst().toDouble();
+            rotate(id, QPointF(x, y), r);
         }
         else if (cmd == "scale") {
             if (fields.size() != 4) {
@@ -173,10 +419,10 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             int id = fields.takeFirst().toInt();
-            int x = fields.takeFirst().toInt();
-            int y = fields.takeFirst().toInt();
-            int s = fields.takeFirst().toInt();
-            scale(id, QPoint(x, y), s);
+            double x = fields.takeFirst().toDouble();
+            double y = fields.takeFirst().toDouble();
+            double s = fields.takeFirst().toDouble();
+            scale(id, QPointF(x, y), s);
         }
         else if (cmd == "clip") {
             if (fields.size() != 6) {
@@ -184,12 +430,24 @@ int PainterCLI::exec(int argc, char *argv[])
                 return 1;
             }
             int id = fields.takeFirst().toInt();
-            int x1 = fields.takeFirst().toInt();
-            int y1 = fields.takeFirst().toInt();
-            int x2 = fields.takeFirst().toInt();
-            int y2 = fields.takeFirst().toInt();
+            double x1 = fields.takeFirst().toDouble();
+            double y1 = fields.takeFirst().toDouble();
+            double x2 = fields.takeFirst().toDouble();
+            double y2 = fields.takeFirst().toDouble();
             QString alg = fields.takeFirst();
-            clip(id, QPoint(x1, y1), QPoint(x2, y2), alg);
+            clip(id, QPointF(x1, y1), QPointF(x2, y2), alg);
+        }
+        else if (cmd == "clipAll") {
+            if (fields.size() != 5) {
+                cerr << "Clip all error: 5 argument expected." << endl;
+                return 1;
+            }
+            double x1 = fields.takeFirst().toDouble();
+            double y1 = fields.takeFirst().toDouble();
+            double x2 = fields.takeFirst().toDouble();
+            double y2 = fields.takeFirst().toDouble();
+            QString alg = fields.takeFirst();
+            clipAll(QPointF(x1, y1), QPointF(x2, y2), alg);
         }
         else {
             cerr << "Undefined command: " << qPrintable(cmd) << endl;
@@ -200,34 +458,239 @@ int PainterCLI::exec(int argc, char *argv[])
     return 0;
 }
 
-void PainterCLI::drawShapes()
+int PainterCLI::renderScene(const QString &fileName, const QDir &outDir)
+{
+    TRACE_SCOPE("renderScene");
+    cg::SceneFile scene;
+    if (!scene.open(fileName)) {
+        cerr << "Cannot open scene: " << qPrintable(scene.errorString()) << endl;
+        return 1;
+    }
+
+    QSize size = scene.getCanvasSize();
+    canvas.reset(size.width(), size.height());
+    clearShapes();
+    /* Shapes off the canvas are never decoded. */
+    scene.appendTo(store, QRect(QPoint(0, 0), size));
+    store.draw(canvas);
+
+    QString name = outDir.filePath(QFileInfo(fileName).completeBaseName());
+    return writeCanvas(canvas, name) ? 0 : 1;
+}
+
+/* Prints the memory held by the shapes left at the end of the script,
+ * by type, and the peak resident memory of the whole run. */
+void PainterCLI::printMemoryReport(std::ostream &out)
 {
+    flushCommands();
+    QMap<QString, qint64> counts, bytes;
     for (auto iter = shapeManager.constBegin();
-         iter != shapeManager.constEnd(); ++iter)
-        if (iter.value())
-            iter.value()->draw(canvas);
+         iter != shapeManager.constEnd(); ++iter) {
+        cg::Shape *shape = iter.value();
+        if (!shape)
+            continue;
+        QString name = shape->shapeName();
+        counts[name] += 1;
+        bytes[name] += shape->sizeInBytes();
+    }
+
+    out << "Memory report:" << endl;
+    for (auto iter = counts.constBegin(); iter != counts.constEnd(); ++iter) {
+        qint64 total = bytes.value(iter.key());
+        out << "  " << std::left << std::setw(10) << qPrintable(iter.key())
+             << std::right << std::setw(10) << iter.value() << " shapes"
+             << std::setw(14) << total << " bytes"
+             << std::setw(10) << std::fixed << std::setprecision(1)
+             << static_cast<double>(total) / iter.value() << " bytes/shape" << endl;
+    }
+    out << "  Canvas: " << canvas.sizeInBytes() << " bytes" << endl;
+    qint64 peak = peakResidentBytes();
+    if (peak >= 0)
+        out << "  Peak RSS: " << peak << " bytes" << endl;
+    else
+        out << "  Peak RSS: unknown" << endl;
+}
+
+/* Runs the queued commands and brings the store up to date with the
+ * shapes they ran on. */
+void PainterCLI::flushCommands()
+{
+    QVector<int> ids;
+    executor.flush(&ids);
+    updateStore(ids);
+}
+
+/* Updates, removes or adds the records of the shapes with the ids, as
+ * shapeManager has them now. The store draws in the order of the ids,
+ * which is also the order of handles. */
+void PainterCLI::updateStore(const QVector<int> &ids)
+{
+    TRACE_SCOPE("updateStore");
+    QVector<int> added;
+    for (int id : ids) {
+        cg::Shape *shape = shapeManager.value(id, nullptr);
+        auto iter = handles.find(id);
+        if (iter == handles.end()) {
+            if (shape)
+                added.append(id);
+        }
+        else if (shape) {
+            store.update(iter.value(), *shape);
+        }
+        else {
+            store.remove(iter.value());
+            handles.erase(iter);
+        }
+    }
+
+    /* Ids past the last one stored are appended, as scripts mostly
+     * number their shapes in order; the others are placed by walking
+     * the ids before them. */
+    std::sort(added.begin(), added.end());
+    int position = 0;
+    auto stored = handles.constBegin();
+    for (int id : added) {
+        if (handles.isEmpty() || id > handles.lastKey()) {
+            position = store.size();
+        }
+        else {
+            while (stored != handles.constEnd() && stored.key() < id) {
+                ++stored;
+                ++position;
+            }
+        }
+        stored = handles.insert(id, store.insert(position, *shapeManager.value(id)));
+        ++stored;
+        ++position;
+    }
+}
+
+void PainterCLI::drawShapes()
+{
+    flushCommands();
+    store.draw(canvas);
 }
 
 void PainterCLI::clearShapes()
 {
+    executor.flush();
     for (auto iter = shapeManager.constBegin();
          iter != shapeManager.constEnd(); ++iter)
         if (iter.value())
             delete iter.value();
     shapeManager.clear();
+    store.clear();
+    handles.clear();
 }
 
 void PainterCLI::resetCanvas(int width, int height)
 {
-    canvas = QImage(width, height, QImage::Format_RGB32);
+    canvas.reset(width, height);
     clearShapes();
 }
 
 void PainterCLI::saveCanvas(const QString &name)
 {
-    canvas.fill(Qt::white);
+    TRACE_SCOPE("saveCanvas");
+    canvas.clear();
     drawShapes();
-    canvas.mirrored(false, true).save(name + ".bmp", "bmp");
+    writeCanvas(canvas, name);
+}
+
+/* Every scale is rasterized natively from the same store, each on its
+ * own canvas, and the scales are drawn and written in parallel. */
+void PainterCLI::saveCanvas(const QString &name, const QVector<double> &scales)
+{
+    TRACE_SCOPE("saveCanvas");
+    flushCommands();
+    scaledCanvases.resize(scales.size());
+
+    QVector<ScaledSave *> saves;
+    for (int i = 0; i < scales.size(); ++i) {
+        double scale = scales[i];
+        scaledCanvases[i].reset(qMax(1, qCeil(canvas.width() * scale)),
+                                qMax(1, qCeil(canvas.height() * scale)));
+        /* Frames for the stream are written here, in order. */
+        QString fileName;
+        if (!stream)
+            fileName = scaledName(name, scale) + "."
+                    + cg::TiledCanvas::suffixOf(format);
+        saves.append(new ScaledSave(store, scaledCanvases[i], scale,
+                                    format, fileName));
+    }
+    /* The calling thread draws the first scale, and draws them all if
+     * it is the only thread. */
+    bool parallel = maxThreadCount > 1;
+    for (int i = 1; parallel && i < saves.size(); ++i)
+        savePool.start(saves[i]);
+    for (int i = 0; i < (parallel ? 1 : saves.size()); ++i)
+        saves[i]->save();
+    savePool.waitForDone();
+
+    for (int i = 0; i < saves.size(); ++i) {
+        ScaledSave *save = saves[i];
+        if (stream)
+            writeCanvas(scaledCanvases[i], scaledName(name, scales[i]));
+        else if (save->isSaved())
+            savedFiles.append(save->getFileName());
+        else
+            cerr << "Fail to save canvas: " << qPrintable(save->getFileName()) << endl;
+        delete save;
+    }
+}
+
+QString PainterCLI::scaledName(const QString &name, double scale)
+{
+    return name + "@" + QString::number(scale) + "x";
+}
+
+/* Writes name with the suffix of the format, or the next frame of the
+ * stream. Rows are written in canvas order, which mirrors the picture
+ * vertically as the scripts expect. */
+bool PainterCLI::writeCanvas(const cg::TiledCanvas &canvas, const QString &name)
+{
+    if (!canvas.fitsIn(format)) {
+        cerr << "Save error: canvas " << qPrintable(name) << " is too large for "
+             << qPrintable(cg::TiledCanvas::suffixOf(format)) << endl;
+        return false;
+    }
+    if (stream) {
+        /* Flushed so that a reader gets each frame as it is saved. */
+        if (canvas.write(stream, format, true) && stream->flush())
+            return true;
+        cerr << "Fail to write frame: " << qPrintable(name) << endl;
+        return false;
+    }
+
+    QString fileName = name + "." + cg::TiledCanvas::suffixOf(format);
+    if (!canvas.save(fileName, format, true)) {
+        cerr << "Fail to save canvas: " << qPrintable(fileName) << endl;
+        return false;
+    }
+    savedFiles.append(fileName);
+    return true;
+}
+
+void PainterCLI::saveScene(const QString &name)
+{
+    TRACE_SCOPE("saveScene");
+    flushCommands();
+    if (cg::SceneFile::save(name + ".pscene", store, canvas.size()))
+        savedFiles.append(name + ".pscene");
+    else
+        cerr << "Fail to save scene: " << qPrintable(name) << ".pscene" << endl;
+}
+
+/* Mirrored like the bitmaps, so that both show the same picture. An SVG
+ * is always a file, even when canvases are streamed. */
+void PainterCLI::saveSvg(const QString &fileName)
+{
+    TRACE_SCOPE("saveSvg");
+    flushCommands();
+    if (cg::SvgExporter::save(fileName, store, canvas.size(), true))
+        savedFiles.append(fileName);
+    else
+        cerr << "Fail to save canvas: " << qPrintable(fileName) << endl;
 }
 
 void PainterCLI::setColor(const QColor &color)
@@ -235,80 +698,76 @@ void PainterCLI::setColor(const QColor &color)
     curColor = color;
 }
 
-void PainterCLI::drawLine(int id, const QPoint &p1, const QPoint &p2,
+void PainterCLI::drawLine(int id, const QPointF &p1, const QPointF &p2,
                           const QString &alg)
 {
-    cg::Line *line = new cg::Line(p1, p2, curColor, alg);
-    shapeManager.insert(id, line);
+    executor.drawLine(id, p1, p2, curColor, alg);
 }
 
-void PainterCLI::drawPolygon(int id, const QVector<QPoint> &points,
+void PainterCLI::drawPolygon(int id, const QVector<QPointF> &points,
                              const QString &alg)
 {
-    cg::Polygon *polygon = new cg::Polygon(points, curColor, alg);
-    shapeManager.insert(id, polygon);
+    executor.drawPolygon(id, points, curColor, alg);
 }
 
-void PainterCLI::drawEllipse(int id, const QPoint &center, int rx, int ry)
+void PainterCLI::drawEllipse(int id, const QPointF &center, double rx, double ry)
 {
-    cg::Ellipse *ellipse = new cg::Ellipse(center, rx, ry, curColor, "");
-    shapeManager.insert(id, ellipse);
+    executor.drawEllipse(id, center, rx, ry, curColor);
 }
 
-void PainterCLI::drawCurve(int id, const QVector<QPoint> &points,
+void PainterCLI::drawCurve(int id, const QVector<QPointF> &points,
                            const QString &alg)
 {
-    cg::Curve *curve = new cg::Curve(points, curColor, alg);
-    shapeManager.insert(id, curve);
+    executor.drawCurve(id, points, curColor, alg);
 }
 
-void PainterCLI::translate(int id, const QPoint &d)
+void PainterCLI::translate(int id, const QPointF &d)
 {
-    cg::Shape *shape = shapeManager.value(id, nullptr);
-    if (!shape) {
-        cerr << "Cannot find shape by id: " << id << endl;
-        return;
-    }
-    shape->translate(d);
+    executor.translate(id, d);
 }
 
-void PainterCLI::rotate(int id, const QPoint &c, double r)
+void PainterCLI::rotate(int id, const QPointF &c, double r)
 {
-    cg::Shape *shape = shapeManager.value(id, nullptr);
-    if (!shape) {
-        cerr << "Cannot find shape by id: " << id << endl;
-        return;
-    }
     /* r is a clockwise degree while rotate accepts
      * anticlockwise radians. */
-    shape->rotate(c, -qDegreesToRadians(r));
+    executor.rotate(id, c, -qDegreesToRadians(r));
 }
 
-void PainterCLI::scale(int id, const QPoint &c, double s)
+void PainterCLI::scale(int id, const QPointF &c, double s)
 {
-    cg::Shape *shape = shapeManager.value(id, nullptr);
-    if (!shape) {
-        cerr << "Cannot find shape by id: " << id << endl;
-        return;
-    }
-    shape->scale(c, s);
+    executor.scale(id, c, s);
 }
 
-void PainterCLI::clip(int id, const QPoint &p1, const QPoint &p2,
+void PainterCLI::clip(int id, const QPointF &p1, const QPointF &p2,
                       const QString &alg)
 {
-    cg::Shape *shape = shapeManager.take(id);
-    if (!shape) {
-        cerr << "Cannot find shape by id: " << id << endl;
-        return;
-    }
-    cg::Line *line = dynamic_cast<cg::Line *>(shape);
-    if (!line) {
-        cerr << "The shape with id " << id << " is not a Line" << endl;
-        return;
+    executor.clip(id, p1, p2, alg);
+}
+
+void PainterCLI::clipAll(const QPointF &p1, const QPointF &p2,
+                         const QString &alg)
+{
+    TRACE_SCOPE("clipAll");
+    flushCommands();
+    QVector<int> ids = shapeManager.keys().toVector();
+    QVector<cg::Shape *> shapes = shapeManager.values().toVector();
+    QVector<cg::Shape *> clippedShapes = cg::BatchClipper(p1, p2).clip(shapes, alg);
+
+    /* QMap::values() is ordered by key, so walk the map alongside. */
+    int i = 0;
+    auto iter = shapeManager.begin();
+    while (iter != shapeManager.end()) {
+        cg::Shape *shape = shapes[i], *clippedShape = clippedShapes[i];
+        ++i;
+        if (clippedShape != shape)
+            delete shape;
+        if (clippedShape) {
+            iter.value() = clippedShape;
+            ++iter;
+        }
+        else {
+            iter = shapeManager.erase(iter);
+        }
     }
-    cg::Shape *clippedShape = line->clip(p1, p2, alg);
-    if (clippedShape)
-        shapeManager.insert(id, clippedShape);
-    delete line;
+    updateStore(ids);
 }
@@ -2,13 +2,22 @@
 #define PAINTERCLI_H
 
 #include "shape.h"
+#include "scriptexecutor.h"
+#include "shapestore.h"
+#include "tiledcanvas.h"
 
 #include <QString>
-#include <QImage>
+#include <QDir>
+#include <QFile>
 #include <QColor>
-#include <QPoint>
+#include <QPointF>
 #include <QVector>
 #include <QMap>
+#include <QStringList>
+#include <QThread>
+#include <QThreadPool>
+
+#include <iosfwd>
 
 class PainterCLI
 {
@@ -18,29 +27,72 @@ public:
 
     int exec(int argc, char *argv[]);
 
+    /* Runs a script or renders a scene document into outDir. */
+    int run(const QString &fileName, const QDir &outDir);
+    /* Runs a script read from script. The canvas and the store keep
+     * their memory from one run to the next. */
+    int run(QIODevice *script, const QDir &outDir);
+    /* The files written by run(), in order. */
+    QStringList getSavedFiles() const { return savedFiles; }
+    void setFormat(cg::TiledCanvas::ImageFormat format) { this->format = format; }
+    /* Limits the threads a run uses, the calling thread included. By
+     * default it uses every core. */
+    void setMaxThreadCount(int count);
+
+    /* Reads the name of a format as --format takes it: bmp, ppm, raw or
+     * qoi. */
+    static bool parseFormat(const QString &name,
+                            cg::TiledCanvas::ImageFormat &format);
+
 private:
+    int runScript(QIODevice *inFile, const QDir &outDir);
+    int renderScene(const QString &fileName, const QDir &outDir);
+
+    void printMemoryReport(std::ostream &out);
+
+    void flushCommands();
+    void updateStore(const QVector<int> &ids);
     void drawShapes();
     void clearShapes();
 
     void resetCanvas(int width, int height);
     void saveCanvas(const QString &name);
+    void saveCanvas(const QString &name, const QVector<double> &scales);
+    void saveScene(const QString &name);
+    void saveSvg(const QString &fileName);
+    bool writeCanvas(const cg::TiledCanvas &canvas, const QString &name);
+    static QString scaledName(const QString &name, double scale);
     void setColor(const QColor &curColor);
-    void drawLine(int id, const QPoint &p1, const QPoint &p2,
+    void drawLine(int id, const QPointF &p1, const QPointF &p2,
                   const QString &alg);
-    void drawPolygon(int id, const QVector<QPoint> &points,
+    void drawPolygon(int id, const QVector<QPointF> &points,
                      const QString &alg);
-    void drawEllipse(int id, const QPoint &center, int rx, int ry);
-    void drawCurve(int id, const QVector<QPoint> &points,
+    void drawEllipse(int id, const QPointF &center, double rx, double ry);
+    void drawCurve(int id, const QVector<QPointF> &points,
                    const QString &alg);
-    void translate(int id, const QPoint &d);
-    void rotate(int id, const QPoint &c, double r);
-    void scale(int id, const QPoint &c, double s);
-    void clip(int id, const QPoint &p1, const QPoint &p2,
+    void translate(int id, const QPointF &d);
+    void rotate(int id, const QPointF &c, double r);
+    void scale(int id, const QPointF &c, double s);
+    void clip(int id, const QPointF &p1, const QPointF &p2,
               const QString &alg);
+    void clipAll(const QPointF &p1, const QPointF &p2, const QString &alg);
 
     QColor curColor;
-    QImage canvas;
+    cg::TiledCanvas canvas;
     QMap<int, cg::Shape *> shapeManager;
+    /* Runs the commands on single shapes; flushed before shapeManager
+     * is read as a whole. */
+    ScriptExecutor executor{shapeManager};
+    cg::ShapeStore store;   /* follows shapeManager, see updateStore() */
+    QMap<int, int> handles; /* the store handle of each id */
+    QStringList savedFiles;
+
+    QVector<cg::TiledCanvas> scaledCanvases;   /* one per scale saved */
+    QThreadPool savePool;   /* besides the calling thread */
+    int maxThreadCount = QThread::idealThreadCount();
+
+    cg::TiledCanvas::ImageFormat format = cg::TiledCanvas::BMP;
+    QFile *stream = nullptr;    /* saved canvases go here rather than to files */
 };
 
 #endif // PAINTERCLI_H
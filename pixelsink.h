@@ -0,0 +1,162 @@
+#ifndef PIXELSINK_H
+#define PIXELSINK_H
+
+#include <QImage>
+#include <QRgb>
+
+#include <algorithm>
+
+namespace cg {
+
+/* Pixel sinks are the targets of the rasterization kernels. A sink
+ * provides plot(x, y), the inclusive spans hspan(x0, x1, y) and
+ * vspan(x, y0, y1) with x0 <= x1 and y0 <= y1, and diagonal(x, y, n, yStep)
+ * drawing the n pixels (x + k, y + k * yStep) with yStep = 1 or -1. All of
+ * them clip against the sink's bounds. Kernels are templates over the sink, so the calls are
+ * inlined into their inner loops. */
+
+/* Color formats with 32 bits per pixel. */
+struct Rgb32Format
+{
+    typedef quint32 Pixel;
+    static Pixel pack(QRgb rgb) { return 0xff000000u | rgb; }
+};
+
+/* Writes straight into the scanlines of a QImage. */
+template <typename Format>
+class ImageSink
+{
+public:
+    typedef typename Format::Pixel Pixel;
+
+    ImageSink(QImage &canvas, QRgb rgb)
+        : bits(reinterpret_cast<Pixel *>(canvas.bits())),
+          stride(canvas.bytesPerLine() / static_cast<int>(sizeof(Pixel))),
+          width(canvas.width()), height(canvas.height()),
+          pixel(Format::pack(rgb))
+    {
+
+    }
+
+    void plot(int x, int y)
+    {
+        if (static_cast<unsigned>(x) < static_cast<unsigned>(width)
+                && static_cast<unsigned>(y) < static_cast<unsigned>(height))
+            bits[y * stride + x] = pixel;
+    }
+
+    void hspan(int x0, int x1, int y)
+    {
+        if (static_cast<unsigned>(y) >= static_cast<unsigned>(height))
+            return;
+        x0 = qMax(x0, 0);
+        x1 = qMin(x1, width - 1);
+        if (x0 <= x1) {
+            Pixel *row = bits + y * stride;
+            std::fill(row + x0, row + x1 + 1, pixel);
+        }
+    }
+
+    void vspan(int x, int y0, int y1)
+    {
+        if (static_cast<unsigned>(x) >= static_cast<unsigned>(width))
+            return;
+        y0 = qMax(y0, 0);
+        y1 = qMin(y1, height - 1);
+        Pixel *p = bits + y0 * stride + x;
+        for (int y = y0; y <= y1; ++y, p += stride)
+            *p = pixel;
+    }
+
+    void diagonal(int x, int y, int n, int yStep)
+    {
+        /* Restrict k to the pixels inside the image. */
+        int kBegin = qMax(0, -x);
+        int kEnd = qMin(n, width - x);
+        if (yStep > 0) {
+            kBegin = qMax(kBegin, -y);
+            kEnd = qMin(kEnd, height - y);
+        }
+        else {
+            kBegin = qMax(kBegin, y - height + 1);
+            kEnd = qMin(kEnd, y + 1);
+        }
+        if (kBegin >= kEnd)
+            return;
+
+        const int step = yStep > 0 ? stride + 1 : 1 - stride;
+        Pixel *p = bits + (y + kBegin * yStep) * stride + x + kBegin;
+        for (int k = kBegin; k < kEnd; ++k, p += step)
+            *p = pixel;
+    }
+
+private:
+    Pixel *bits;
+    int stride;
+    int width, height;
+    Pixel pixel;
+};
+
+/* Falls back to QImage::setPixel for formats without a specialized sink. */
+class GenericImageSink
+{
+public:
+    GenericImageSink(QImage &canvas, QRgb rgb)
+        : canvas(canvas), rgb(rgb)
+    {
+
+    }
+
+    void plot(int x, int y)
+    {
+        if (canvas.valid(x, y))
+            canvas.setPixel(x, y, rgb);
+    }
+
+    void hspan(int x0, int x1, int y)
+    {
+        for (int x = x0; x <= x1; ++x)
+            plot(x, y);
+    }
+
+    void vspan(int x, int y0, int y1)
+    {
+        for (int y = y0; y <= y1; ++y)
+            plot(x, y);
+    }
+
+    void diagonal(int x, int y, int n, int yStep)
+    {
+        for (int k = 0; k < n; ++k)
+            plot(x + k, y + k * yStep);
+    }
+
+private:
+    QImage &canvas;
+    QRgb rgb;
+};
+
+/* Runs a kernel with the fastest sink available for the canvas format.
+ * The kernel is a functor taking the sink by reference. */
+template <typename Kernel>
+void withPixelSink(QImage &canvas, QRgb rgb, Kernel kernel)
+{
+    switch (canvas.format()) {
+    case QImage::Format_RGB32:
+    case QImage::Format_ARGB32:
+    case QImage::Format_ARGB32_Premultiplied: {
+        ImageSink<Rgb32Format> sink(canvas, rgb);
+        kernel(sink);
+        break;
+    }
+    default: {
+        GenericImageSink sink(canvas, rgb);
+        kernel(sink);
+        break;
+    }
+    }
+}
+
+}
+
+#endif // PIXELSINK_H
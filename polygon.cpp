@@ -1,120 +1,175 @@
 #include "polygon.h"
+#include "fixedpoint.h"
 #include "utils.h"
 #include "line.h"
+#include "shapestore.h"
+#include "tiledcanvas.h"
 
 #include <QImage>
 #include <QtDebug>
+
 namespace cg {
 
-Polygon::Polygon(const QVector<QPoint> &points,
+Polygon::Polygon(const QVector<QPointF> &points,
                  const QColor &color, const QString &algorithm)
-    : vp(points), c(color), alg(algorithm)
+    : Shape(color, algorithm), vp(fixed::fromReal(points))
 {
     Q_ASSERT(vp.size() >= 3);
 }
 
-void Polygon::beginTransaction()
+void Polygon::swapState(Shape &other)
 {
-    oldvp = vp;
-    Shape::beginTransaction();
+    Polygon &o = static_cast<Polygon &>(other);
+    qSwap(vp, o.vp);
+    Shape::swapState(other);
 }
 
-void Polygon::commitTransaction()
+void Polygon::appendTo(ShapeStore &store)
 {
-    Shape::commitTransaction();
+    store.addPolygon(vp, rgb, alg);
 }
 
-void Polygon::rollbackTransaction()
+void Polygon::draw(QImage &canvas)
 {
-    vp = oldvp;
-    Shape::rollbackTransaction();
+    rasterizeFixed(canvas, vp.constData(), vp.size(), rgb, alg);
 }
 
-void Polygon::draw(QImage &canvas)
+template <typename Canvas>
+void Polygon::rasterizeFixed(Canvas &canvas, const QPoint *points, int n,
+                             QRgb rgb, Algorithm alg)
 {
-    if (alg == "DDA")
-        drawByDDA(canvas);
-    else if (alg == "Bresenham")
-        drawByBresenham(canvas);
-    else
-        drawByDefault(canvas);
+    Q_ASSERT(n >= 3);
+
+    for (int i = 0; i < n - 1; ++i)
+        Line::rasterizeFixed(canvas, points[i], points[i + 1], rgb, alg);
+    Line::rasterizeFixed(canvas, points[n - 1], points[0], rgb, alg);
 }
 
-void Polygon::drawByDefault(QImage &canvas)
+void Polygon::translate(const QPointF &d)
 {
-    drawByBresenham(canvas);
+    const Polygon &old = backup ? static_cast<const Polygon &>(*backup) : *this;
+    Q_ASSERT(vp.size() == old.vp.size());
+    QPoint offset = fixed::fromReal(d);
+    for (int i = 0; i < vp.size(); ++i)
+        vp[i] = old.vp[i] + offset;
 }
 
-void Polygon::drawByDDA(QImage &canvas)
+void Polygon::scale(const QPointF &c, double s)
 {
-    Q_ASSERT(vp.size() >= 3);
+    const Polygon &old = backup ? static_cast<const Polygon &>(*backup) : *this;
+    Q_ASSERT(vp.size() == old.vp.size());
+    for (int i = 0; i < vp.size(); ++i)
+        vp[i] = fixed::fromReal(utils::scalePoint(fixed::toReal(old.vp[i]), c, s));
+}
 
-    for (int i = 0; i < vp.size() - 1; ++i)
-        cg::Line(vp[i], vp[i+1], c, "DDA").draw(canvas);
-    cg::Line(vp.back(), vp.front(), c, "DDA").draw(canvas);
+void Polygon::rotate(const QPointF &c, double r)
+{
+    const Polygon &old = backup ? static_cast<const Polygon &>(*backup) : *this;
+    Q_ASSERT(vp.size() == old.vp.size());
+    for (int i = 0; i < vp.size(); ++i)
+        vp[i] = fixed::fromReal(utils::rotatePoint(fixed::toReal(old.vp[i]), c, r));
 }
 
-void Polygon::drawByBresenham(QImage &canvas)
+cg::Shape *Polygon::clip(const QPointF &p1, const QPointF &p2,
+                         const QString & /* alg */)
 {
-    Q_ASSERT(vp.size() >= 3);
+    QRectF window = QRectF(p1, p2).normalized();
+    QVector<QPointF> points = fixed::toReal(vp);
+    QRectF hull = utils::boundingRect(points.constData(), points.size());
+
+    if (utils::contains(window, hull))
+        return new Polygon(points, QColor(rgb), algorithmName(alg));
+    if (!utils::intersects(window, hull))
+        return nullptr;
+
+    QVector<QPointF> clipped = clipBySutherlandHodgman(points, window);
+    if (clipped.size() < 3)
+        return nullptr;
+    return new Polygon(clipped, QColor(rgb), algorithmName(alg));
+}
 
-    for (int i = 0; i < vp.size() - 1; ++i)
-        cg::Line(vp[i], vp[i+1], c, "Bresenham").draw(canvas);
-    cg::Line(vp.back(), vp.front(), c, "Bresenham").draw(canvas);
+QVector<QPointF> Polygon::clipBySutherlandHodgman(const QVector<QPointF> &points,
+                                                  const QRectF &window)
+{
+    QVector<QPointF> result = points;
+    result = clipAgainstEdge(result, LEFT_EDGE, window.left());
+    result = clipAgainstEdge(result, RIGHT_EDGE, window.right());
+    result = clipAgainstEdge(result, TOP_EDGE, window.top());
+    result = clipAgainstEdge(result, BOTTOM_EDGE, window.bottom());
+
+    /* Vertices on the window's edges come out twice. */
+    QVector<QPointF> deduped;
+    for (auto &p : result)
+        if (deduped.isEmpty() || deduped.back() != p)
+            deduped.append(p);
+    while (deduped.size() > 1 && deduped.front() == deduped.back())
+        deduped.removeLast();
+    return deduped;
 }
 
-void Polygon::translate(const QPoint &d)
+QVector<QPointF> Polygon::clipAgainstEdge(const QVector<QPointF> &points,
+                                          int edge, double boundary)
 {
-    if (duringTransaction) {
-        Q_ASSERT(vp.size() == oldvp.size());
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = oldvp[i] + d;
-    }
-    else {
-        for (auto &p : vp)
-            p += d;
+    QVector<QPointF> output;
+    if (points.isEmpty())
+        return output;
+
+    QPointF prev = points.back();
+    bool prevInside = isInside(prev, edge, boundary);
+    for (auto &cur : points) {
+        bool curInside = isInside(cur, edge, boundary);
+        if (curInside) {
+            if (!prevInside)
+                output.append(intersect(prev, cur, edge, boundary));
+            output.append(cur);
+        }
+        else if (prevInside) {
+            output.append(intersect(prev, cur, edge, boundary));
+        }
+        prev = cur;
+        prevInside = curInside;
     }
+    return output;
 }
 
-void Polygon::scale(const QPoint &c, double s)
+bool Polygon::isInside(const QPointF &p, int edge, double boundary)
 {
-    if (duringTransaction) {
-        Q_ASSERT(vp.size() == oldvp.size());
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::scalePoint(oldvp[i], c, s);
-    }
-    else {
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::scalePoint(vp[i], c, s);
+    switch (edge) {
+    case LEFT_EDGE:     return p.x() >= boundary;
+    case RIGHT_EDGE:    return p.x() <= boundary;
+    case TOP_EDGE:      return p.y() >= boundary;
+    case BOTTOM_EDGE:   return p.y() <= boundary;
+    default:
+        Q_ASSERT(0); /* Should not reach here */
+        return false;
     }
 }
 
-void Polygon::rotate(const QPoint &c, double r)
+QPointF Polygon::intersect(const QPointF &a, const QPointF &b,
+                           int edge, double boundary)
 {
-    if (duringTransaction) {
-        Q_ASSERT(vp.size() == oldvp.size());
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::rotatePoint(oldvp[i], c, r);
+    if (edge == LEFT_EDGE || edge == RIGHT_EDGE) {
+        Q_ASSERT(a.x() != b.x());
+        double t = (boundary - a.x()) / (b.x() - a.x());
+        return QPointF(boundary, a.y() + t * (b.y() - a.y()));
     }
     else {
-        for (int i = 0; i < vp.size(); ++i)
-            vp[i] = utils::rotatePoint(vp[i], c, r);
+        Q_ASSERT(a.y() != b.y());
+        double t = (boundary - a.y()) / (b.y() - a.y());
+        return QPointF(a.x() + t * (b.x() - a.x()), boundary);
     }
 }
 
 QRect Polygon::getRectHull()
 {
     Q_ASSERT(vp.size() >= 3);
-    QPoint topLeft = vp[0];
-    QPoint bottomRight = vp[0];
-    for (int i = 1; i < vp.size(); ++i) {
-        const QPoint &p = vp[i];
-        topLeft.rx() = qMin(topLeft.x(), p.x());
-        topLeft.ry() = qMin(topLeft.y(), p.y());
-        bottomRight.rx() = qMax(bottomRight.x(), p.x());
-        bottomRight.ry() = qMax(bottomRight.y(), p.y());
-    }
-    return QRect(topLeft, bottomRight);
+    QVector<QPointF> points = fixed::toReal(vp);
+    return utils::pixelRect(utils::boundingRect(points.constData(), points.size()));
 }
 
+template void Polygon::rasterizeFixed(QImage &, const QPoint *, int,
+                                      QRgb, Algorithm);
+template void Polygon::rasterizeFixed(TiledCanvas &, const QPoint *, int,
+                                      QRgb, Algorithm);
+
 }
@@ -5,40 +5,50 @@
 
 #include <QVector>
 #include <QColor>
+#include <QRectF>
 
 namespace cg {
 
 class Polygon : public Shape
 {
 public:
-    Polygon(const QVector<QPoint> &points,
+    Polygon(const QVector<QPointF> &points,
             const QColor &color, const QString &algorithm);
     ~Polygon() = default;
 
     QString shapeName() { return "Polygon"; }
-
-    void beginTransaction();
-    void commitTransaction();
-    void rollbackTransaction();
+    Shape *clone() const { return new Polygon(*this); }
+    void swapState(Shape &other);
+    qint64 sizeInBytes() const
+    { return sizeof(Polygon) + vp.size() * sizeof(QPoint); }
+    void appendTo(ShapeStore &store);
 
     void draw(QImage &canvas);
-    void translate(const QPoint &d);
-    void scale(const QPoint &c, double s);
-    void rotate(const QPoint &c, double r);
+    void translate(const QPointF &d);
+    void scale(const QPointF &c, double s);
+    void rotate(const QPointF &c, double r);
+    cg::Shape *clip(const QPointF &p1, const QPointF &p2, const QString &alg);
 
     QRect getRectHull();
 
-private:
-    void drawByDefault(QImage &canvas);
-    void drawByDDA(QImage &canvas);
-    void drawByBresenham(QImage &canvas);
+    static QVector<QPointF> clipBySutherlandHodgman(const QVector<QPointF> &points,
+                                                    const QRectF &window);
 
-    QVector<QPoint> vp;
-    QColor c;
-    QString alg;
+    /* Draws the polygon of points in 24.8 fixed point. */
+    template <typename Canvas>
+    static void rasterizeFixed(Canvas &canvas, const QPoint *points, int n,
+                               QRgb rgb, Algorithm alg);
 
-    /* for transaction */
-    QVector<QPoint> oldvp;
+private:
+    // enum for clipAgainstEdge
+    enum { LEFT_EDGE, RIGHT_EDGE, TOP_EDGE, BOTTOM_EDGE };
+    static QVector<QPointF> clipAgainstEdge(const QVector<QPointF> &points,
+                                            int edge, double boundary);
+    static bool isInside(const QPointF &p, int edge, double boundary);
+    static QPointF intersect(const QPointF &a, const QPointF &b,
+                             int edge, double boundary);
+
+    QVector<QPoint> vp;     /* 24.8 fixed point */
 };
 
 }
@@ -0,0 +1,161 @@
+#include "polyline.h"
+#include "fixedpoint.h"
+#include "utils.h"
+#include "line.h"
+#include "shapestore.h"
+#include "tiledcanvas.h"
+
+#include <QImage>
+#include <QtDebug>
+
+namespace cg {
+
+Polyline::Polyline(const QVector<QVector<QPointF>> &runs,
+                   const QColor &color, const QString &algorithm)
+    : Shape(color, algorithm)
+{
+    Q_ASSERT(!runs.isEmpty());
+    this->runs.reserve(runs.size());
+    for (auto &run : runs)
+        this->runs.append(fixed::fromReal(run));
+}
+
+void Polyline::swapState(Shape &other)
+{
+    Polyline &o = static_cast<Polyline &>(other);
+    qSwap(runs, o.runs);
+    Shape::swapState(other);
+}
+
+qint64 Polyline::sizeInBytes() const
+{
+    qint64 size = sizeof(Polyline) + runs.size() * sizeof(QVector<QPoint>);
+    for (const QVector<QPoint> &run : runs)
+        size += run.size() * sizeof(QPoint);
+    return size;
+}
+
+void Polyline::appendTo(ShapeStore &store)
+{
+    store.addPolyline(runs, rgb, alg);
+}
+
+void Polyline::draw(QImage &canvas)
+{
+    for (auto &run : runs)
+        rasterizeFixed(canvas, run.constData(), run.size(), rgb, alg);
+}
+
+template <typename Canvas>
+void Polyline::rasterize(Canvas &canvas, const QPoint *points, int n,
+                         QRgb rgb, Algorithm alg)
+{
+    for (int i = 0; i < n - 1; ++i)
+        Line::rasterize(canvas, points[i], points[i + 1], rgb, alg);
+}
+
+template <typename Canvas>
+void Polyline::rasterizeFixed(Canvas &canvas, const QPoint *points, int n,
+                              QRgb rgb, Algorithm alg)
+{
+    for (int i = 0; i < n - 1; ++i)
+        Line::rasterizeFixed(canvas, points[i], points[i + 1], rgb, alg);
+}
+
+void Polyline::translate(const QPointF &d)
+{
+    const Polyline &old = backup ? static_cast<const Polyline &>(*backup) : *this;
+    Q_ASSERT(runs.size() == old.runs.size());
+    QPoint offset = fixed::fromReal(d);
+    for (int i = 0; i < runs.size(); ++i)
+        for (int j = 0; j < runs[i].size(); ++j)
+            runs[i][j] = old.runs[i][j] + offset;
+}
+
+void Polyline::scale(const QPointF &c, double s)
+{
+    const Polyline &old = backup ? static_cast<const Polyline &>(*backup) : *this;
+    Q_ASSERT(runs.size() == old.runs.size());
+    for (int i = 0; i < runs.size(); ++i)
+        for (int j = 0; j < runs[i].size(); ++j)
+            runs[i][j] = fixed::fromReal(
+                        utils::scalePoint(fixed::toReal(old.runs[i][j]), c, s));
+}
+
+void Polyline::rotate(const QPointF &c, double r)
+{
+    const Polyline &old = backup ? static_cast<const Polyline &>(*backup) : *this;
+    Q_ASSERT(runs.size() == old.runs.size());
+    for (int i = 0; i < runs.size(); ++i)
+        for (int j = 0; j < runs[i].size(); ++j)
+            runs[i][j] = fixed::fromReal(
+                        utils::rotatePoint(fixed::toReal(old.runs[i][j]), c, r));
+}
+
+cg::Shape *Polyline::clip(const QPointF &p1, const QPointF &p2,
+                          const QString & /* alg */)
+{
+    QRectF window = QRectF(p1, p2).normalized();
+    QRectF hull = getBounds();
+
+    if (!utils::intersects(window, hull))
+        return nullptr;
+    QVector<QVector<QPointF>> realRuns;
+    for (auto &run : runs)
+        realRuns.append(fixed::toReal(run));
+    if (utils::contains(window, hull))
+        return new Polyline(realRuns, QColor(rgb), algorithmName(alg));
+
+    /* Clip segment by segment, and join the clipped segments
+     * back into runs wherever they are still connected. */
+    QVector<QVector<QPointF>> clipped;
+    for (auto &run : realRuns) {
+        bool connected = false;
+        for (int i = 0; i < run.size() - 1; ++i) {
+            QPointF start = run[i], end = run[i + 1];
+            if (!Line::clipSegment(start, end, window.topLeft(),
+                                   window.bottomRight())) {
+                connected = false;
+                continue;
+            }
+            if (!connected || clipped.back().back() != start)
+                clipped.append(QVector<QPointF>{ start });
+            clipped.back().append(end);
+            connected = (end == run[i + 1]);
+        }
+    }
+
+    if (clipped.isEmpty())
+        return nullptr;
+    return new Polyline(clipped, QColor(rgb), algorithmName(alg));
+}
+
+QRect Polyline::getRectHull()
+{
+    return utils::pixelRect(getBounds());
+}
+
+QRectF Polyline::getBounds() const
+{
+    Q_ASSERT(!runs.isEmpty() && !runs.front().isEmpty());
+    QPoint topLeft = runs.front().front();
+    QPoint bottomRight = topLeft;
+    for (auto &run : runs) {
+        for (auto &p : run) {
+            topLeft.rx() = qMin(topLeft.x(), p.x());
+            topLeft.ry() = qMin(topLeft.y(), p.y());
+            bottomRight.rx() = qMax(bottomRight.x(), p.x());
+            bottomRight.ry() = qMax(bottomRight.y(), p.y());
+        }
+    }
+    return QRectF(fixed::toReal(topLeft), fixed::toReal(bottomRight));
+}
+
+template void Polyline::rasterize(QImage &, const QPoint *, int, QRgb, Algorithm);
+template void Polyline::rasterize(TiledCanvas &, const QPoint *, int, QRgb, Algorithm);
+template void Polyline::rasterizeFixed(QImage &, const QPoint *, int,
+                                       QRgb, Algorithm);
+template void Polyline::rasterizeFixed(TiledCanvas &, const QPoint *, int,
+                                       QRgb, Algorithm);
+
+}
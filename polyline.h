@@ -0,0 +1,52 @@
+#ifndef POLYLINE_H
+#define POLYLINE_H
+
+#include "shape.h"
+
+#include <QVector>
+#include <QColor>
+#include <QRectF>
+
+namespace cg {
+
+/* An open polyline made of one or more disconnected runs.
+ * It is mainly produced by clipping curves. */
+class Polyline : public Shape
+{
+public:
+    Polyline(const QVector<QVector<QPointF>> &runs,
+             const QColor &color, const QString &algorithm);
+    ~Polyline() = default;
+
+    QString shapeName() { return "Polyline"; }
+    Shape *clone() const { return new Polyline(*this); }
+    void swapState(Shape &other);
+    qint64 sizeInBytes() const;
+    void appendTo(ShapeStore &store);
+
+    void draw(QImage &canvas);
+    void translate(const QPointF &d);
+    void scale(const QPointF &c, double s);
+    void rotate(const QPointF &c, double r);
+    cg::Shape *clip(const QPointF &p1, const QPointF &p2, const QString &alg);
+
+    QRect getRectHull();
+
+    /* Draws a single run. */
+    template <typename Canvas>
+    static void rasterize(Canvas &canvas, const QPoint *points, int n,
+                          QRgb rgb, Algorithm alg);
+    /* The same for a run in 24.8 fixed point. */
+    template <typename Canvas>
+    static void rasterizeFixed(Canvas &canvas, const QPoint *points, int n,
+                               QRgb rgb, Algorithm alg);
+
+private:
+    QRectF getBounds() const;
+
+    QVector<QVector<QPoint>> runs;      /* 24.8 fixed point */
+};
+
+}
+
+#endif // POLYLINE_H
@@ -0,0 +1,368 @@
+#include "regressioncheck.h"
+#include "paintercli.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QtEndian>
+
+#include <algorithm>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+namespace {
+
+/* Timings this close to the baseline pass whatever the margin, since
+ * short scripts are below the resolution of the timer. */
+const double TIMER_SLACK = 1.0;     /* milliseconds */
+
+}
+
+RegressionCheck::RegressionCheck()
+    : runs(DEFAULT_RUNS), margin(DEFAULT_MARGIN), record(false)
+{
+
+}
+
+int RegressionCheck::exec(const QStringList &args)
+{
+    QStringList paths;
+    for (int i = 0; i < args.size(); ++i) {
+        if (args[i] == "--record") {
+            record = true;
+        }
+        else if (args[i] == "--margin" && i + 1 < args.size()) {
+            bool ok;
+            margin = args[++i].toDouble(&ok);
+            if (!ok || margin < 0) {
+                cerr << "Check error: invalid margin: " << qPrintable(args[i]) << endl;
+                return 1;
+            }
+        }
+        else if (args[i] == "--runs" && i + 1 < args.size()) {
+            bool ok;
+            runs = args[++i].toInt(&ok);
+            if (!ok || runs < 1) {
+                cerr << "Check error: invalid number of runs: " << qPrintable(args[i]) << endl;
+                return 1;
+            }
+        }
+        else {
+            paths.append(args[i]);
+        }
+    }
+    if (paths.size() != 2) {
+        cerr << "Check error: a manifest and an output directory expected." << endl;
+        return 1;
+    }
+
+    manifest = paths[0];
+    QDir outDir(paths[1]), dir;
+    if (!outDir.exists() && !dir.mkdir(paths[1])) {
+        cerr << "Fail to create output directory: " << qPrintable(paths[1]) << endl;
+        return 1;
+    }
+    if (!readManifest())
+        return 1;
+
+    int failures = 0;
+    for (auto &entry : entries) {
+        if (!check(entry, outDir))
+            ++failures;
+    }
+
+    if (record) {
+        if (failures > 0 || !writeManifest()) {
+            cerr << "Fail to record manifest: " << qPrintable(manifest) << endl;
+            return 1;
+        }
+        return 0;
+    }
+    cout << entries.size() - failures << " passed, " << failures << " failed" << endl;
+    return failures > 0 ? 1 : 0;
+}
+
+bool RegressionCheck::readManifest()
+{
+    QFile file(manifest);
+    if (!file.open(QIODevice::ReadOnly)) {
+        cerr << "Cannot open manifest: " << qPrintable(file.errorString()) << endl;
+        return false;
+    }
+
+    QTextStream in(&file);
+    int lineNumber = 0;
+    while (!in.atEnd()) {
+        QString line = in.readLine();
+        ++lineNumber;
+        if (line.isEmpty() || line.startsWith('#'))
+            continue;
+
+        QStringList fields = line.split(' ');
+        if ((fields.size() == 3 || fields.size() == 4) && fields[0] == "script") {
+            Entry entry;
+            bool ok;
+            entry.script = fields[1];
+            entry.baseline = fields[2].toDouble(&ok);
+            if (fields.size() == 4) {
+                cg::TiledCanvas::ImageFormat format;
+                entry.format = fields[3];
+                ok = ok && PainterCLI::parseFormat(entry.format, format);
+            }
+            if (ok) {
+                entries.append(entry);
+                continue;
+            }
+        }
+        else if (fields.size() == 2 && !entries.isEmpty()) {
+            Output output = { fields[0], fields[1] };
+            entries.back().outputs.append(output);
+            continue;
+        }
+        cerr << "Manifest error at line " << lineNumber << ": "
+             << qPrintable(line) << endl;
+        return false;
+    }
+    return true;
+}
+
+bool RegressionCheck::writeManifest() const
+{
+    QSaveFile file(manifest);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QTextStream out(&file);
+    out << "# Regression corpus, checked by PainterCheck <manifest> <outDir>.\n"
+        << "# script <path> <baseline milliseconds>, then <output> <hash> per saved file.\n";
+    for (auto &entry : entries) {
+        out << "\nscript " << entry.script << ' '
+            << QString::number(entry.baseline, 'f', 2);
+        if (!entry.format.isEmpty())
+            out << ' ' << entry.format;
+        out << '\n';
+        for (auto &output : entry.outputs)
+            out << output.name << ' ' << output.hash << '\n';
+    }
+    out.flush();
+    return file.commit();
+}
+
+bool RegressionCheck::check(Entry &entry, const QDir &outDir)
+{
+    QString script = QFileInfo(manifest).dir().filePath(entry.script);
+    /* Keep the outputs of each script apart for inspection. */
+    QString name = QFileInfo(script).completeBaseName();
+    if (!outDir.mkpath(name)) {
+        cerr << "Fail to create output directory: "
+             << qPrintable(outDir.filePath(name)) << endl;
+        return false;
+    }
+    QDir dir(outDir.filePath(name));
+    cg::TiledCanvas::ImageFormat format = cg::TiledCanvas::BMP;
+    if (!entry.format.isEmpty())
+        PainterCLI::parseFormat(entry.format, format);
+
+    /* The best of several runs is the least disturbed by other load. */
+    double best = 0.0;
+    QStringList savedFiles;
+    for (int i = 0; i < runs; ++i) {
+        PainterCLI cli;
+        cli.setFormat(format);
+        QElapsedTimer timer;
+        timer.start();
+        int status = cli.run(script, dir);
+        double elapsed = timer.nsecsElapsed() / 1e6;
+        if (status != 0) {
+            cout << "FAIL " << qPrintable(entry.script)
+                 << ": the script stopped with an error" << endl;
+            return false;
+        }
+        if (i == 0 || elapsed < best)
+            best = elapsed;
+        savedFiles = cli.getSavedFiles();
+    }
+
+    if (format == cg::TiledCanvas::QOI
+            && !checkRoundTrip(entry, script, dir, savedFiles))
+        return false;
+
+    QVector<Output> outputs;
+    for (auto &file : savedFiles) {
+        Output output = { QFileInfo(file).fileName(), hashFile(file) };
+        outputs.append(output);
+    }
+
+    if (record) {
+        entry.outputs = outputs;
+        entry.baseline = best;
+        cout << "RECORD " << qPrintable(entry.script) << ' '
+             << outputs.size() << " files " << best << " ms" << endl;
+        return true;
+    }
+
+    bool passed = true;
+    int n = qMax(outputs.size(), entry.outputs.size());
+    for (int i = 0; i < n; ++i) {
+        if (i >= outputs.size()) {
+            cout << "FAIL " << qPrintable(entry.script) << ": "
+                 << qPrintable(entry.outputs[i].name) << " was not saved" << endl;
+            passed = false;
+        }
+        else if (i >= entry.outputs.size()) {
+            cout << "FAIL " << qPrintable(entry.script) << ": "
+                 << qPrintable(outputs[i].name) << " is not in the manifest" << endl;
+            passed = false;
+        }
+        else if (outputs[i].name != entry.outputs[i].name) {
+            cout << "FAIL " << qPrintable(entry.script) << ": "
+                 << qPrintable(outputs[i].name) << " saved instead of "
+                 << qPrintable(entry.outputs[i].name) << endl;
+            passed = false;
+        }
+        else if (outputs[i].hash != entry.outputs[i].hash) {
+            cout << "FAIL " << qPrintable(entry.script) << ": "
+                 << qPrintable(outputs[i].name) << " differs from its golden hash" << endl;
+            passed = false;
+        }
+    }
+
+    double limit = entry.baseline * (1 + margin / 100) + TIMER_SLACK;
+    if (best > limit) {
+        cout << "FAIL " << qPrintable(entry.script) << ": " << best
+             << " ms, baseline " << entry.baseline << " ms" << endl;
+        passed = false;
+    }
+
+    if (passed) {
+        cout << "PASS " << qPrintable(entry.script) << ": " << best
+             << " ms, baseline " << entry.baseline << " ms" << endl;
+    }
+    return passed;
+}
+
+/* 64-bit FNV-1a of the file's bytes, in hex. */
+QString RegressionCheck::hashFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return QString("unreadable");
+
+    quint64 hash = Q_UINT64_C(14695981039346656037);
+    char buffer[64 * 1024];
+    qint64 n;
+    while ((n = file.read(buffer, sizeof(buffer))) > 0) {
+        for (qint64 i = 0; i < n; ++i) {
+            hash ^= static_cast<uchar>(buffer[i]);
+            hash *= Q_UINT64_C(1099511628211);
+        }
+    }
+
+    char hex[17];
+    for (int i = 15; i >= 0; --i) {
+        hex[i] = "0123456789abcdef"[hash & 0xf];
+        hash >>= 4;
+    }
+    hex[16] = '\0';
+    return QString(hex);
+}
+
+/* Runs the script once more saving raw RGB, and compares that with
+ * what each of its QOI files decodes to. */
+bool RegressionCheck::checkRoundTrip(const Entry &entry, const QString &script,
+                                     const QDir &dir, const QStringList &savedFiles)
+{
+    PainterCLI cli;
+    cli.setFormat(cg::TiledCanvas::RAW);
+    if (cli.run(script, dir) != 0 || cli.getSavedFiles().size() != savedFiles.size()) {
+        cout << "FAIL " << qPrintable(entry.script)
+             << ": the script saves other canvases as raw" << endl;
+        return false;
+    }
+    QStringList rawFiles = cli.getSavedFiles();
+
+    bool passed = true;
+    for (int i = 0; i < savedFiles.size(); ++i) {
+        QFile qoiFile(savedFiles[i]), rawFile(rawFiles[i]);
+        QByteArray pixels;
+        if (!qoiFile.open(QIODevice::ReadOnly) || !rawFile.open(QIODevice::ReadOnly)
+                || !decodeQoi(qoiFile.readAll(), pixels)
+                || pixels != rawFile.readAll()) {
+            cout << "FAIL " << qPrintable(entry.script) << ": "
+                 << qPrintable(QFileInfo(savedFiles[i]).fileName())
+                 << " does not decode to the saved canvas" << endl;
+            passed = false;
+        }
+    }
+    return passed;
+}
+
+/* Decodes a QOI image into RGB bytes, top line first. See
+ * https://qoiformat.org/qoi-specification.pdf. */
+bool RegressionCheck::decodeQoi(const QByteArray &data, QByteArray &pixels)
+{
+    const int headerSize = 14, endMarkerSize = 8;
+    if (data.size() < headerSize + endMarkerSize || !data.startsWith("qoif"))
+        return false;
+    const uchar *p = reinterpret_cast<const uchar *>(data.constData());
+    const uchar *end = p + data.size() - endMarkerSize;
+    qint64 n = static_cast<qint64>(qFromBigEndian<quint32>(p + 4))
+            * qFromBigEndian<quint32>(p + 8);
+    if (n > static_cast<qint64>(data.size()) * 62)   /* more than runs can hold */
+        return false;
+    p += headerSize;
+
+    QRgb index[64] = { 0 };
+    QRgb pixel = qRgba(0, 0, 0, 255);
+    int run = 0;
+    pixels.resize(static_cast<int>(n * 3));
+    uchar *dst = reinterpret_cast<uchar *>(pixels.data());
+    for (qint64 i = 0; i < n; ++i) {
+        if (run > 0) {
+            --run;
+        }
+        else {
+            if (p == end)
+                return false;
+            int op = *p++;
+            int r = qRed(pixel), g = qGreen(pixel), b = qBlue(pixel);
+            if (op == 0xfe || op == 0xff) {
+                int size = op == 0xfe ? 3 : 4;
+                if (end - p < size)
+                    return false;
+                pixel = qRgba(p[0], p[1], p[2], size == 4 ? p[3] : qAlpha(pixel));
+                p += size;
+            }
+            else if (op >> 6 == 0) {
+                pixel = index[op];
+            }
+            else if (op >> 6 == 1) {
+                pixel = qRgba(r + (op >> 4 & 3) - 2, g + (op >> 2 & 3) - 2,
+                              b + (op & 3) - 2, qAlpha(pixel));
+            }
+            else if (op >> 6 == 2) {
+                if (p == end)
+                    return false;
+                int dg = (op & 0x3f) - 32;
+                int drg = (*p >> 4) - 8, dbg = (*p & 0xf) - 8;
+                ++p;
+                pixel = qRgba(r + dg + drg, g + dg, b + dg + dbg, qAlpha(pixel));
+            }
+            else {
+                run = op & 0x3f;
+            }
+            int slot = (qRed(pixel) * 3 + qGreen(pixel) * 5 + qBlue(pixel) * 7
+                        + qAlpha(pixel) * 11) % 64;
+            index[slot] = pixel;
+        }
+        *dst++ = static_cast<uchar>(qRed(pixel));
+        *dst++ = static_cast<uchar>(qGreen(pixel));
+        *dst++ = static_cast<uchar>(qBlue(pixel));
+    }
+    static const char endMarker[endMarkerSize] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+    return p == end && std::equal(endMarker, endMarker + endMarkerSize, end);
+}
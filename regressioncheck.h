@@ -0,0 +1,66 @@
+#ifndef REGRESSIONCHECK_H
+#define REGRESSIONCHECK_H
+
+#include <QByteArray>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QDir>
+
+/* Runs a corpus of scripts and compares what they save, and how long
+ * they take, with a manifest.
+ *
+ * The manifest lists each script, relative to the manifest, with its
+ * baseline time in milliseconds, followed by the files it saves and
+ * their hashes:
+ *
+ *     script ../script.txt 0.52
+ *     output_1.bmp 3c1e0f5d9a6b2e47
+ *
+ * A format as --format takes it may follow the baseline; scripts save
+ * BMP otherwise. Blank lines and lines starting with '#' are ignored.
+ * A script fails if it stops with an error, if it saves other files or
+ * if a file's hash differs. It also fails if its best time over
+ * several runs exceeds the baseline by more than the margin. A QOI file
+ * must also decode to the same pixels the script saves as raw RGB.
+ * --record rewrites the manifest from the current outputs and times
+ * instead of checking. */
+class RegressionCheck
+{
+public:
+    RegressionCheck();
+
+    int exec(const QStringList &args);
+
+private:
+    enum { DEFAULT_RUNS = 3, DEFAULT_MARGIN = 25 };
+
+    struct Output {
+        QString name;
+        QString hash;
+    };
+
+    struct Entry {
+        QString script;
+        double baseline;        /* milliseconds */
+        QString format;         /* empty for BMP */
+        QVector<Output> outputs;
+    };
+
+    bool readManifest();
+    bool writeManifest() const;
+    bool check(Entry &entry, const QDir &outDir);
+    bool checkRoundTrip(const Entry &entry, const QString &script,
+                        const QDir &dir, const QStringList &savedFiles);
+
+    static QString hashFile(const QString &fileName);
+    static bool decodeQoi(const QByteArray &data, QByteArray &pixels);
+
+    QString manifest;
+    QVector<Entry> entries;
+    int runs;
+    double margin;              /* percent */
+    bool record;
+};
+
+#endif // REGRESSIONCHECK_H
@@ -0,0 +1,161 @@
+#include "renderserver.h"
+#include "paintercli.h"
+#include "trace.h"
+
+#include <QBuffer>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <QThread>
+
+#include <cstdio>
+#include <iostream>
+using std::cout;
+using std::cerr;
+using std::endl;
+
+class RenderServer::Job : public QRunnable
+{
+public:
+    Job(RenderServer &server, const QString &id, const QString &outDir,
+        const QByteArray &script)
+        : server(server), id(id), outDir(outDir), script(script) {}
+
+    void run() override
+    {
+        cg::Trace::setThreadName("server worker");
+        TRACE_SCOPE("job");
+
+        if (!QDir().mkpath(outDir)) {
+            cerr << "Fail to create output directory: " << qPrintable(outDir) << endl;
+            server.reply(id, 1, QStringList());
+            return;
+        }
+
+        PainterCLI *cli = server.acquireCli();
+        QBuffer buffer;
+        buffer.setData(script);
+        buffer.open(QIODevice::ReadOnly);
+        int status = cli->run(&buffer, QDir(outDir));
+        QStringList files;
+        for (auto &file : cli->getSavedFiles())
+            files.append(QFileInfo(file).absoluteFilePath());
+        server.releaseCli(cli);
+
+        server.reply(id, status, files);
+    }
+
+private:
+    RenderServer &server;
+    QString id;
+    QString outDir;
+    QByteArray script;
+};
+
+RenderServer::RenderServer()
+{
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+}
+
+RenderServer::~RenderServer()
+{
+    pool.waitForDone();
+    qDeleteAll(clis);
+}
+
+int RenderServer::exec(const QStringList &args)
+{
+    for (int i = 0; i < args.size(); ++i) {
+        if (args[i] == "--jobs" && i + 1 < args.size()) {
+            bool ok;
+            int jobs = args[++i].toInt(&ok);
+            if (!ok || jobs < 1) {
+                cerr << "Serve error: invalid number of jobs: " << qPrintable(args[i]) << endl;
+                return 1;
+            }
+            pool.setMaxThreadCount(jobs);
+        }
+        else {
+            cerr << "Serve error: invalid argument: " << qPrintable(args[i]) << endl;
+            return 1;
+        }
+    }
+
+    QFile in;
+    if (!in.open(stdin, QIODevice::ReadOnly)) {
+        cerr << "Cannot open standard input: " << qPrintable(in.errorString()) << endl;
+        return 1;
+    }
+
+    int status = 0;
+    while (true) {
+        QByteArray header = in.readLine();
+        if (header.isEmpty())
+            break;      /* end of input */
+        QStringList fields = QString::fromUtf8(header).trimmed().split(' ');
+        if (fields.size() == 1 && fields[0].isEmpty())
+            continue;
+
+        bool ok = fields.size() == 4 && fields[0] == "job";
+        qint64 length = ok ? fields[3].toLongLong(&ok) : 0;
+        if (!ok || length < 0) {
+            /* The framing is lost, so nothing after this can be read. */
+            cerr << "Serve error: bad job header: "
+                 << qPrintable(QString::fromUtf8(header).trimmed()) << endl;
+            status = 1;
+            break;
+        }
+
+        QByteArray script;
+        while (script.size() < length) {
+            QByteArray chunk = in.read(length - script.size());
+            if (chunk.isEmpty())
+                break;
+            script += chunk;
+        }
+        if (script.size() < length) {
+            cerr << "Serve error: job " << qPrintable(fields[1])
+                 << " ends early" << endl;
+            status = 1;
+            break;
+        }
+
+        pool.start(new Job(*this, fields[1], fields[2], script));
+    }
+
+    pool.waitForDone();
+    return status;
+}
+
+PainterCLI *RenderServer::acquireCli()
+{
+    QMutexLocker locker(&mutex);
+    if (!idleClis.isEmpty()) {
+        PainterCLI *cli = idleClis.last();
+        idleClis.removeLast();
+        return cli;
+    }
+    /* At most one per worker is ever created. The workers already keep
+     * the cores busy, so a job runs on its worker's thread alone. */
+    PainterCLI *cli = new PainterCLI;
+    cli->setMaxThreadCount(1);
+    clis.append(cli);
+    return cli;
+}
+
+void RenderServer::releaseCli(PainterCLI *cli)
+{
+    QMutexLocker locker(&mutex);
+    idleClis.append(cli);
+}
+
+void RenderServer::reply(const QString &id, int status, const QStringList &files)
+{
+    QMutexLocker locker(&replyMutex);
+    cout << "done " << qPrintable(id) << ' ' << status << ' ' << files.size() << '\n';
+    for (auto &file : files)
+        cout << qPrintable(file) << '\n';
+    cout.flush();
+}
@@ -0,0 +1,56 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include <QByteArray>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <QVector>
+
+class PainterCLI;
+
+/* Stays resident and runs script jobs read from standard input, so that
+ * process startup is paid once rather than per job.
+ *
+ * A job is a header line followed by the script itself:
+ *
+ *     job <id> <outDir> <length>
+ *     <length bytes of script>
+ *
+ * The id and the output directory may not contain spaces. Jobs run
+ * concurrently on a pool of workers, and each is answered on standard
+ * output as soon as it finishes, so answers may come out of order:
+ *
+ *     done <id> <status> <n>
+ *
+ * followed by the absolute paths of the n files the job saved, one per
+ * line. Status 0 means the script ran to the end. A job runs on its
+ * worker's thread alone, so n workers use n threads. Each worker keeps a
+ * PainterCLI, whose canvas tiles and shape store are reused by the next
+ * job it runs. The server exits once the input ends and every job has
+ * been answered. */
+class RenderServer
+{
+public:
+    RenderServer();
+    ~RenderServer();
+
+    int exec(const QStringList &args);
+
+private:
+    class Job;
+
+    PainterCLI *acquireCli();
+    void releaseCli(PainterCLI *cli);
+    void reply(const QString &id, int status, const QStringList &files);
+
+    QThreadPool pool;
+
+    QMutex mutex;
+    QVector<PainterCLI *> idleClis;     /* guarded by mutex */
+    QVector<PainterCLI *> clis;         /* guarded by mutex */
+    QMutex replyMutex;                  /* keeps answers whole */
+};
+
+#endif // RENDERSERVER_H
@@ -0,0 +1,104 @@
+#include "renderworker.h"
+#include "trace.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QColor>
+#include <QPainter>
+#include <QRegion>
+
+RenderWorker::RenderWorker(QObject *parent)
+    : QObject(parent), hasPendingRequest(false), renderScheduled(false),
+      hasReadyFrame(false), droppedFrames(0)
+{
+
+}
+
+void RenderWorker::requestFrame(const cg::ShapeStore::Changes &changes,
+                                const QSize &size,
+                                const cg::Viewport &viewport,
+                                const QSize &paperSize)
+{
+    QMutexLocker locker(&mutex);
+    if (!changes.isEmpty())
+        pendingChanges.append(changes);
+    pendingSize = size;
+    pendingViewport = viewport;
+    pendingPaperSize = paperSize;
+    hasPendingRequest = true;
+
+    /* One queued call drains every request made before it runs. */
+    if (!renderScheduled) {
+        renderScheduled = true;
+        QMetaObject::invokeMethod(this, "render", Qt::QueuedConnection);
+    }
+}
+
+bool RenderWorker::takeFrame(QImage &frame)
+{
+    QMutexLocker locker(&mutex);
+    if (!hasReadyFrame)
+        return false;
+
+    /* The old front buffer becomes the next ready buffer to recycle. */
+    frame.swap(readyBuffer);
+    hasReadyFrame = false;
+    return true;
+}
+
+void RenderWorker::render()
+{
+    cg::Trace::setThreadName("render");
+    while (true) {
+        TRACE_SCOPE("render");
+        QVector<cg::ShapeStore::Changes> changes;
+        QSize size;
+        cg::Viewport viewport;
+        QSize paperSize;
+        {
+            QMutexLocker locker(&mutex);
+            if (!hasPendingRequest) {
+                renderScheduled = false;
+                return;
+            }
+            changes.swap(pendingChanges);
+            size = pendingSize;
+            viewport = pendingViewport;
+            paperSize = pendingPaperSize;
+            hasPendingRequest = false;
+        }
+
+        for (const auto &change : changes)
+            scene.apply(change);
+
+        {
+            TRACE_SCOPE("clear");
+            if (backBuffer.size() != size)
+                backBuffer = QImage(size, QImage::Format_RGB32);
+            backBuffer.fill(Qt::white);
+        }
+        scene.draw(backBuffer, viewport);
+
+        /* Shapes are clipped to the paper; the rest of the view is gray. */
+        QRect paper = viewport.map(QRect(QPoint(0, 0), paperSize));
+        QRegion outside = QRegion(backBuffer.rect()).subtracted(paper);
+        if (!outside.isEmpty()) {
+            TRACE_SCOPE("paper");
+            QPainter painter(&backBuffer);
+            painter.setClipRegion(outside);
+            painter.fillRect(backBuffer.rect(), Qt::lightGray);
+        }
+
+        {
+            QMutexLocker locker(&mutex);
+            if (hasPendingRequest && droppedFrames < MAX_DROPPED_FRAMES) {
+                ++droppedFrames;
+                continue;
+            }
+            backBuffer.swap(readyBuffer);
+            hasReadyFrame = true;
+            droppedFrames = 0;
+        }
+        emit frameReady();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef RENDERWORKER_H
+#define RENDERWORKER_H
+
+#include "shapestore.h"
+#include "viewport.h"
+
+#include <QObject>
+#include <QImage>
+#include <QSize>
+#include <QMutex>
+#include <QVector>
+
+/* Rasterizes the scene off the GUI thread.
+ *
+ * The worker keeps its own copy of the scene store. Each request carries
+ * the changes the GUI thread's store logged since the last request, so
+ * only the shapes edited in between cross threads, and the GUI thread
+ * never copies the scene or shares arrays that it would have to detach
+ * on its next edit.
+ *
+ * The worker lives in its own thread and owns three frame buffers: the
+ * back buffer it renders into, the ready buffer holding the newest
+ * completed frame, and the front buffer handed to the GUI thread by
+ * takeFrame(). Finishing a frame and taking a frame only swap buffers
+ * under the lock, so neither side waits for the other's drawing.
+ *
+ * Frames are never queued. A new request replaces one that has not been
+ * picked up yet, though the changes of both are kept, and a frame whose
+ * request was superseded while it was rendered is dropped. */
+class RenderWorker : public QObject
+{
+    Q_OBJECT
+public:
+    explicit RenderWorker(QObject *parent = nullptr);
+
+    /* Both may be called from any thread. */
+    void requestFrame(const cg::ShapeStore::Changes &changes,
+                      const QSize &size, const cg::Viewport &viewport,
+                      const QSize &paperSize);
+    bool takeFrame(QImage &frame);
+
+signals:
+    void frameReady();
+
+private slots:
+    void render();
+
+private:
+    /* Publish anyway after dropping this many frames in a row, so that a
+     * continuous stream of requests can't starve the display. */
+    enum { MAX_DROPPED_FRAMES = 2 };
+
+    QMutex mutex;
+
+    /* Guarded by mutex */
+    QVector<cg::ShapeStore::Changes> pendingChanges;
+    QSize pendingSize;
+    cg::Viewport pendingViewport;
+    QSize pendingPaperSize;
+    bool hasPendingRequest;
+    bool renderScheduled;
+    QImage readyBuffer;
+    bool hasReadyFrame;
+
+    /* Only touched by the worker thread */
+    cg::ShapeStore scene;
+    QImage backBuffer;
+    int droppedFrames;
+};
+
+#endif // RENDERWORKER_H
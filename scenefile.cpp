@@ -0,0 +1,809 @@
+#include "scenefile.h"
+#include "line.h"
+#include "polygon.h"
+#include "ellipse.h"
+#include "curve.h"
+#include "polyline.h"
+#include "fixedpoint.h"
+#include "trace.h"
+
+#include <QSaveFile>
+#include <QColor>
+#include <QtEndian>
+#include <QtNumeric>
+#include <QtDebug>
+
+#include <cstring>
+
+namespace cg {
+
+namespace {
+
+const char MAGIC[4] = { 'P', 'S', 'C', 'N' };
+
+enum {
+    BATCH_SIZE = 8,     /* kind, count */
+    LINE_SIZE = 24,     /* x1, y1, x2, y2, rgb, alg */
+    ELLIPSE_SIZE = 32,  /* x, y, rx, ry, theta, rgb, reserved */
+    PATH_SIZE = 32,     /* hull left, top, right, bottom, rgb, alg,
+                           vertex count, vertex offset */
+    RUNS_SIZE = 4,
+};
+
+/* Record sizes of the sections, in the order of SceneFile's enum. */
+const int RECORD_SIZE[] = {
+    BATCH_SIZE, LINE_SIZE, PATH_SIZE, ELLIPSE_SIZE, PATH_SIZE, PATH_SIZE,
+    RUNS_SIZE, 1
+};
+
+void putU32(QByteArray &out, quint32 value)
+{
+    uchar bytes[4];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 4);
+}
+
+void putU64(QByteArray &out, quint64 value)
+{
+    uchar bytes[8];
+    qToLittleEndian(value, bytes);
+    out.append(reinterpret_cast<const char *>(bytes), 8);
+}
+
+void putInt(QByteArray &out, int value)
+{
+    putU32(out, static_cast<quint32>(value));
+}
+
+/* Zigzag maps small deltas of either sign to small codes, which take
+ * seven bits per byte. */
+void putVarint(QByteArray &out, qint64 value)
+{
+    quint64 code = (static_cast<quint64>(value) << 1) ^
+            static_cast<quint64>(value >> 63);
+    while (code >= 0x80) {
+        out.append(static_cast<char>(code | 0x80));
+        code >>= 7;
+    }
+    out.append(static_cast<char>(code));
+}
+
+quint32 getU32(const uchar *p)
+{
+    return qFromLittleEndian<quint32>(p);
+}
+
+quint64 getU64(const uchar *p)
+{
+    return qFromLittleEndian<quint64>(p);
+}
+
+int getInt(const uchar *p)
+{
+    return static_cast<qint32>(getU32(p));
+}
+
+bool getVarint(const uchar *&p, const uchar *end, qint64 &value)
+{
+    quint64 code = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (p == end)
+            return false;
+        uchar byte = *p++;
+        code |= static_cast<quint64>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            value = static_cast<qint64>(code >> 1) ^ -static_cast<qint64>(code & 1);
+            return true;
+        }
+    }
+    return false;
+}
+
+Algorithm getAlgorithm(const uchar *p)
+{
+    quint32 alg = getU32(p);
+    if (alg > static_cast<quint32>(Algorithm::B_SPLINE))
+        return Algorithm::DEFAULT;
+    return static_cast<Algorithm>(alg);
+}
+
+double getDouble(const uchar *p)
+{
+    quint64 bits = getU64(p);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+QPoint getPoint(const uchar *p)
+{
+    return QPoint(getInt(p), getInt(p + 4));
+}
+
+/* Reads a point in the file's unit, see SceneFile::unit, as fixed point. */
+QPoint getFixedPoint(const uchar *p, int unit)
+{
+    return getPoint(p) * unit;
+}
+
+QRect getPathHull(const uchar *record)
+{
+    return QRect(getPoint(record), getPoint(record + 8));
+}
+
+/* Reads an ellipse record in fixed point. Returns false if its radii or
+ * angle make no sense. */
+bool getEllipse(const uchar *record, int unit, QPoint &center,
+                int &rx, int &ry, double &theta)
+{
+    center = getFixedPoint(record, unit);
+    rx = getInt(record + 8) * unit;
+    ry = getInt(record + 12) * unit;
+    theta = getDouble(record + 16);
+    return rx >= 0 && ry >= 0 && qIsFinite(theta);
+}
+
+/* Vertex offsets in path records are 32-bit. */
+const qint64 MAX_POOL_OFFSET = 0xffffffffLL;
+
+int varintSize(qint64 value)
+{
+    quint64 code = (static_cast<quint64>(value) << 1) ^
+            static_cast<quint64>(value >> 63);
+    int size = 1;
+    for (; code >= 0x80; code >>= 7)
+        ++size;
+    return size;
+}
+
+void putPathRecord(QByteArray &out, const QRect &hull, int n,
+                   QRgb rgb, Algorithm alg, qint64 offset)
+{
+    putInt(out, hull.left());
+    putInt(out, hull.top());
+    putInt(out, hull.right());
+    putInt(out, hull.bottom());
+    putU32(out, rgb);
+    putU32(out, static_cast<quint32>(alg));
+    putU32(out, static_cast<quint32>(n));
+    putU32(out, static_cast<quint32>(offset));
+}
+
+/* Writes the vertices of a path to the pool, or only returns the size
+ * they take there if pool is null. The first vertex is coded from the
+ * hull's corner, the others from the vertex before them. */
+qint64 putPathVertices(QByteArray *pool, const QRect &hull,
+                       const QPoint *points, int n)
+{
+    qint64 size = 0;
+    qint64 x = static_cast<qint64>(hull.left()) * fixed::ONE;
+    qint64 y = static_cast<qint64>(hull.top()) * fixed::ONE;
+    for (int i = 0; i < n; ++i) {
+        if (pool) {
+            putVarint(*pool, points[i].x() - x);
+            putVarint(*pool, points[i].y() - y);
+        }
+        else {
+            size += varintSize(points[i].x() - x) + varintSize(points[i].y() - y);
+        }
+        x = points[i].x();
+        y = points[i].y();
+    }
+    return size;
+}
+
+/* Decodes the vertices of a path record from the pool. Returns false if
+ * the path has fewer than minCount vertices or they run past the end of
+ * the pool. */
+bool decodePath(const uchar *record, const uchar *pool, qint64 poolSize,
+                int unit, quint32 minCount, QVector<QPoint> &points)
+{
+    qint64 x = static_cast<qint64>(getInt(record)) * fixed::ONE;
+    qint64 y = static_cast<qint64>(getInt(record + 4)) * fixed::ONE;
+    quint32 n = getU32(record + 24);
+    quint32 offset = getU32(record + 28);
+    /* A vertex takes at least two bytes. */
+    if (n < minCount || offset > poolSize || n > (poolSize - offset) / 2)
+        return false;
+
+    points.resize(static_cast<int>(n));
+    QPoint *out = points.data();
+    const uchar *p = pool + offset, *end = pool + poolSize;
+    for (quint32 i = 0; i < n; ++i) {
+        qint64 dx, dy;
+        if (!getVarint(p, end, dx) || !getVarint(p, end, dy))
+            return false;
+        x += dx * unit;
+        y += dy * unit;
+        out[i] = QPoint(static_cast<int>(x), static_cast<int>(y));
+    }
+    return true;
+}
+
+/* Turns the records visited into new shapes. */
+struct ShapeCollector
+{
+    ShapeCollector(int unit, const uchar *pool, qint64 poolSize)
+        : unit(unit), pool(pool), poolSize(poolSize) {}
+
+    void line(const uchar *record)
+    {
+        shapes.append(new Line(fixed::toReal(getFixedPoint(record, unit)),
+                               fixed::toReal(getFixedPoint(record + 8, unit)),
+                               QColor::fromRgba(getU32(record + 16)),
+                               Shape::algorithmName(getAlgorithm(record + 20))));
+    }
+
+    void ellipse(const uchar *record)
+    {
+        QPoint center;
+        int rx, ry;
+        double theta;
+        if (getEllipse(record, unit, center, rx, ry, theta))
+            shapes.append(new Ellipse(fixed::toReal(center), fixed::toReal(rx),
+                                      fixed::toReal(ry),
+                                      QColor::fromRgba(getU32(record + 24)),
+                                      QString(), theta));
+    }
+
+    void polygon(const uchar *record)
+    {
+        if (decode(record, 3))
+            shapes.append(new Polygon(fixed::toReal(points), color(record),
+                                      name(record)));
+    }
+
+    void curve(const uchar *record)
+    {
+        if (decode(record, 2))
+            shapes.append(new Curve(fixed::toReal(points), color(record),
+                                    name(record)));
+    }
+
+    void polyline(const uchar *record, int nRuns)
+    {
+        QVector<QVector<QPointF>> runs;
+        runs.reserve(nRuns);
+        for (int i = 0; i < nRuns; ++i) {
+            if (!decode(record + i * PATH_SIZE, 1))
+                return;
+            runs.append(fixed::toReal(points));
+        }
+        shapes.append(new Polyline(runs, color(record), name(record)));
+    }
+
+    bool decode(const uchar *record, quint32 minCount)
+    {
+        if (decodePath(record, pool, poolSize, unit, minCount, points))
+            return true;
+        qDebug("Skip a corrupt path");
+        return false;
+    }
+
+    static QColor color(const uchar *record)
+    {
+        return QColor::fromRgba(getU32(record + 16));
+    }
+
+    static QString name(const uchar *record)
+    {
+        return Shape::algorithmName(getAlgorithm(record + 20));
+    }
+
+    int unit;
+    const uchar *pool;
+    qint64 poolSize;
+    QList<Shape *> shapes;
+    QVector<QPoint> points;
+};
+
+/* Appends the records visited to a store, unless their hull misses the
+ * window. Culled paths are never decoded. */
+struct StoreAppender
+{
+    StoreAppender(ShapeStore &store, const QRect &window, int unit,
+                  const uchar *pool, qint64 poolSize)
+        : store(store), window(window), unit(unit),
+          pool(pool), poolSize(poolSize) {}
+
+    void line(const uchar *record)
+    {
+        QPoint p1 = getFixedPoint(record, unit);
+        QPoint p2 = getFixedPoint(record + 8, unit);
+        if (meets(QRect(fixed::toPixel(p1), fixed::toPixel(p2)).normalized()))
+            store.addLine(p1, p2, getU32(record + 16), getAlgorithm(record + 20));
+    }
+
+    void ellipse(const uchar *record)
+    {
+        QPoint center;
+        int rx, ry;
+        double theta;
+        if (getEllipse(record, unit, center, rx, ry, theta) &&
+                meets(Ellipse::rectHullFixed(center, rx, ry, theta)))
+            store.addEllipse(center, rx, ry, theta, getU32(record + 24));
+    }
+
+    void polygon(const uchar *record)
+    {
+        if (meets(getPathHull(record)) && decode(record, 3))
+            store.addPolygon(points, getU32(record + 16), getAlgorithm(record + 20));
+    }
+
+    void curve(const uchar *record)
+    {
+        if (meets(getPathHull(record)) && decode(record, 2))
+            store.addCurve(points, getU32(record + 16), getAlgorithm(record + 20));
+    }
+
+    void polyline(const uchar *record, int nRuns)
+    {
+        QVector<QVector<QPoint>> runs;
+        for (int i = 0; i < nRuns; ++i) {
+            const uchar *run = record + i * PATH_SIZE;
+            if (meets(getPathHull(run)) && decode(run, 1))
+                runs.append(points);
+        }
+        if (!runs.isEmpty())
+            store.addPolyline(runs, getU32(record + 16), getAlgorithm(record + 20));
+    }
+
+    bool meets(const QRect &hull) const
+    {
+        /* A pixel of margin covers rounding at the edges of the hull. */
+        return hull.adjusted(-1, -1, 1, 1).intersects(window);
+    }
+
+    bool decode(const uchar *record, quint32 minCount)
+    {
+        if (decodePath(record, pool, poolSize, unit, minCount, points))
+            return true;
+        qDebug("Skip a corrupt path");
+        return false;
+    }
+
+    ShapeStore &store;
+    QRect window;
+    int unit;
+    const uchar *pool;
+    qint64 poolSize;
+    QVector<QPoint> points;
+};
+
+}
+
+/* Buffers what is written to a device and counts the bytes. Records are
+ * appended to out(), and next() passes them on once a chunk is full. */
+class SceneFile::Writer
+{
+public:
+    explicit Writer(QIODevice *device)
+        : device(device), flushed(0), failed(false)
+    {
+        chunk.reserve(CHUNK_SIZE);
+    }
+
+    QByteArray &out() { return chunk; }
+    void next()
+    {
+        if (chunk.size() >= CHUNK_SIZE)
+            flush();
+    }
+    qint64 pos() const { return flushed + chunk.size(); }
+
+    bool flush()
+    {
+        if (!failed && !chunk.isEmpty())
+            failed = device->write(chunk) != chunk.size();
+        flushed += chunk.size();
+        chunk.resize(0);
+        return !failed;
+    }
+
+private:
+    enum { CHUNK_SIZE = 64 * 1024 };
+
+    QIODevice *device;
+    QByteArray chunk;
+    qint64 flushed;
+    bool failed;
+};
+
+SceneFile::SceneFile()
+    : mapped(nullptr), data(nullptr), unit(1)
+{
+
+}
+
+SceneFile::~SceneFile()
+{
+    close();
+}
+
+bool SceneFile::save(const QString &fileName, const ShapeStore &store,
+                     const QSize &canvasSize)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    return write(&file, store, canvasSize) && file.commit();
+}
+
+/* Streams the sections to the device, reading the records where they
+ * lie in the store in drawing order, so that nothing the size of the
+ * scene is built in memory. The table in the header is written last. */
+bool SceneFile::write(QIODevice *device, const ShapeStore &store,
+                      const QSize &canvasSize)
+{
+    TRACE_SCOPE("write scene");
+    Writer writer(device);
+    QByteArray &out = writer.out();
+    const ShapeStore::Slot *slotOf = store.shapeSlots.constData();
+    const QVector<int> &order = store.order;
+    quint64 offsets[SECTION_COUNT], counts[SECTION_COUNT] = { 0 };
+
+    out.append(MAGIC, 4);
+    putU32(out, VERSION);
+    putInt(out, canvasSize.width());
+    putInt(out, canvasSize.height());
+    putU32(out, static_cast<quint32>(store.size()));
+    putU32(out, 0);
+    out.append(QByteArray(HEADER_SIZE - TABLE_OFFSET, '\0'));
+
+    /* A batch runs on across removed shapes. */
+    offsets[BATCHES] = writer.pos();
+    int kind = ShapeStore::REMOVED, count = 0;
+    for (int i = 0; i <= order.size(); ++i) {
+        const ShapeStore::Slot *slot =
+                i < order.size() ? &slotOf[order[i]] : nullptr;
+        if (slot && slot->kind == ShapeStore::REMOVED)
+            continue;
+        if (slot && slot->kind == kind) {
+            count += slot->count;
+            continue;
+        }
+        if (count > 0) {
+            putU32(out, static_cast<quint32>(kind));
+            putU32(out, static_cast<quint32>(count));
+            ++counts[BATCHES];
+            writer.next();
+        }
+        if (slot) {
+            kind = slot->kind;
+            count = slot->count;
+        }
+    }
+
+    offsets[LINES] = writer.pos();
+    for (int handle : order) {
+        if (slotOf[handle].kind != ShapeStore::LINE)
+            continue;
+        const ShapeStore::LineRecord &record = store.lines[slotOf[handle].first];
+        putInt(out, record.p1.x());
+        putInt(out, record.p1.y());
+        putInt(out, record.p2.x());
+        putInt(out, record.p2.y());
+        putU32(out, record.rgb);
+        putU32(out, static_cast<quint32>(record.alg));
+        ++counts[LINES];
+        writer.next();
+    }
+
+    /* The vertices of polygons, curves and polylines follow each other
+     * in the pool, which comes last. */
+    qint64 poolSize = 0;
+    offsets[POLYGONS] = writer.pos();
+    bool fits = writePaths(writer, store, ShapeStore::POLYGON,
+                           counts[POLYGONS], poolSize);
+
+    offsets[ELLIPSES] = writer.pos();
+    for (int handle : order) {
+        if (slotOf[handle].kind != ShapeStore::ELLIPSE)
+            continue;
+        const ShapeStore::EllipseRecord &record =
+                store.ellipses[slotOf[handle].first];
+        quint64 theta;
+        std::memcpy(&theta, &record.theta, sizeof(theta));
+        putInt(out, record.center.x());
+        putInt(out, record.center.y());
+        putInt(out, record.rx);
+        putInt(out, record.ry);
+        putU64(out, theta);
+        putU32(out, record.rgb);
+        putU32(out, 0);
+        ++counts[ELLIPSES];
+        writer.next();
+    }
+
+    offsets[CURVES] = writer.pos();
+    fits = fits && writePaths(writer, store, ShapeStore::CURVE,
+                              counts[CURVES], poolSize);
+    offsets[POLYLINES] = writer.pos();
+    fits = fits && writePaths(writer, store, ShapeStore::POLYLINE,
+                              counts[POLYLINES], poolSize);
+    if (!fits)
+        return false;
+
+    offsets[POLYLINE_RUNS] = writer.pos();
+    for (int handle : order) {
+        const ShapeStore::Slot &slot = slotOf[handle];
+        if (slot.kind != ShapeStore::POLYLINE)
+            continue;
+        putU32(out, static_cast<quint32>(slot.count));
+        ++counts[POLYLINE_RUNS];
+        writer.next();
+    }
+
+    offsets[VERTICES] = writer.pos();
+    writeVertices(writer, store, ShapeStore::POLYGON);
+    writeVertices(writer, store, ShapeStore::CURVE);
+    writeVertices(writer, store, ShapeStore::POLYLINE);
+    counts[VERTICES] = static_cast<quint64>(writer.pos()) - offsets[VERTICES];
+    if (!writer.flush())
+        return false;
+
+    QByteArray table;
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        putU64(table, offsets[i]);
+        putU64(table, counts[i]);
+    }
+    return device->seek(TABLE_OFFSET) && device->write(table) == table.size();
+}
+
+/* Writes the path records of kind in drawing order and adds the size of
+ * their vertices to poolSize, which is where the next path's vertices
+ * start. Returns false once a path starts beyond a 32-bit offset. */
+bool SceneFile::writePaths(Writer &writer, const ShapeStore &store, int kind,
+                           quint64 &count, qint64 &poolSize)
+{
+    const ShapeStore::PathRecord *records = store.pathRecords(kind);
+    const QPoint *vertices = store.vertices.constData();
+    for (int handle : store.order) {
+        const ShapeStore::Slot &slot = store.shapeSlots[handle];
+        if (slot.kind != kind)
+            continue;
+        const ShapeStore::PathRecord *record = records + slot.first;
+        for (int i = 0; i < slot.count; ++i, ++record) {
+            if (poolSize > MAX_POOL_OFFSET)
+                return false;
+            putPathRecord(writer.out(), record->hull, record->count,
+                          record->rgb, record->alg, poolSize);
+            poolSize += putPathVertices(nullptr, record->hull,
+                                        vertices + record->first,
+                                        record->count);
+            ++count;
+            writer.next();
+        }
+    }
+    return true;
+}
+
+/* Writes the vertices of the paths writePaths() wrote for kind. */
+void SceneFile::writeVertices(Writer &writer, const ShapeStore &store,
+                              int kind)
+{
+    const ShapeStore::PathRecord *records = store.pathRecords(kind);
+    const QPoint *vertices = store.vertices.constData();
+    for (int handle : store.order) {
+        const ShapeStore::Slot &slot = store.shapeSlots[handle];
+        if (slot.kind != kind)
+            continue;
+        const ShapeStore::PathRecord *record = records + slot.first;
+        for (int i = 0; i < slot.count; ++i, ++record) {
+            putPathVertices(&writer.out(), record->hull,
+                            vertices + record->first, record->count);
+            writer.next();
+        }
+    }
+}
+
+bool SceneFile::isSceneFile(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    char magic[4];
+    return file.read(magic, 4) == 4 && std::memcmp(magic, MAGIC, 4) == 0;
+}
+
+bool SceneFile::open(const QString &fileName)
+{
+    TRACE_SCOPE("SceneFile::open");
+    close();
+    error.clear();
+
+    file.setFileName(fileName);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    qint64 size = file.size();
+    mapped = file.map(0, size);
+    const uchar *bytes = mapped;
+    if (!bytes) {
+        /* Not every file can be mapped; read those instead. */
+        buffer = file.readAll();
+        bytes = reinterpret_cast<const uchar *>(buffer.constData());
+        size = buffer.size();
+    }
+
+    if (!attach(bytes, size)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void SceneFile::close()
+{
+    if (mapped) {
+        file.unmap(mapped);
+        mapped = nullptr;
+    }
+    file.close();
+    buffer.clear();
+    data = nullptr;
+    canvasSize = QSize();
+}
+
+bool SceneFile::attach(const uchar *bytes, qint64 size)
+{
+    if (size < HEADER_SIZE || std::memcmp(bytes, MAGIC, 4) != 0) {
+        error = QString("Not a scene document");
+        return false;
+    }
+    quint32 version = getU32(bytes + 4);
+    if (version != 1 && version != VERSION) {
+        error = QString("Unsupported scene document version %1").arg(version);
+        return false;
+    }
+    int width = getInt(bytes + 8), height = getInt(bytes + 12);
+    if (width <= 0 || height <= 0) {
+        error = QString("Bad canvas size %1x%2").arg(width).arg(height);
+        return false;
+    }
+
+    const uchar *table = bytes + TABLE_OFFSET;
+    for (int i = 0; i < SECTION_COUNT; ++i) {
+        quint64 offset = getU64(table + 16 * i);
+        quint64 count = getU64(table + 16 * i + 8);
+        if (offset > static_cast<quint64>(size) ||
+                count > (static_cast<quint64>(size) - offset) / RECORD_SIZE[i]) {
+            error = QString("Truncated scene document");
+            return false;
+        }
+        sections[i].begin = bytes + offset;
+        sections[i].count = static_cast<qint64>(count);
+    }
+    if (!checkBatches()) {
+        error = QString("Corrupt scene document");
+        return false;
+    }
+
+    canvasSize = QSize(width, height);
+    /* Version 1 held whole pixels. */
+    unit = version == 1 ? static_cast<int>(fixed::ONE) : 1;
+    data = bytes;
+    return true;
+}
+
+bool SceneFile::checkBatches()
+{
+    /* Batches must use up every record, and each polyline must lie in
+     * one batch, as ShapeStore lays them out. Vertices are checked as
+     * they are decoded. */
+    static const int sectionOfKind[ShapeStore::KIND_COUNT] = {
+        LINES, POLYGONS, ELLIPSES, CURVES, POLYLINES
+    };
+    qint64 used[ShapeStore::KIND_COUNT] = { 0 };
+    qint64 nextRuns = 0;
+
+    const Section &batches = sections[BATCHES];
+    const Section &runs = sections[POLYLINE_RUNS];
+    for (qint64 i = 0; i < batches.count; ++i) {
+        const uchar *batch = batches.begin + i * BATCH_SIZE;
+        quint32 kind = getU32(batch);
+        qint64 count = getU32(batch + 4);
+        if (kind >= ShapeStore::KIND_COUNT)
+            return false;
+        used[kind] += count;
+
+        while (kind == ShapeStore::POLYLINE && count > 0) {
+            if (nextRuns == runs.count)
+                return false;
+            qint64 n = getU32(runs.begin + nextRuns++ * RUNS_SIZE);
+            if (n > count)
+                return false;
+            count -= n;
+        }
+    }
+
+    for (int kind = 0; kind < ShapeStore::KIND_COUNT; ++kind) {
+        if (used[kind] != sections[sectionOfKind[kind]].count)
+            return false;
+    }
+    return true;
+}
+
+template <typename Visitor>
+void SceneFile::visit(Visitor &visitor) const
+{
+    qint64 next[ShapeStore::KIND_COUNT] = { 0 };
+    qint64 nextRuns = 0;
+
+    const Section &batches = sections[BATCHES];
+    const Section &runs = sections[POLYLINE_RUNS];
+    for (qint64 i = 0; i < batches.count; ++i) {
+        const uchar *batch = batches.begin + i * BATCH_SIZE;
+        int kind = static_cast<int>(getU32(batch));
+        qint64 count = getU32(batch + 4);
+        qint64 first = next[kind];
+        next[kind] += count;
+
+        switch (kind) {
+        case ShapeStore::LINE: {
+            const uchar *record = sections[LINES].begin + first * LINE_SIZE;
+            for (qint64 j = 0; j < count; ++j, record += LINE_SIZE)
+                visitor.line(record);
+            break;
+        }
+        case ShapeStore::POLYGON: {
+            const uchar *record = sections[POLYGONS].begin + first * PATH_SIZE;
+            for (qint64 j = 0; j < count; ++j, record += PATH_SIZE)
+                visitor.polygon(record);
+            break;
+        }
+        case ShapeStore::ELLIPSE: {
+            const uchar *record = sections[ELLIPSES].begin + first * ELLIPSE_SIZE;
+            for (qint64 j = 0; j < count; ++j, record += ELLIPSE_SIZE)
+                visitor.ellipse(record);
+            break;
+        }
+        case ShapeStore::CURVE: {
+            const uchar *record = sections[CURVES].begin + first * PATH_SIZE;
+            for (qint64 j = 0; j < count; ++j, record += PATH_SIZE)
+                visitor.curve(record);
+            break;
+        }
+        case ShapeStore::POLYLINE: {
+            /* A batch of polylines counts their runs. */
+            const uchar *record = sections[POLYLINES].begin + first * PATH_SIZE;
+            while (count > 0) {
+                int n = static_cast<int>(getU32(runs.begin + nextRuns++ * RUNS_SIZE));
+                if (n == 0)
+                    continue;
+                visitor.polyline(record, n);
+                record += n * PATH_SIZE;
+                count -= n;
+            }
+            break;
+        }
+        default:
+            Q_ASSERT(0); /* Should not reach here */ break;
+        }
+    }
+}
+
+void SceneFile::appendTo(ShapeStore &store, const QRect &window) const
+{
+    TRACE_SCOPE("SceneFile::appendTo");
+    if (!isOpen())
+        return;
+    StoreAppender appender(store, window, unit, sections[VERTICES].begin,
+                           sections[VERTICES].count);
+    visit(appender);
+}
+
+QList<Shape *> SceneFile::createShapes() const
+{
+    TRACE_SCOPE("SceneFile::createShapes");
+    if (!isOpen())
+        return QList<Shape *>();
+    ShapeCollector collector(unit, sections[VERTICES].begin,
+                             sections[VERTICES].count);
+    visit(collector);
+    return collector.shapes;
+}
+
+}
@@ -0,0 +1,103 @@
+#ifndef SCENEFILE_H
+#define SCENEFILE_H
+
+#include "shape.h"
+#include "shapestore.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QList>
+#include <QRect>
+#include <QSize>
+#include <QString>
+
+namespace cg {
+
+/* A scene saved in Painter's binary document format.
+ *
+ * The document is a ShapeStore laid out on disk: a header with the
+ * canvas size and a table of sections, then one section per record
+ * type, the drawing order as batches and a pool of vertices. Records
+ * have a fixed size per type and hold a packed color and a resolved
+ * algorithm. Coordinates and radii are in 24.8 fixed point, as the
+ * store keeps them. Path records also keep the hull of their vertices in
+ * pixels, which serves as the hull index. Vertices are delta coded as
+ * variable-length integers from the hull corner, and each path knows
+ * where its own vertices start. All integers are little endian. Version
+ * 1 documents, which hold whole pixels, are still read.
+ *
+ * open() maps the file and only checks the header and the drawing
+ * order. The vertices of a path are decoded when it is appended to a
+ * store or turned into a shape, and not at all if it is culled. */
+class SceneFile
+{
+public:
+    SceneFile();
+    ~SceneFile();
+
+    static bool save(const QString &fileName, const ShapeStore &store,
+                     const QSize &canvasSize);
+    /* Whether the file starts like a scene document. */
+    static bool isSceneFile(const QString &fileName);
+
+    bool open(const QString &fileName);
+    void close();
+    bool isOpen() const { return data != nullptr; }
+    QString errorString() const { return error; }
+
+    QSize getCanvasSize() const { return canvasSize; }
+
+    /* Appends the shapes that may touch window to store, in drawing
+     * order. */
+    void appendTo(ShapeStore &store, const QRect &window) const;
+    /* Creates every shape of the scene, in drawing order. Polylines
+     * without runs draw nothing and are dropped. */
+    QList<Shape *> createShapes() const;
+
+    enum { VERSION = 2 };
+
+private:
+    // enum for sections, in the order they are written
+    enum {
+        BATCHES, LINES, POLYGONS, ELLIPSES, CURVES, POLYLINES,
+        POLYLINE_RUNS, VERTICES, SECTION_COUNT
+    };
+
+    /* The header is the magic, the version, the canvas size, the number
+     * of shapes and a reserved word, then an offset and a count for
+     * each section. */
+    enum { TABLE_OFFSET = 24, HEADER_SIZE = TABLE_OFFSET + 16 * SECTION_COUNT };
+
+    struct Section {
+        const uchar *begin;
+        qint64 count;   /* records; bytes for VERTICES */
+    };
+
+    class Writer;
+
+    static bool write(QIODevice *device, const ShapeStore &store,
+                      const QSize &canvasSize);
+    static bool writePaths(Writer &writer, const ShapeStore &store, int kind,
+                           quint64 &count, qint64 &poolSize);
+    static void writeVertices(Writer &writer, const ShapeStore &store,
+                              int kind);
+    bool attach(const uchar *bytes, qint64 length);
+    bool checkBatches();
+
+    template <typename Visitor>
+    void visit(Visitor &visitor) const;
+
+    QFile file;
+    QByteArray buffer;      /* the file's contents if it can't be mapped */
+    uchar *mapped;
+    const uchar *data;
+    QString error;
+
+    QSize canvasSize;
+    int unit;               /* a coordinate of the file in fixed point */
+    Section sections[SECTION_COUNT];
+};
+
+}
+
+#endif // SCENEFILE_H
@@ -0,0 +1,255 @@
+#include "scriptexecutor.h"
+#include "line.h"
+#include "ellipse.h"
+#include "polygon.h"
+#include "curve.h"
+#include "trace.h"
+
+#include <QRunnable>
+
+#include <algorithm>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+class ScriptExecutor::Task : public QRunnable
+{
+public:
+    Task(ScriptExecutor &executor, int begin, int end)
+        : executor(executor), begin(begin), end(end)
+    {
+        setAutoDelete(false);
+    }
+
+    void run() override
+    {
+        cg::Trace::setThreadName("command worker");
+        executor.runChains(begin, end, failed);
+    }
+
+    QVector<int> failed;
+
+private:
+    ScriptExecutor &executor;
+    int begin, end;
+};
+
+ScriptExecutor::ScriptExecutor(QMap<int, cg::Shape *> &shapes)
+    : shapes(shapes)
+{
+}
+
+ScriptExecutor::~ScriptExecutor()
+{
+    flush();
+}
+
+ScriptExecutor::Command &ScriptExecutor::append(int id, Command::Type type)
+{
+    int index = commands.size();
+    commands.resize(index + 1);
+    Command &command = commands.last();
+    command.type = type;
+    command.id = id;
+    command.next = -1;
+
+    auto iter = chainOf.find(id);
+    if (iter == chainOf.end()) {
+        chainOf.insert(id, chains.size());
+        chains.append(Chain{id, index, index, 1, nullptr});
+    }
+    else {
+        Chain &chain = chains[iter.value()];
+        commands[chain.last].next = index;
+        chain.last = index;
+        ++chain.length;
+    }
+    return command;
+}
+
+void ScriptExecutor::drawLine(int id, const QPointF &p1, const QPointF &p2,
+                              const QColor &color, const QString &alg)
+{
+    Command &command = append(id, Command::LINE);
+    command.p1 = p1;
+    command.p2 = p2;
+    command.color = color;
+    command.alg = alg;
+}
+
+void ScriptExecutor::drawPolygon(int id, const QVector<QPointF> &points,
+                                 const QColor &color, const QString &alg)
+{
+    Command &command = append(id, Command::POLYGON);
+    command.points = points;
+    command.color = color;
+    command.alg = alg;
+}
+
+void ScriptExecutor::drawEllipse(int id, const QPointF &center,
+                                 double rx, double ry, const QColor &color)
+{
+    Command &command = append(id, Command::ELLIPSE);
+    command.p1 = center;
+    command.a = rx;
+    command.b = ry;
+    command.color = color;
+}
+
+void ScriptExecutor::drawCurve(int id, const QVector<QPointF> &points,
+                               const QColor &color, const QString &alg)
+{
+    Command &command = append(id, Command::CURVE);
+    command.points = points;
+    command.color = color;
+    command.alg = alg;
+}
+
+void ScriptExecutor::translate(int id, const QPointF &d)
+{
+    append(id, Command::TRANSLATE).p1 = d;
+}
+
+void ScriptExecutor::rotate(int id, const QPointF &c, double r)
+{
+    Command &command = append(id, Command::ROTATE);
+    command.p1 = c;
+    command.a = r;
+}
+
+void ScriptExecutor::scale(int id, const QPointF &c, double s)
+{
+    Command &command = append(id, Command::SCALE);
+    command.p1 = c;
+    command.a = s;
+}
+
+void ScriptExecutor::clip(int id, const QPointF &p1, const QPointF &p2,
+                          const QString &alg)
+{
+    Command &command = append(id, Command::CLIP);
+    command.p1 = p1;
+    command.p2 = p2;
+    command.alg = alg;
+}
+
+/* Runs chains [begin, end) and appends the index of every command whose
+ * shape didn't exist to failed. Only reads the table of shapes, so any
+ * number of workers may run at once. */
+void ScriptExecutor::runChains(int begin, int end, QVector<int> &failed)
+{
+    TRACE_SCOPE("run commands");
+    const QMap<int, cg::Shape *> &table = shapes;
+    for (int i = begin; i < end; ++i) {
+        Chain &chain = chains[i];
+        cg::Shape *shape = table.value(chain.id, nullptr);
+        for (int j = chain.first; j >= 0; j = commands[j].next) {
+            const Command &command = commands[j];
+            cg::Shape *created = nullptr;
+            switch (command.type) {
+            case Command::LINE:
+                created = new cg::Line(command.p1, command.p2,
+                                       command.color, command.alg);
+                break;
+            case Command::POLYGON:
+                created = new cg::Polygon(command.points, command.color,
+                                          command.alg);
+                break;
+            case Command::ELLIPSE:
+                created = new cg::Ellipse(command.p1, command.a, command.b,
+                                          command.color, "");
+                break;
+            case Command::CURVE:
+                created = new cg::Curve(command.points, command.color,
+                                        command.alg);
+                break;
+            default:
+                break;
+            }
+            if (created) {
+                delete shape;
+                shape = created;
+                continue;
+            }
+
+            if (!shape) {
+                failed.append(j);
+                continue;
+            }
+            switch (command.type) {
+            case Command::TRANSLATE:
+                shape->translate(command.p1);
+                break;
+            case Command::ROTATE:
+                shape->rotate(command.p1, command.a);
+                break;
+            case Command::SCALE:
+                shape->scale(command.p1, command.a);
+                break;
+            case Command::CLIP: {
+                cg::Shape *clippedShape = shape->clip(command.p1, command.p2,
+                                                      command.alg);
+                delete shape;
+                shape = clippedShape;
+                break;
+            }
+            default:
+                Q_ASSERT(0); /* Should not reach here */
+            }
+        }
+        chain.shape = shape;
+    }
+}
+
+void ScriptExecutor::flush(QVector<int> *ids)
+{
+    if (commands.isEmpty())
+        return;
+    TRACE_SCOPE("ScriptExecutor::flush");
+
+    /* Cut the chains into shares of about the same number of commands.
+     * The calling thread runs the first share itself. */
+    int taskCount = qBound(1, commands.size() / MIN_COMMANDS_PER_TASK,
+                           pool.maxThreadCount());
+    int share = (commands.size() + taskCount - 1) / taskCount;
+    QVector<int> bounds(1, 0);
+    int length = 0;
+    for (int i = 0; i < chains.size(); ++i) {
+        length += chains[i].length;
+        if (length >= share && i + 1 < chains.size()) {
+            bounds.append(i + 1);
+            length = 0;
+        }
+    }
+    bounds.append(chains.size());
+
+    QVector<Task *> tasks;
+    for (int k = 1; k + 1 < bounds.size(); ++k) {
+        tasks.append(new Task(*this, bounds[k], bounds[k + 1]));
+        pool.start(tasks.last());
+    }
+    QVector<int> failed;
+    runChains(bounds[0], bounds[1], failed);
+    pool.waitForDone();
+
+    for (Task *task : tasks) {
+        failed += task->failed;
+        delete task;
+    }
+    std::sort(failed.begin(), failed.end());
+    for (int index : failed)
+        cerr << "Cannot find shape by id: " << commands[index].id << endl;
+
+    for (const Chain &chain : chains) {
+        if (chain.shape)
+            shapes.insert(chain.id, chain.shape);
+        else
+            shapes.remove(chain.id);
+        if (ids)
+            ids->append(chain.id);
+    }
+
+    commands.clear();
+    chains.clear();
+    chainOf.clear();
+}
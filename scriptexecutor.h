@@ -0,0 +1,89 @@
+#ifndef SCRIPTEXECUTOR_H
+#define SCRIPTEXECUTOR_H
+
+#include "shape.h"
+
+#include <QColor>
+#include <QHash>
+#include <QMap>
+#include <QPointF>
+#include <QString>
+#include <QThreadPool>
+#include <QVector>
+
+/* Queues the commands of a script that act on a single shape and runs
+ * them in parallel.
+ *
+ * Commands on the same id form a chain that runs in script order, and
+ * chains of different ids are independent of each other, so each worker
+ * takes a share of the chains. Anything that reads the whole table of
+ * shapes, such as saving, resetting or clipAll, is a barrier and must
+ * call flush() first. The table then holds exactly what running the
+ * commands one by one would have left in it, and "Cannot find shape"
+ * errors are reported in script order. */
+class ScriptExecutor
+{
+public:
+    explicit ScriptExecutor(QMap<int, cg::Shape *> &shapes);
+    ~ScriptExecutor();
+
+    void drawLine(int id, const QPointF &p1, const QPointF &p2,
+                  const QColor &color, const QString &alg);
+    void drawPolygon(int id, const QVector<QPointF> &points,
+                     const QColor &color, const QString &alg);
+    void drawEllipse(int id, const QPointF &center, double rx, double ry,
+                     const QColor &color);
+    void drawCurve(int id, const QVector<QPointF> &points,
+                   const QColor &color, const QString &alg);
+    void translate(int id, const QPointF &d);
+    /* r is in anticlockwise radians, as Shape::rotate() takes it. */
+    void rotate(int id, const QPointF &c, double r);
+    void scale(int id, const QPointF &c, double s);
+    void clip(int id, const QPointF &p1, const QPointF &p2,
+              const QString &alg);
+
+    /* Runs every queued command and updates the table of shapes. Given
+     * ids, appends the id of every shape the commands ran on. */
+    void flush(QVector<int> *ids = nullptr);
+
+    /* Limits the threads flush() runs on, the calling thread included. */
+    void setMaxThreadCount(int count) { pool.setMaxThreadCount(count); }
+
+private:
+    /* Below this many commands per worker the pool costs more than it
+     * saves. */
+    enum { MIN_COMMANDS_PER_TASK = 1024 };
+
+    struct Command {
+        enum Type {
+            LINE, POLYGON, ELLIPSE, CURVE, TRANSLATE, ROTATE, SCALE, CLIP
+        } type;
+        int id;
+        int next;                   /* next command on the shape, or -1 */
+        QPointF p1, p2;             /* endpoints, center or offset */
+        double a, b;                /* radii, angle or factor */
+        QVector<QPointF> points;
+        QColor color;
+        QString alg;
+    };
+
+    struct Chain {
+        int id;
+        int first, last;            /* indices into commands */
+        int length;
+        cg::Shape *shape;           /* the result once run */
+    };
+
+    class Task;
+
+    Command &append(int id, Command::Type type);
+    void runChains(int begin, int end, QVector<int> &failed);
+
+    QMap<int, cg::Shape *> &shapes;
+    QVector<Command> commands;      /* in script order */
+    QVector<Chain> chains;          /* in order of first command */
+    QHash<int, int> chainOf;        /* id to index into chains */
+    QThreadPool pool;
+};
+
+#endif // SCRIPTEXECUTOR_H
@@ -0,0 +1,266 @@
+#include "scriptgenerator.h"
+
+#include <QFile>
+#include <QTextStream>
+#include <QtMath>
+
+#include <cstdio>
+#include <iostream>
+using std::cerr;
+using std::endl;
+
+ScriptGenerator::ScriptGenerator()
+    : seed(1), shapeCount(1000), canvasSize(1024, 768), distribution(UNIFORM),
+      spill(0.1), maxPoints(8), transformDensity(0.0), saveInterval(0)
+{
+    mix[LINE] = 5;
+    mix[POLYGON] = 2;
+    mix[ELLIPSE] = 2;
+    mix[CURVE] = 1;
+}
+
+int ScriptGenerator::exec(const QStringList &args)
+{
+    QString outFile;
+    for (int i = 0; i < args.size(); ++i) {
+        const QString &arg = args[i];
+        bool hasValue = i + 1 < args.size();
+        bool ok = hasValue;
+        if (arg == "--seed" && hasValue) {
+            seed = args[++i].toUInt(&ok);
+        }
+        else if (arg == "--shapes" && hasValue) {
+            shapeCount = args[++i].toInt(&ok);
+            ok = ok && shapeCount >= 0;
+        }
+        else if (arg == "--mix" && hasValue) {
+            ok = parseMix(args[++i]);
+        }
+        else if (arg == "--canvas" && hasValue) {
+            ok = parseCanvas(args[++i]);
+        }
+        else if (arg == "--coords" && hasValue) {
+            QString value = args[++i];
+            if (value == "uniform")
+                distribution = UNIFORM;
+            else if (value == "clustered")
+                distribution = CLUSTERED;
+            else
+                ok = false;
+        }
+        else if (arg == "--spill" && hasValue) {
+            spill = args[++i].toDouble(&ok) / 100;
+            ok = ok && spill >= 0;
+        }
+        else if (arg == "--max-points" && hasValue) {
+            maxPoints = args[++i].toInt(&ok);
+            ok = ok && maxPoints >= 3;
+        }
+        else if (arg == "--transforms" && hasValue) {
+            transformDensity = args[++i].toDouble(&ok);
+            ok = ok && transformDensity >= 0;
+        }
+        else if (arg == "--saves" && hasValue) {
+            saveInterval = args[++i].toInt(&ok);
+            ok = ok && saveInterval >= 0;
+        }
+        else if (!arg.startsWith("--") && outFile.isEmpty()) {
+            outFile = arg;
+            ok = true;
+        }
+        else {
+            ok = false;
+        }
+
+        if (!ok) {
+            cerr << "Generate error: invalid argument: " << qPrintable(arg);
+            if (hasValue && arg.startsWith("--"))
+                cerr << ' ' << qPrintable(args[i]);
+            cerr << endl;
+            return 1;
+        }
+    }
+    if (outFile.isEmpty()) {
+        cerr << "Generate error: an output file or - expected." << endl;
+        return 1;
+    }
+
+    QFile file(outFile);
+    bool opened = outFile == "-" ? file.open(stdout, QIODevice::WriteOnly)
+                                 : file.open(QIODevice::WriteOnly);
+    if (!opened) {
+        cerr << "Cannot open file: " << qPrintable(file.errorString()) << endl;
+        return 1;
+    }
+    QTextStream out(&file);
+    generate(out);
+    out.flush();
+    return 0;
+}
+
+void ScriptGenerator::generate(QTextStream &out)
+{
+    static const char *lineAlgorithms[] = { "DDA", "Bresenham" };
+    static const char *curveAlgorithms[] = { "Bezier", "B-spline" };
+
+    random.seed(seed);
+    int width = canvasSize.width(), height = canvasSize.height();
+    clusters.clear();
+    for (int i = 0; i < CLUSTER_COUNT; ++i)
+        clusters.append(QPoint(random.bounded(width), random.bounded(height)));
+
+    out << "resetCanvas " << width << ' ' << height << '\n';
+    int saves = 0;
+    for (int id = 1; id <= shapeCount; ++id) {
+        if ((id - 1) % COLOR_PERIOD == 0) {
+            out << "setColor " << random.bounded(256) << ' '
+                << random.bounded(256) << ' ' << random.bounded(256) << '\n';
+        }
+
+        switch (nextType()) {
+        case LINE: {
+            QPoint p1 = nextPoint(), p2 = nextPoint();
+            out << "drawLine " << id << ' ' << p1.x() << ' ' << p1.y() << ' '
+                << p2.x() << ' ' << p2.y() << ' '
+                << lineAlgorithms[random.bounded(2)] << '\n';
+            break;
+        }
+        case POLYGON: {
+            int n = random.bounded(3, maxPoints + 1);
+            out << "drawPolygon " << id << ' ' << n << ' '
+                << lineAlgorithms[random.bounded(2)] << '\n';
+            writePoints(out, n);
+            break;
+        }
+        case ELLIPSE: {
+            QPoint c = nextPoint();
+            int maxRadius = qMax(1, qMin(width, height) / 8);
+            out << "drawEllipse " << id << ' ' << c.x() << ' ' << c.y() << ' '
+                << random.bounded(1, maxRadius + 1) << ' '
+                << random.bounded(1, maxRadius + 1) << '\n';
+            break;
+        }
+        case CURVE: {
+            int n = random.bounded(2, maxPoints + 1);
+            out << "drawCurve " << id << ' ' << n << ' '
+                << curveAlgorithms[random.bounded(2)] << '\n';
+            writePoints(out, n);
+            break;
+        }
+        default:
+            Q_ASSERT(0); /* Should not reach here */ break;
+        }
+
+        int transforms = static_cast<int>(transformDensity);
+        if (random.generateDouble() < transformDensity - transforms)
+            ++transforms;
+        for (int i = 0; i < transforms; ++i)
+            writeTransform(out, id);
+
+        if (saveInterval > 0 && id % saveInterval == 0 && id < shapeCount)
+            out << "saveCanvas gen_" << ++saves << '\n';
+    }
+    out << "saveCanvas gen_" << ++saves << '\n';
+}
+
+bool ScriptGenerator::parseMix(const QString &value)
+{
+    QStringList weights = value.split(',');
+    if (weights.size() != TYPE_COUNT)
+        return false;
+
+    int total = 0;
+    for (int i = 0; i < TYPE_COUNT; ++i) {
+        bool ok;
+        mix[i] = weights[i].toInt(&ok);
+        if (!ok || mix[i] < 0)
+            return false;
+        total += mix[i];
+    }
+    return total > 0;
+}
+
+bool ScriptGenerator::parseCanvas(const QString &value)
+{
+    QStringList size = value.split('x');
+    if (size.size() != 2)
+        return false;
+
+    bool widthOk, heightOk;
+    int width = size[0].toInt(&widthOk);
+    int height = size[1].toInt(&heightOk);
+    if (!widthOk || !heightOk || width <= 0 || height <= 0)
+        return false;
+    canvasSize = QSize(width, height);
+    return true;
+}
+
+int ScriptGenerator::nextType()
+{
+    int total = 0;
+    for (int weight : mix)
+        total += weight;
+
+    int r = random.bounded(total);
+    for (int type = 0; type < TYPE_COUNT; ++type) {
+        if (r < mix[type])
+            return type;
+        r -= mix[type];
+    }
+    Q_ASSERT(0); /* Should not reach here */
+    return LINE;
+}
+
+QPoint ScriptGenerator::nextPoint()
+{
+    int width = canvasSize.width(), height = canvasSize.height();
+    int dx = qRound(spill * width), dy = qRound(spill * height);
+
+    if (distribution == CLUSTERED) {
+        /* Normally distributed around a cluster, by Box-Muller. */
+        QPoint c = clusters[random.bounded(static_cast<int>(CLUSTER_COUNT))];
+        double sigma = qMin(width, height) / 10.0;
+        double r = sigma * qSqrt(-2 * qLn(1 - random.generateDouble()));
+        double angle = 2 * M_PI * random.generateDouble();
+        int x = c.x() + qRound(r * qCos(angle));
+        int y = c.y() + qRound(r * qSin(angle));
+        return QPoint(qBound(-dx, x, width - 1 + dx),
+                      qBound(-dy, y, height - 1 + dy));
+    }
+    return QPoint(random.bounded(-dx, width + dx),
+                  random.bounded(-dy, height + dy));
+}
+
+void ScriptGenerator::writePoints(QTextStream &out, int n)
+{
+    for (int i = 0; i < n; ++i) {
+        QPoint p = nextPoint();
+        if (i > 0)
+            out << ' ';
+        out << p.x() << ' ' << p.y();
+    }
+    out << '\n';
+}
+
+void ScriptGenerator::writeTransform(QTextStream &out, int lastId)
+{
+    int id = random.bounded(1, lastId + 1);
+    int kind = random.bounded(20);
+    if (kind < 10) {
+        int dx = qMax(1, canvasSize.width() / 8);
+        int dy = qMax(1, canvasSize.height() / 8);
+        out << "translate " << id << ' ' << random.bounded(-dx, dx + 1) << ' '
+            << random.bounded(-dy, dy + 1) << '\n';
+        return;
+    }
+
+    QPoint c = nextPoint();
+    if (kind < 17) {
+        out << "rotate " << id << ' ' << c.x() << ' ' << c.y() << ' '
+            << random.bounded(-180, 181) << '\n';
+    }
+    else {
+        out << "scale " << id << ' ' << c.x() << ' ' << c.y() << ' '
+            << random.bounded(50, 201) / 100.0 << '\n';
+    }
+}
@@ -0,0 +1,60 @@
+#ifndef SCRIPTGENERATOR_H
+#define SCRIPTGENERATOR_H
+
+#include <QRandomGenerator>
+#include <QPoint>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+class QTextStream;
+
+/* Writes random but reproducible drawing scripts for benchmarks.
+ *
+ * The same seed and options always give the same script. Shapes are
+ * drawn with the given mix of types, and each is followed by a random
+ * number of transforms of earlier shapes averaging the transform
+ * density. The canvas is saved every few shapes and once at the end.
+ * Writing to "-" streams the script to standard output, so it can be
+ * piped into the command line interface. */
+class ScriptGenerator
+{
+public:
+    ScriptGenerator();
+
+    int exec(const QStringList &args);
+    void generate(QTextStream &out);
+
+private:
+    // enum for shape types, in the order of --mix
+    enum { LINE, POLYGON, ELLIPSE, CURVE, TYPE_COUNT };
+
+    // enum for coordinate distributions
+    enum { UNIFORM, CLUSTERED };
+
+    enum { CLUSTER_COUNT = 8, COLOR_PERIOD = 16 };
+
+    bool parseMix(const QString &value);
+    bool parseCanvas(const QString &value);
+
+    int nextType();
+    QPoint nextPoint();
+    void writePoints(QTextStream &out, int n);
+    void writeTransform(QTextStream &out, int lastId);
+
+    QRandomGenerator random;
+    quint32 seed;
+    int shapeCount;
+    int mix[TYPE_COUNT];
+    QSize canvasSize;
+    int distribution;
+    double spill;           /* part of the canvas size points may fall outside */
+    int maxPoints;          /* for polygons and curves */
+    double transformDensity;
+    int saveInterval;       /* shapes between saves; 0 saves only at the end */
+
+    QVector<QPoint> clusters;
+};
+
+#endif // SCRIPTGENERATOR_H
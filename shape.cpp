@@ -3,25 +3,60 @@
 
 namespace cg {
 
-Shape::Shape()
-    : duringTransaction(false), autoCenter(true)
+Shape::Shape(const QColor &color, const QString &algorithm)
+    : backup(nullptr), rgb(color.rgb()), alg(parseAlgorithm(algorithm)),
+      autoCenter(true)
 {
 
 }
 
+Shape::Shape(const Shape &other)
+    : backup(nullptr), center(other.center), rgb(other.rgb), alg(other.alg),
+      autoCenter(other.autoCenter)
+{
+
+}
+
+Shape::~Shape()
+{
+    delete backup;
+}
+
 void Shape::beginTransaction()
 {
-    duringTransaction = true;
+    delete backup;
+    backup = clone();
 }
 
 void Shape::commitTransaction()
 {
-    duringTransaction = false;
+    delete backup;
+    backup = nullptr;
 }
 
 void Shape::rollbackTransaction()
 {
-    duringTransaction = false;
+    if (!backup)
+        return;
+
+    /* The center is not part of a transaction. */
+    Shape *old = backup;
+    backup = nullptr;
+    QPoint oldCenter = center;
+    bool oldAutoCenter = autoCenter;
+    swapState(*old);
+    center = oldCenter;
+    autoCenter = oldAutoCenter;
+    delete old;
+}
+
+void Shape::swapState(Shape &other)
+{
+    qSwap(backup, other.backup);
+    qSwap(center, other.center);
+    qSwap(rgb, other.rgb);
+    qSwap(alg, other.alg);
+    qSwap(autoCenter, other.autoCenter);
 }
 
 QPoint Shape::getCenter()
@@ -35,4 +70,33 @@ void Shape::setCenter(const QPoint &newCenter)
     autoCenter = utils::isClose(getRectHull().center(), center, 6);
 }
 
+Algorithm Shape::parseAlgorithm(const QString &name)
+{
+    if (name == "DDA")
+        return Algorithm::DDA;
+    if (name == "Bresenham")
+        return Algorithm::BRESENHAM;
+    if (name == "Bezier")
+        return Algorithm::BEZIER;
+    if (name == "B-spline")
+        return Algorithm::B_SPLINE;
+    return Algorithm::DEFAULT;
+}
+
+QString Shape::algorithmName(Algorithm alg)
+{
+    switch (alg) {
+    case Algorithm::DDA:
+        return "DDA";
+    case Algorithm::BRESENHAM:
+        return "Bresenham";
+    case Algorithm::BEZIER:
+        return "Bezier";
+    case Algorithm::B_SPLINE:
+        return "B-spline";
+    default:
+        return QString();
+    }
+}
+
 }
@@ -4,37 +4,76 @@
 #include <QString>
 #include <QRect>
 #include <QPoint>
+#include <QPointF>
+#include <QColor>
 
 class QImage;
 
 namespace cg {
 
+class ShapeStore;
+
+/* Drawing algorithms, resolved once from their names in scripts. */
+enum class Algorithm : quint8 {
+    DEFAULT, DDA, BRESENHAM, BEZIER, B_SPLINE,
+};
+
+/* The state common to all shapes. The color is kept packed and the
+ * algorithm resolved, so that a shape holds no heap data of its own. */
 class Shape
 {
 public:
-    Shape();
-    virtual ~Shape() = default;
+    Shape(const QColor &color, const QString &algorithm);
+    Shape(const Shape &other);
+    Shape &operator=(const Shape &) = delete;
+    virtual ~Shape();
 
     virtual QString shapeName() = 0;
 
-    virtual void beginTransaction();
-    virtual void commitTransaction();
-    virtual void rollbackTransaction();
+    /* A copy of this shape. Vertex arrays are shared until either
+     * copy changes them. */
+    virtual Shape *clone() const = 0;
+    /* Exchange the whole state with other, which must be a shape of
+     * the same type. */
+    virtual void swapState(Shape &other);
+    /* An estimate of the memory held by this shape. */
+    virtual qint64 sizeInBytes() const = 0;
+
+    /* Append this shape to a store for batched rendering. */
+    virtual void appendTo(ShapeStore &store) = 0;
+
+    /* A transaction keeps a clone of the shape as it began, which
+     * transforms start from. The clone is freed when it ends. */
+    void beginTransaction();
+    void commitTransaction();
+    void rollbackTransaction();
 
     virtual void draw(QImage &canvas) = 0;
-    virtual void translate(const QPoint &d) = 0;
-    virtual void rotate(const QPoint &c, double r) = 0;
-    virtual void scale(const QPoint &c, double s) = 0;
+    /* Shapes keep their coordinates in 24.8 fixed point, as the store
+     * does, and each transform rounds back to it. Transforms within a
+     * transaction start from the backup, so a drag rounds only once. */
+    virtual void translate(const QPointF &d) = 0;
+    virtual void rotate(const QPointF &c, double r) = 0;
+    virtual void scale(const QPointF &c, double s) = 0;
+    virtual Shape *clip(const QPointF &p1, const QPointF &p2,
+                        const QString &alg) = 0;
 
+    /* In pixels, as the shape is drawn. */
     virtual QRect getRectHull() = 0;
 
     virtual QPoint getCenter();
     virtual void setCenter(const QPoint &newCenter);
 
+    static Algorithm parseAlgorithm(const QString &name);
+    /* The name parseAlgorithm() maps to alg; empty for the default. */
+    static QString algorithmName(Algorithm alg);
+
 protected:
-    bool duringTransaction;
+    Shape *backup;          /* null outside of a transaction */
 
     QPoint center;
+    QRgb rgb;
+    Algorithm alg;
     bool autoCenter;
 };
 
@@ -0,0 +1,192 @@
+#include "shapelistmodel.h"
+
+#include <QMetaObject>
+#include <QtDebug>
+
+#include <algorithm>
+
+namespace {
+
+struct IdLess
+{
+    template <typename Entry>
+    bool operator()(const Entry &entry, int id) const { return entry.id < id; }
+};
+
+}
+
+ShapeListModel::ShapeListModel(QObject *parent)
+    : QAbstractListModel(parent), nextId(1), flushScheduled(false)
+{
+
+}
+
+int ShapeListModel::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : entries.size();
+}
+
+QVariant ShapeListModel::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || role != Qt::DisplayRole)
+        return QVariant();
+
+    const Entry &entry = entries[rowOf(index.row())];
+    return entry.shape->shapeName() + " " + QString::number(entry.id);
+}
+
+void ShapeListModel::addShape(cg::Shape *shape)
+{
+    if (!shape) {
+        qDebug("addShape(nullptr)");
+        return;
+    }
+
+    Entry entry = { shape, nextId++ };
+    ids.insert(shape, entry.id);
+    pendingAdditions.append(entry);
+    scheduleFlush();
+}
+
+void ShapeListModel::removeShape(cg::Shape *shape)
+{
+    if (!shape) {
+        qDebug("removeShape(nullptr)");
+        return;
+    }
+
+    auto iter = ids.find(shape);
+    if (iter == ids.end()) {
+        qDebug("Can't find shape to remove!");
+        return;
+    }
+    int id = iter.value();
+    ids.erase(iter);
+
+    /* A shape removed before it was listed is just dropped from the queue. */
+    if (!pendingAdditions.isEmpty() && id >= pendingAdditions.first().id) {
+        auto pending = std::lower_bound(pendingAdditions.begin(),
+                                        pendingAdditions.end(), id, IdLess());
+        Q_ASSERT(pending != pendingAdditions.end() && pending->id == id);
+        pendingAdditions.erase(pending);
+        return;
+    }
+    pendingRemovals.append(id);
+    scheduleFlush();
+}
+
+void ShapeListModel::clear()
+{
+    beginResetModel();
+    entries.clear();
+    ids.clear();
+    pendingAdditions.clear();
+    pendingRemovals.clear();
+    endResetModel();
+}
+
+cg::Shape *ShapeListModel::shapeAt(const QModelIndex &index) const
+{
+    if (!index.isValid())
+        return nullptr;
+    return entries[rowOf(index.row())].shape;
+}
+
+QModelIndex ShapeListModel::indexOf(cg::Shape *shape)
+{
+    if (!shape)
+        return QModelIndex();
+
+    flush();
+    auto iter = ids.constFind(shape);
+    if (iter == ids.constEnd())
+        return QModelIndex();
+    int entry = entryOf(iter.value());
+    Q_ASSERT(entry >= 0);
+    return index(rowOf(entry));
+}
+
+void ShapeListModel::flush()
+{
+    flushRemovals();
+    flushAdditions();
+    flushScheduled = false;
+}
+
+void ShapeListModel::scheduleFlush()
+{
+    if (!flushScheduled) {
+        flushScheduled = true;
+        QMetaObject::invokeMethod(this, "flush", Qt::QueuedConnection);
+    }
+}
+
+void ShapeListModel::flushRemovals()
+{
+    if (pendingRemovals.isEmpty())
+        return;
+
+    std::sort(pendingRemovals.begin(), pendingRemovals.end());
+    QVector<int> removed;   /* entries, ascending */
+    removed.reserve(pendingRemovals.size());
+    for (int id : pendingRemovals) {
+        removed.append(entryOf(id));
+        Q_ASSERT(removed.back() >= 0);
+    }
+    pendingRemovals.clear();
+
+    int runs = 0;
+    for (int i = 0; i < removed.size(); ++i) {
+        if (i == 0 || removed[i] != removed[i - 1] + 1)
+            ++runs;
+    }
+
+    if (runs > MAX_REMOVED_RUNS) {
+        /* One pass over the entries beats many row removals. */
+        beginResetModel();
+        int kept = 0, next = 0;
+        for (int i = 0; i < entries.size(); ++i) {
+            if (next < removed.size() && removed[next] == i)
+                ++next;
+            else
+                entries[kept++] = entries[i];
+        }
+        entries.resize(kept);
+        endResetModel();
+        return;
+    }
+
+    /* Remove the runs from the top row down, so that the entries of the
+     * runs still to remove keep their indices. */
+    int i = removed.size();
+    while (i > 0) {
+        int last = removed[--i];
+        int first = last;
+        while (i > 0 && removed[i - 1] == first - 1)
+            first = removed[--i];
+
+        beginRemoveRows(QModelIndex(), rowOf(last), rowOf(first));
+        entries.remove(first, last - first + 1);
+        endRemoveRows();
+    }
+}
+
+void ShapeListModel::flushAdditions()
+{
+    if (pendingAdditions.isEmpty())
+        return;
+
+    /* The newest shapes go on top. */
+    beginInsertRows(QModelIndex(), 0, pendingAdditions.size() - 1);
+    entries += pendingAdditions;
+    endInsertRows();
+    pendingAdditions.clear();
+}
+
+int ShapeListModel::entryOf(int id) const
+{
+    auto entry = std::lower_bound(entries.begin(), entries.end(), id, IdLess());
+    if (entry == entries.end() || entry->id != id)
+        return -1;
+    return static_cast<int>(entry - entries.begin());
+}
@@ -0,0 +1,66 @@
+#ifndef SHAPELISTMODEL_H
+#define SHAPELISTMODEL_H
+
+#include "shape.h"
+
+#include <QAbstractListModel>
+#include <QVector>
+#include <QHash>
+
+/* Lists the shapes of a painter, newest first, for a QListView.
+ *
+ * Each shape is listed under its name and a serial id given when it is
+ * added. Rows are labelled on demand, so a row costs an entry of two words
+ * plus a hash node instead of a widget item. Entries are kept oldest first
+ * so that adding is an append; ids grow along them, so a shape's row is
+ * found by a hash lookup and a binary search.
+ *
+ * Additions and removals are queued and applied together when control
+ * returns to the event loop, so a clip of every shape notifies the view
+ * once rather than once per shape. */
+class ShapeListModel : public QAbstractListModel
+{
+    Q_OBJECT
+public:
+    explicit ShapeListModel(QObject *parent = nullptr);
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+    void addShape(cg::Shape *shape);
+    void removeShape(cg::Shape *shape);
+    void clear();
+
+    cg::Shape *shapeAt(const QModelIndex &index) const;
+    /* Applies the queued changes first. */
+    QModelIndex indexOf(cg::Shape *shape);
+
+public slots:
+    void flush();
+
+private:
+    /* Above this many runs of removed rows, reset the model instead of
+     * removing the runs one by one. */
+    enum { MAX_REMOVED_RUNS = 16 };
+
+    struct Entry {
+        cg::Shape *shape;
+        int id;
+    };
+
+    void scheduleFlush();
+    void flushRemovals();
+    void flushAdditions();
+    int entryOf(int id) const;
+    int rowOf(int entry) const { return entries.size() - 1 - entry; }
+
+    QVector<Entry> entries;         /* listed, oldest first */
+    QHash<cg::Shape *, int> ids;    /* listed or queued */
+    int nextId;
+
+    QVector<Entry> pendingAdditions;
+    QVector<int> pendingRemovals;   /* ids of listed shapes */
+    bool flushScheduled;
+};
+
+#endif // SHAPELISTMODEL_H
@@ -0,0 +1,934 @@
+#include "shapestore.h"
+#include "fixedpoint.h"
+#include "line.h"
+#include "polygon.h"
+#include "ellipse.h"
+#include "curve.h"
+#include "polyline.h"
+#include "tiledcanvas.h"
+#include "trace.h"
+
+#include <QImage>
+#include <QRectF>
+#include <QtMath>
+
+#include <algorithm>
+
+namespace cg {
+
+namespace {
+
+/* Trace names of batches, in the order of ShapeStore's enum. */
+const char *const BATCH_NAMES[] = {
+    "draw lines", "draw polygons", "draw ellipses", "draw curves",
+    "draw polylines"
+};
+
+/* The scalings of draw() and drawScaled(), applied to 24.8 fixed point
+ * records as they are drawn. */
+class Unscaled
+{
+public:
+    QPoint point(const QPoint &p) const { return p; }
+    int length(int v) const { return v; }
+    const QPoint *path(const QPoint *points, int, QVector<QPoint> &) const
+    {
+        return points;
+    }
+};
+
+/* Pixel x spans [x - 0.5, x + 0.5), so scaling the canvas about its top
+ * left corner maps x to scale * (x + 0.5) - 0.5. */
+class PixelScale
+{
+public:
+    explicit PixelScale(double scale) : scale(scale) {}
+
+    QPoint point(const QPoint &p) const
+    {
+        return QPoint(coordinate(p.x()), coordinate(p.y()));
+    }
+    int length(int v) const
+    {
+        return fixed::fromReal(fixed::toReal(v) * scale);
+    }
+    /* Scales the points into buffer and returns its data. */
+    const QPoint *path(const QPoint *points, int n,
+                       QVector<QPoint> &buffer) const
+    {
+        buffer.resize(n);
+        for (int i = 0; i < n; ++i)
+            buffer[i] = point(points[i]);
+        return buffer.constData();
+    }
+
+private:
+    int coordinate(int v) const
+    {
+        return fixed::fromReal(scale * (fixed::toReal(v) + 0.5) - 0.5);
+    }
+
+    double scale;
+};
+
+}
+
+ShapeStore::ShapeStore()
+    : shapeCount(0), target(-1), appending(false), isPacked(true),
+      garbageRecords(0), garbageVertices(0), recording(false)
+{
+
+}
+
+void ShapeStore::clear()
+{
+    lines.clear();
+    polygons.clear();
+    ellipses.clear();
+    curves.clear();
+    polylines.clear();
+    vertices.clear();
+    shapeSlots.clear();
+    order.clear();
+    freeHandles.clear();
+    shapeCount = 0;
+    isPacked = true;
+    garbageRecords = 0;
+    garbageVertices = 0;
+
+    if (recording) {
+        log = Changes();
+        log.reset = true;
+        lastEdit.clear();
+    }
+}
+
+int ShapeStore::insert(int position, Shape &shape)
+{
+    Q_ASSERT(position >= 0 && position <= shapeCount);
+    openSlot(newHandle());
+    shape.appendTo(*this);
+    Q_ASSERT(shapeSlots[target].kind != REMOVED);
+
+    int handle = target;
+    target = -1;
+    closeSlot(handle, position);
+    return handle;
+}
+
+void ShapeStore::update(int handle, Shape &shape)
+{
+    Q_ASSERT(shapeSlots[handle].kind != REMOVED);
+    target = handle;
+    shape.appendTo(*this);
+    target = -1;
+    logEdit(Edit::UPDATE, handle, -1);
+    collectGarbage();
+}
+
+void ShapeStore::remove(int handle)
+{
+    Slot &slot = shapeSlots[handle];
+    Q_ASSERT(slot.kind != REMOVED);
+    releaseRecords(slot);
+    slot.kind = REMOVED;
+    --shapeCount;
+    logEdit(Edit::REMOVE, handle, -1);
+    collectGarbage();
+}
+
+void ShapeStore::setRecording(bool on)
+{
+    recording = on;
+    if (!on) {
+        log = Changes();
+        lastEdit.clear();
+    }
+}
+
+ShapeStore::Changes ShapeStore::takeChanges()
+{
+    Changes changes;
+    changes.reset = log.reset;
+    changes.edits.swap(log.edits);
+    changes.lines.swap(log.lines);
+    changes.ellipses.swap(log.ellipses);
+    changes.paths.swap(log.paths);
+    changes.vertices.swap(log.vertices);
+    log.reset = false;
+    lastEdit.clear();
+    return changes;
+}
+
+void ShapeStore::apply(const Changes &changes)
+{
+    if (changes.isEmpty())
+        return;
+    TRACE_SCOPE("ShapeStore::apply");
+    if (changes.reset)
+        clear();
+
+    for (const Edit &edit : changes.edits) {
+        switch (edit.type) {
+        case Edit::INSERT:
+            openSlot(edit.handle);
+            fillFromEdit(changes, edit);
+            target = -1;
+            closeSlot(edit.handle, edit.position);
+            break;
+        case Edit::UPDATE:
+            target = edit.handle;
+            fillFromEdit(changes, edit);
+            target = -1;
+            logEdit(Edit::UPDATE, edit.handle, -1);
+            collectGarbage();
+            break;
+        case Edit::REMOVE:
+            remove(edit.handle);
+            break;
+        }
+    }
+
+    /* Handles come from the store the changes were taken from, so any
+     * freed here may be in use there. */
+    freeHandles.clear();
+}
+
+void ShapeStore::addLine(const QPoint &p1, const QPoint &p2,
+                         QRgb rgb, Algorithm alg)
+{
+    LineRecord record = { p1, p2, rgb, alg };
+    *claimRecords(lines, LINE, 1) = record;
+    finishAdd();
+}
+
+void ShapeStore::addPolygon(const QVector<QPoint> &points,
+                            QRgb rgb, Algorithm alg)
+{
+    setPath(*claimRecords(polygons, POLYGON, 1),
+            points.constData(), points.size(), rgb, alg);
+    finishAdd();
+}
+
+void ShapeStore::addEllipse(const QPoint &center, int rx, int ry,
+                            double theta, QRgb rgb)
+{
+    EllipseRecord record = { center, rx, ry, theta, rgb };
+    *claimRecords(ellipses, ELLIPSE, 1) = record;
+    finishAdd();
+}
+
+void ShapeStore::addCurve(const QVector<QPoint> &controls,
+                          QRgb rgb, Algorithm alg)
+{
+    setPath(*claimRecords(curves, CURVE, 1),
+            controls.constData(), controls.size(), rgb, alg);
+    finishAdd();
+}
+
+void ShapeStore::addPolyline(const QVector<QVector<QPoint>> &runs,
+                             QRgb rgb, Algorithm alg)
+{
+    PathRecord *records = claimRecords(polylines, POLYLINE, runs.size());
+    for (int i = 0; i < runs.size(); ++i)
+        setPath(records[i], runs[i].constData(), runs[i].size(), rgb, alg);
+    finishAdd();
+}
+
+int ShapeStore::newHandle()
+{
+    return freeHandles.isEmpty() ? shapeSlots.size() : freeHandles.takeLast();
+}
+
+/* Makes handle the empty slot that add*() fill. */
+void ShapeStore::openSlot(int handle)
+{
+    Slot empty = { REMOVED, 0, 0, false };
+    while (shapeSlots.size() <= handle)
+        shapeSlots.append(empty);
+
+    /* A store replaying changes may still list a handle that the store
+     * they came from has already reused. */
+    if (shapeSlots[handle].listed)
+        dropRemoved();
+    Q_ASSERT(shapeSlots[handle].kind == REMOVED);
+    shapeSlots[handle] = empty;
+    target = handle;
+}
+
+void ShapeStore::closeSlot(int handle, int position)
+{
+    /* Removed shapes still in order would throw the position off. */
+    if (position == shapeCount) {
+        order.append(handle);
+    }
+    else {
+        dropRemoved();
+        order.insert(position, handle);
+        isPacked = false;
+    }
+    shapeSlots[handle].listed = true;
+    ++shapeCount;
+    logEdit(Edit::INSERT, handle, position);
+}
+
+/* A shape added outside insert() and update() goes to the end of the
+ * drawing order once its records are written. */
+int ShapeStore::targetSlot()
+{
+    if (target < 0) {
+        openSlot(newHandle());
+        appending = true;
+    }
+    return target;
+}
+
+void ShapeStore::finishAdd()
+{
+    if (!appending)
+        return;
+    int handle = target;
+    target = -1;
+    appending = false;
+    closeSlot(handle, shapeCount);
+}
+
+/* Returns the count records of the target slot, keeping the ones it has
+ * if they are as many and of the same type. */
+template <typename Record>
+Record *ShapeStore::claimRecords(QVector<Record> &records, int kind, int count)
+{
+    int handle = targetSlot();
+    Slot &slot = shapeSlots[handle];
+    if (slot.kind != kind || slot.count != count) {
+        releaseRecords(slot);
+        slot.kind = kind;
+        slot.first = records.size();
+        slot.count = count;
+        records.insert(slot.first, count, Record());
+    }
+    return records.data() + slot.first;
+}
+
+void ShapeStore::releaseRecords(const Slot &slot)
+{
+    const QVector<PathRecord> *paths = nullptr;
+    switch (slot.kind) {
+    case POLYGON:
+        paths = &polygons; break;
+    case CURVE:
+        paths = &curves; break;
+    case POLYLINE:
+        paths = &polylines; break;
+    case REMOVED:
+        return;
+    default:
+        break;
+    }
+
+    garbageRecords += slot.count;
+    if (paths) {
+        const PathRecord *record = paths->constData() + slot.first;
+        for (int i = 0; i < slot.count; ++i)
+            garbageVertices += record[i].count;
+    }
+    isPacked = false;
+}
+
+/* Writes the vertices over the record's old ones if there are as many,
+ * else after the end of the pool. */
+void ShapeStore::setPath(PathRecord &record, const QPoint *points, int n,
+                         QRgb rgb, Algorithm alg)
+{
+    if (record.count != n) {
+        if (record.count > 0) {
+            garbageVertices += record.count;
+            isPacked = false;
+        }
+        record.first = vertices.size();
+        record.count = n;
+        vertices.resize(record.first + record.count);
+    }
+    record.rgb = rgb;
+    record.alg = alg;
+    record.hull = QRect();
+    if (n == 0)
+        return;
+
+    QPoint *out = vertices.data() + record.first;
+    QPoint topLeft = points[0], bottomRight = topLeft;
+    for (int i = 0; i < n; ++i) {
+        const QPoint &p = points[i];
+        topLeft.rx() = qMin(topLeft.x(), p.x());
+        topLeft.ry() = qMin(topLeft.y(), p.y());
+        bottomRight.rx() = qMax(bottomRight.x(), p.x());
+        bottomRight.ry() = qMax(bottomRight.y(), p.y());
+        out[i] = p;
+    }
+    record.hull = QRect(fixed::toPixel(topLeft), fixed::toPixel(bottomRight));
+}
+
+/* Logs an edit just made, with a copy of the records it wrote. An update
+ * rewrites the copy of the shape's last logged edit instead, as nothing
+ * logged after that edit depends on the shape's records. */
+void ShapeStore::logEdit(Edit::Type type, int handle, int position)
+{
+    if (!recording)
+        return;
+
+    if (type == Edit::REMOVE) {
+        lastEdit.remove(handle);
+    }
+    else if (type == Edit::UPDATE && lastEdit.contains(handle)) {
+        copyRecords(handle, log.edits[lastEdit.value(handle)]);
+        return;
+    }
+    Edit edit = { type, handle, position, REMOVED, 0, 0 };
+    if (type != Edit::REMOVE) {
+        copyRecords(handle, edit);
+        lastEdit.insert(handle, log.edits.size());
+    }
+    log.edits.append(edit);
+}
+
+/* Copies the records of handle into the log, over the ones edit already
+ * has there if they are of the same size. */
+void ShapeStore::copyRecords(int handle, Edit &edit)
+{
+    const Slot &slot = shapeSlots[handle];
+    bool fresh = edit.kind != slot.kind || edit.count != slot.count;
+    edit.kind = slot.kind;
+    edit.count = slot.count;
+
+    const QVector<PathRecord> *paths = nullptr;
+    switch (slot.kind) {
+    case LINE:
+        if (fresh) {
+            edit.first = log.lines.size();
+            log.lines.resize(edit.first + 1);
+        }
+        log.lines[edit.first] = lines.at(slot.first);
+        return;
+    case ELLIPSE:
+        if (fresh) {
+            edit.first = log.ellipses.size();
+            log.ellipses.resize(edit.first + 1);
+        }
+        log.ellipses[edit.first] = ellipses.at(slot.first);
+        return;
+    case POLYGON:
+        paths = &polygons; break;
+    case CURVE:
+        paths = &curves; break;
+    case POLYLINE:
+        paths = &polylines; break;
+    default:
+        Q_ASSERT(0); /* Should not reach here */ return;
+    }
+
+    if (fresh) {
+        edit.first = log.paths.size();
+        log.paths.resize(edit.first + edit.count);
+    }
+    const PathRecord *from = paths->constData() + slot.first;
+    PathRecord *to = log.paths.data() + edit.first;
+    for (int i = 0; i < edit.count; ++i) {
+        int first = to[i].first;
+        if (fresh || to[i].count != from[i].count) {
+            first = log.vertices.size();
+            log.vertices.resize(first + from[i].count);
+        }
+        to[i] = from[i];
+        to[i].first = first;
+        std::copy(vertices.constData() + from[i].first,
+                  vertices.constData() + from[i].first + from[i].count,
+                  log.vertices.data() + first);
+    }
+}
+
+/* Writes the records an edit logged into the target slot. */
+void ShapeStore::fillFromEdit(const Changes &changes, const Edit &edit)
+{
+    PathRecord *records = nullptr;
+    switch (edit.kind) {
+    case LINE:
+        *claimRecords(lines, LINE, 1) = changes.lines.at(edit.first);
+        return;
+    case ELLIPSE:
+        *claimRecords(ellipses, ELLIPSE, 1) = changes.ellipses.at(edit.first);
+        return;
+    case POLYGON:
+        records = claimRecords(polygons, POLYGON, edit.count); break;
+    case CURVE:
+        records = claimRecords(curves, CURVE, edit.count); break;
+    case POLYLINE:
+        records = claimRecords(polylines, POLYLINE, edit.count); break;
+    default:
+        Q_ASSERT(0); /* Should not reach here */ return;
+    }
+
+    const PathRecord *from = changes.paths.constData() + edit.first;
+    for (int i = 0; i < edit.count; ++i)
+        setPath(records[i], changes.vertices.constData() + from[i].first,
+                from[i].count, from[i].rgb, from[i].alg);
+}
+
+/* Takes the removed shapes out of the drawing order and frees their
+ * handles. */
+void ShapeStore::dropRemoved()
+{
+    if (order.size() == shapeCount)
+        return;
+
+    int n = 0;
+    for (int handle : order) {
+        Slot &slot = shapeSlots[handle];
+        if (slot.kind != REMOVED) {
+            order[n++] = handle;
+        }
+        else {
+            slot.listed = false;
+            freeHandles.append(handle);
+        }
+    }
+    order.resize(n);
+}
+
+/* Packs the store once half of a pool or of the order is garbage, so
+ * that the garbage stays within the size of the live scene. */
+void ShapeStore::collectGarbage()
+{
+    int records = lines.size() + polygons.size() + ellipses.size()
+            + curves.size() + polylines.size();
+    if (2 * garbageRecords > records || 2 * garbageVertices > vertices.size()
+            || 2 * shapeCount < order.size())
+        squeeze();
+}
+
+void ShapeStore::squeeze()
+{
+    TRACE_SCOPE("ShapeStore::squeeze");
+    dropRemoved();
+    if (isPacked)
+        return;
+
+    QVector<LineRecord> newLines;
+    QVector<PathRecord> newPolygons;
+    QVector<EllipseRecord> newEllipses;
+    QVector<PathRecord> newCurves;
+    QVector<PathRecord> newPolylines;
+    QVector<QPoint> newVertices;
+    newVertices.reserve(vertices.size() - garbageVertices);
+
+    for (int handle : order) {
+        Slot &slot = shapeSlots[handle];
+        const QVector<PathRecord> *paths = nullptr;
+        QVector<PathRecord> *newPaths = nullptr;
+        switch (slot.kind) {
+        case LINE:
+            newLines.append(lines.at(slot.first));
+            slot.first = newLines.size() - 1;
+            continue;
+        case ELLIPSE:
+            newEllipses.append(ellipses.at(slot.first));
+            slot.first = newEllipses.size() - 1;
+            continue;
+        case POLYGON:
+            paths = &polygons; newPaths = &newPolygons; break;
+        case CURVE:
+            paths = &curves; newPaths = &newCurves; break;
+        case POLYLINE:
+            paths = &polylines; newPaths = &newPolylines; break;
+        default:
+            Q_ASSERT(0); /* Should not reach here */ continue;
+        }
+
+        int first = newPaths->size();
+        for (int i = 0; i < slot.count; ++i) {
+            PathRecord record = paths->at(slot.first + i);
+            const QPoint *p = vertices.constData() + record.first;
+            record.first = newVertices.size();
+            for (int j = 0; j < record.count; ++j)
+                newVertices.append(p[j]);
+            newPaths->append(record);
+        }
+        slot.first = first;
+    }
+
+    lines.swap(newLines);
+    polygons.swap(newPolygons);
+    ellipses.swap(newEllipses);
+    curves.swap(newCurves);
+    polylines.swap(newPolylines);
+    vertices.swap(newVertices);
+    isPacked = true;
+    garbageRecords = 0;
+    garbageVertices = 0;
+}
+
+const ShapeStore::PathRecord *ShapeStore::pathRecords(int kind) const
+{
+    switch (kind) {
+    case POLYGON:
+        return polygons.constData();
+    case CURVE:
+        return curves.constData();
+    case POLYLINE:
+        return polylines.constData();
+    default:
+        Q_ASSERT(0); /* Should not reach here */ return nullptr;
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::draw(Canvas &canvas) const
+{
+    TRACE_SCOPE("ShapeStore::draw");
+    drawRuns(canvas, Unscaled());
+}
+
+template <typename Canvas>
+void ShapeStore::drawScaled(Canvas &canvas, double scale) const
+{
+    if (scale == 1.0) {
+        draw(canvas);
+        return;
+    }
+    TRACE_SCOPE("ShapeStore::drawScaled");
+    drawRuns(canvas, PixelScale(scale));
+}
+
+template <typename Canvas, typename Scaling>
+void ShapeStore::drawRuns(Canvas &canvas, const Scaling &scaling) const
+{
+    const Slot *slotOf = shapeSlots.constData();
+    const int *handle = order.constData(), *end = handle + order.size();
+
+    /* Each run of shapes of the same type is drawn by one loop. */
+    while (handle != end) {
+        const int *run = handle;
+        int kind = slotOf[*run].kind;
+        while (++handle != end && slotOf[*handle].kind == kind) {}
+        if (kind == REMOVED)
+            continue;
+
+        TRACE_SCOPE(BATCH_NAMES[kind]);
+        int count = static_cast<int>(handle - run);
+        switch (kind) {
+        case LINE:
+            drawLines(canvas, scaling, run, count); break;
+        case POLYGON:
+            drawPolygons(canvas, scaling, run, count); break;
+        case ELLIPSE:
+            drawEllipses(canvas, scaling, run, count); break;
+        case CURVE:
+            drawCurves(canvas, scaling, run, count); break;
+        case POLYLINE:
+            drawPolylines(canvas, scaling, run, count); break;
+        default:
+            Q_ASSERT(0); /* Should not reach here */ break;
+        }
+    }
+}
+
+template <typename Canvas, typename Scaling>
+void ShapeStore::drawLines(Canvas &canvas, const Scaling &scaling,
+                           const int *handles, int count) const
+{
+    const Slot *slotOf = shapeSlots.constData();
+    const LineRecord *records = lines.constData();
+    for (int i = 0; i < count; ++i) {
+        const LineRecord &record = records[slotOf[handles[i]].first];
+        Line::rasterizeFixed(canvas, scaling.point(record.p1),
+                             scaling.point(record.p2),
+                             record.rgb, record.alg);
+    }
+}
+
+template <typename Canvas, typename Scaling>
+void ShapeStore::drawPolygons(Canvas &canvas, const Scaling &scaling,
+                              const int *handles, int count) const
+{
+    QVector<QPoint> scaled;
+    const Slot *slotOf = shapeSlots.constData();
+    const PathRecord *records = polygons.constData();
+    for (int i = 0; i < count; ++i) {
+        const PathRecord &record = records[slotOf[handles[i]].first];
+        const QPoint *points = scaling.path(vertices.constData() + record.first,
+                                            record.count, scaled);
+        Polygon::rasterizeFixed(canvas, points, record.count,
+                                record.rgb, record.alg);
+    }
+}
+
+template <typename Canvas, typename Scaling>
+void ShapeStore::drawEllipses(Canvas &canvas, const Scaling &scaling,
+                              const int *handles, int count) const
+{
+    const Slot *slotOf = shapeSlots.constData();
+    const EllipseRecord *records = ellipses.constData();
+    for (int i = 0; i < count; ++i) {
+        const EllipseRecord &record = records[slotOf[handles[i]].first];
+        Ellipse::rasterizeFixed(canvas, scaling.point(record.center),
+                                scaling.length(record.rx),
+                                scaling.length(record.ry),
+                                record.theta, record.rgb);
+    }
+}
+
+template <typename Canvas, typename Scaling>
+void ShapeStore::drawCurves(Canvas &canvas, const Scaling &scaling,
+                            const int *handles, int count) const
+{
+    QVector<QPoint> scaled;
+    const Slot *slotOf = shapeSlots.constData();
+    const PathRecord *records = curves.constData();
+    for (int i = 0; i < count; ++i) {
+        const PathRecord &record = records[slotOf[handles[i]].first];
+        const QPoint *points = scaling.path(vertices.constData() + record.first,
+                                            record.count, scaled);
+        Curve::rasterizeFixed(canvas, points, record.count,
+                              record.rgb, record.alg);
+    }
+}
+
+template <typename Canvas, typename Scaling>
+void ShapeStore::drawPolylines(Canvas &canvas, const Scaling &scaling,
+                               const int *handles, int count) const
+{
+    QVector<QPoint> scaled;
+    for (int i = 0; i < count; ++i) {
+        const Slot &slot = shapeSlots.at(handles[i]);
+        const PathRecord *record = polylines.constData() + slot.first;
+        const PathRecord *end = record + slot.count;
+        for (; record != end; ++record) {
+            const QPoint *points = scaling.path(
+                        vertices.constData() + record->first,
+                        record->count, scaled);
+            Polyline::rasterizeFixed(canvas, points, record->count,
+                                     record->rgb, record->alg);
+        }
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::draw(Canvas &canvas, const Viewport &viewport) const
+{
+    if (viewport.isIdentity()) {
+        draw(canvas);
+        return;
+    }
+    if (canvas.width() <= 0 || canvas.height() <= 0)
+        return;
+
+    TRACE_SCOPE("ShapeStore::draw");
+    const Slot *slotOf = shapeSlots.constData();
+    const int *handle = order.constData(), *end = handle + order.size();
+
+    while (handle != end) {
+        const int *run = handle;
+        int kind = slotOf[*run].kind;
+        while (++handle != end && slotOf[*handle].kind == kind) {}
+        if (kind == REMOVED)
+            continue;
+
+        TRACE_SCOPE(BATCH_NAMES[kind]);
+        int count = static_cast<int>(handle - run);
+        switch (kind) {
+        case LINE:
+            drawLines(canvas, viewport, run, count); break;
+        case POLYGON:
+            drawPolygons(canvas, viewport, run, count); break;
+        case ELLIPSE:
+            drawEllipses(canvas, viewport, run, count); break;
+        case CURVE:
+            drawCurves(canvas, viewport, run, count); break;
+        case POLYLINE:
+            drawPolylines(canvas, viewport, run, count); break;
+        default:
+            Q_ASSERT(0); /* Should not reach here */ break;
+        }
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::drawLines(Canvas &canvas, const Viewport &viewport,
+                           const int *handles, int count) const
+{
+    const Slot *slotOf = shapeSlots.constData();
+    for (int j = 0; j < count; ++j) {
+        const LineRecord *record = lines.constData() + slotOf[handles[j]].first;
+        QPointF points[2] = { viewport.mapReal(fixed::toReal(record->p1)),
+                              viewport.mapReal(fixed::toReal(record->p2)) };
+        drawMappedPath(canvas, viewport, points, 2, false,
+                       record->rgb, record->alg);
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::drawPolygons(Canvas &canvas, const Viewport &viewport,
+                              const int *handles, int count) const
+{
+    QVector<QPointF> mapped;
+    const Slot *slotOf = shapeSlots.constData();
+    for (int j = 0; j < count; ++j) {
+        const PathRecord *record = polygons.constData() + slotOf[handles[j]].first;
+        if (!mapHull(canvas, viewport, *record))
+            continue;
+        mapPath(viewport, *record, mapped);
+        drawMappedPath(canvas, viewport, mapped.constData(), mapped.size(),
+                       true, record->rgb, record->alg);
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::drawEllipses(Canvas &canvas, const Viewport &viewport,
+                              const int *handles, int count) const
+{
+    QRect bounds(0, 0, canvas.width(), canvas.height());
+    const Slot *slotOf = shapeSlots.constData();
+    for (int j = 0; j < count; ++j) {
+        const EllipseRecord *record = ellipses.constData() + slotOf[handles[j]].first;
+        QPoint center = viewport.map(fixed::toReal(record->center));
+        int rx = viewport.map(fixed::toReal(record->rx));
+        int ry = viewport.map(fixed::toReal(record->ry));
+        QRect hull = Ellipse::rectHull(center, rx, ry, record->theta)
+                .adjusted(0, 0, 1, 1);
+        if (bounds.intersects(hull))
+            Ellipse::rasterize(canvas, center, rx, ry,
+                               record->theta, record->rgb);
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::drawCurves(Canvas &canvas, const Viewport &viewport,
+                            const int *handles, int count) const
+{
+    QVector<QPointF> mapped, flattened;
+    const Slot *slotOf = shapeSlots.constData();
+    for (int j = 0; j < count; ++j) {
+        const PathRecord *record = curves.constData() + slotOf[handles[j]].first;
+        /* A curve lies within the hull of its control points. */
+        if (!mapHull(canvas, viewport, *record))
+            continue;
+        mapPath(viewport, *record, mapped);
+
+        /* Sample about once every two pixels of the control polygon,
+         * which is never shorter than the curve. */
+        double length = 0.0;
+        for (int i = 0; i < record->count - 1; ++i) {
+            QPointF d = mapped[i + 1] - mapped[i];
+            length += qSqrt(d.x() * d.x() + d.y() * d.y());
+        }
+        int samples = qBound(8, qCeil(length / 2), 1000);
+
+        /* The curve is flattened on screen, as drawScaled() flattens it
+         * on the scaled canvas. */
+        QVector<QPoint> points = Curve::flatten(
+                    mapped.constData(), record->count,
+                    record->alg, 1.0 / samples);
+        flattened.resize(points.size());
+        for (int i = 0; i < points.size(); ++i)
+            flattened[i] = points[i];
+        drawMappedPath(canvas, viewport, flattened.constData(),
+                       flattened.size(), false, record->rgb,
+                       Algorithm::DEFAULT);
+    }
+}
+
+template <typename Canvas>
+void ShapeStore::drawPolylines(Canvas &canvas, const Viewport &viewport,
+                               const int *handles, int count) const
+{
+    QVector<QPointF> mapped;
+    for (int j = 0; j < count; ++j) {
+        const Slot &slot = shapeSlots.at(handles[j]);
+        const PathRecord *record = polylines.constData() + slot.first;
+        const PathRecord *end = record + slot.count;
+        for (; record != end; ++record) {
+            if (!mapHull(canvas, viewport, *record))
+                continue;
+            mapPath(viewport, *record, mapped);
+            drawMappedPath(canvas, viewport, mapped.constData(),
+                           mapped.size(), false, record->rgb, record->alg);
+        }
+    }
+}
+
+template <typename Canvas>
+bool ShapeStore::mapHull(Canvas &canvas, const Viewport &viewport,
+                         const PathRecord &record) const
+{
+    QRect bounds(0, 0, canvas.width(), canvas.height());
+    QRect hull = viewport.map(record.hull);
+    if (!bounds.intersects(hull))
+        return false;
+    if (hull.width() <= 1 && hull.height() <= 1) {
+        Ellipse::rasterize(canvas, hull.topLeft(), 0, 0, record.rgb);
+        return false;
+    }
+    return true;
+}
+
+void ShapeStore::mapPath(const Viewport &viewport, const PathRecord &record,
+                         QVector<QPointF> &mapped) const
+{
+    mapped.resize(record.count);
+    const QPoint *p = vertices.constData() + record.first;
+    for (int i = 0; i < record.count; ++i)
+        mapped[i] = viewport.mapReal(fixed::toReal(p[i]));
+}
+
+template <typename Canvas>
+void ShapeStore::drawMappedPath(Canvas &canvas, const Viewport &viewport,
+                                const QPointF *points, int n, bool closed,
+                                QRgb rgb, Algorithm alg)
+{
+    if (n == 0)
+        return;
+
+    /* Zoomed out, runs of vertices fall on the same pixel. Zoomed in or
+     * at zoom 1, every vertex is kept as draw(canvas) keeps it. */
+    bool merge = viewport.getZoom() < 1.0;
+    int last = 0, edges = 0;
+    for (int i = 1; i < n; ++i) {
+        if (points[i] == points[last] ||
+                (merge && fixed::roundToPixel(points[i]) ==
+                 fixed::roundToPixel(points[last])))
+            continue;
+        drawMappedEdge(canvas, points[last], points[i], rgb, alg);
+        last = i;
+        ++edges;
+    }
+
+    if (edges == 0)
+        Ellipse::rasterize(canvas, fixed::roundToPixel(points[0]), 0, 0, rgb);
+    else if (closed && points[last] != points[0])
+        drawMappedEdge(canvas, points[last], points[0], rgb, alg);
+}
+
+template <typename Canvas>
+void ShapeStore::drawMappedEdge(Canvas &canvas, QPointF p1, QPointF p2,
+                                QRgb rgb, Algorithm alg)
+{
+    /* Zoomed in, an edge can be far longer than the canvas, or reach
+     * beyond what fixed point holds. Only the part near the canvas is
+     * walked; the margin keeps the clipped endpoints off screen. */
+    double w = canvas.width(), h = canvas.height();
+    QRectF window(-w, -h, 3 * w, 3 * h);
+    if (!window.contains(p1) || !window.contains(p2)) {
+        if (!Line::clipSegment(p1, p2, window.topLeft(), window.bottomRight()))
+            return;
+    }
+    Line::rasterizeFixed(canvas, fixed::fromReal(p1), fixed::fromReal(p2),
+                         rgb, alg);
+}
+
+template void ShapeStore::draw(QImage &) const;
+template void ShapeStore::draw(TiledCanvas &) const;
+template void ShapeStore::drawScaled(QImage &, double) const;
+template void ShapeStore::drawScaled(TiledCanvas &, double) const;
+template void ShapeStore::draw(QImage &, const Viewport &) const;
+template void ShapeStore::draw(TiledCanvas &, const Viewport &) const;
+
+}
@@ -0,0 +1,262 @@
+#ifndef SHAPESTORE_H
+#define SHAPESTORE_H
+
+#include "shape.h"
+#include "viewport.h"
+
+#include <QHash>
+#include <QVector>
+#include <QPoint>
+#include <QPointF>
+#include <QRect>
+#include <QRgb>
+
+class QImage;
+
+namespace cg {
+
+class SceneFile;
+class SvgExporter;
+
+/* A render-oriented copy of a scene.
+ *
+ * Shapes are kept by value in one contiguous array per type, with their
+ * algorithm resolved to an enum and their color packed into a QRgb.
+ * Coordinates and radii are in 24.8 fixed point, see fixedpoint.h, as
+ * shapes keep them. Vertices of polygons, curves and polylines share
+ * one pool. Drawing walks each array with a plain loop, without virtual
+ * calls or string compares, one run of shapes of the same type at a
+ * time.
+ *
+ * The store follows the scene as it is edited rather than being built
+ * again. Each shape has a handle, which stays valid until the shape is
+ * removed, and the drawing order is a list of handles. Updating a shape
+ * overwrites its records in place when their sizes are unchanged, as
+ * they are while a shape is dragged. Records that are replaced or
+ * removed are left behind as garbage, and the arrays are packed again
+ * in drawing order once the garbage outgrows the live records.
+ *
+ * A store that records its changes keeps a log of the edits made to it
+ * and a copy of the records each wrote. Applying the log to another
+ * store that started out the same brings it up to date, with the same
+ * handles, at the cost of the edited shapes alone. Updates to a shape
+ * merge into its last logged edit, so a drag logs one shape however
+ * many times it moved. */
+class ShapeStore
+{
+public:
+    struct Changes;
+
+    ShapeStore();
+
+    void clear();
+    bool isEmpty() const { return shapeCount == 0; }
+    int size() const { return shapeCount; }
+
+    /* Adds shape at position in the drawing order, which is within
+     * [0, size()], and returns its handle. */
+    int insert(int position, Shape &shape);
+    int append(Shape &shape) { return insert(shapeCount, shape); }
+    /* Rewrites the records of the shape with handle from shape. */
+    void update(int handle, Shape &shape);
+    void remove(int handle);
+
+    /* Lays the records out in drawing order and frees the garbage. */
+    void squeeze();
+
+    /* Starts or stops logging edits for takeChanges(). */
+    void setRecording(bool on);
+    /* Returns the edits logged since the last call and empties the log. */
+    Changes takeChanges();
+    /* Replays changes taken from a store that was the same as this one
+     * when they began. */
+    void apply(const Changes &changes);
+
+    /* Append a shape at the end of the drawing order, or fill the shape
+     * being inserted or updated. Coordinates and radii are in 24.8
+     * fixed point. */
+    void addLine(const QPoint &p1, const QPoint &p2, QRgb rgb, Algorithm alg);
+    void addPolygon(const QVector<QPoint> &points, QRgb rgb, Algorithm alg);
+    void addEllipse(const QPoint &center, int rx, int ry,
+                    double theta, QRgb rgb);
+    void addCurve(const QVector<QPoint> &controls, QRgb rgb, Algorithm alg);
+    void addPolyline(const QVector<QVector<QPoint>> &runs,
+                     QRgb rgb, Algorithm alg);
+
+    /* Canvas is a QImage or a TiledCanvas. */
+    template <typename Canvas>
+    void draw(Canvas &canvas) const;
+
+    /* Draws the scene as drawn natively on a canvas scale times the size.
+     * Coordinates and radii are scaled in fixed point before any shape
+     * is flattened or rasterized, mapping pixel centers to pixel
+     * centers: x becomes scale * (x + 0.5) - 0.5. */
+    template <typename Canvas>
+    void drawScaled(Canvas &canvas, double scale) const;
+
+    /* Draws the scene as seen through the viewport. Shapes outside the
+     * canvas are skipped, shapes smaller than a pixel become a dot and
+     * curves are sampled in proportion to their size on screen. The
+     * identity viewport draws exactly like draw(canvas). */
+    template <typename Canvas>
+    void draw(Canvas &canvas, const Viewport &viewport) const;
+
+private:
+    friend class SceneFile;
+    friend class SvgExporter;
+
+    // enum for Slot::kind
+    enum { LINE, POLYGON, ELLIPSE, CURVE, POLYLINE, KIND_COUNT,
+           REMOVED = KIND_COUNT };
+
+    struct LineRecord {
+        QPoint p1, p2;
+        QRgb rgb;
+        Algorithm alg;
+    };
+
+    struct EllipseRecord {
+        QPoint center;
+        int rx, ry;
+        double theta;
+        QRgb rgb;
+    };
+
+    /* A range of the vertex pool, used by polygons, curves and
+     * the runs of polylines. The hull is in pixels. */
+    struct PathRecord {
+        int first, count;
+        QRgb rgb;
+        Algorithm alg;
+        QRect hull;
+    };
+
+    /* The records of a shape: one, or one per run of a polyline. */
+    struct Slot {
+        int kind;
+        int first, count;
+        bool listed;        /* in order, perhaps after being removed */
+    };
+
+    /* An edit in the log. The records it wrote are count records of
+     * kind from first in the log's arrays. */
+    struct Edit {
+        enum Type { INSERT, UPDATE, REMOVE } type;
+        int handle;
+        int position;       /* where an insert went in the drawing order */
+        int kind;
+        int first, count;
+    };
+
+public:
+    struct Changes {
+        Changes() : reset(false) {}
+        bool isEmpty() const { return !reset && edits.isEmpty(); }
+
+        bool reset;                 /* the store was cleared first */
+        QVector<Edit> edits;
+        QVector<LineRecord> lines;
+        QVector<EllipseRecord> ellipses;
+        QVector<PathRecord> paths;  /* of every kind of path */
+        QVector<QPoint> vertices;
+    };
+
+private:
+    int newHandle();
+    void openSlot(int handle);
+    void closeSlot(int handle, int position);
+    int targetSlot();
+    void finishAdd();
+    template <typename Record>
+    Record *claimRecords(QVector<Record> &records, int kind, int count);
+    void releaseRecords(const Slot &slot);
+    void setPath(PathRecord &record, const QPoint *points, int n,
+                 QRgb rgb, Algorithm alg);
+    void dropRemoved();
+    void collectGarbage();
+
+    void logEdit(Edit::Type type, int handle, int position);
+    void copyRecords(int handle, Edit &edit);
+    void fillFromEdit(const Changes &changes, const Edit &edit);
+
+    /* The array of path records of a polygon, curve or polyline kind. */
+    const PathRecord *pathRecords(int kind) const;
+
+    /* Scaling maps the records' coordinates and radii to the canvas,
+     * see shapestore.cpp. */
+    template <typename Canvas, typename Scaling>
+    void drawRuns(Canvas &canvas, const Scaling &scaling) const;
+    template <typename Canvas, typename Scaling>
+    void drawLines(Canvas &canvas, const Scaling &scaling,
+                   const int *handles, int count) const;
+    template <typename Canvas, typename Scaling>
+    void drawPolygons(Canvas &canvas, const Scaling &scaling,
+                      const int *handles, int count) const;
+    template <typename Canvas, typename Scaling>
+    void drawEllipses(Canvas &canvas, const Scaling &scaling,
+                      const int *handles, int count) const;
+    template <typename Canvas, typename Scaling>
+    void drawCurves(Canvas &canvas, const Scaling &scaling,
+                    const int *handles, int count) const;
+    template <typename Canvas, typename Scaling>
+    void drawPolylines(Canvas &canvas, const Scaling &scaling,
+                       const int *handles, int count) const;
+
+    template <typename Canvas>
+    void drawLines(Canvas &canvas, const Viewport &viewport,
+                   const int *handles, int count) const;
+    template <typename Canvas>
+    void drawPolygons(Canvas &canvas, const Viewport &viewport,
+                      const int *handles, int count) const;
+    template <typename Canvas>
+    void drawEllipses(Canvas &canvas, const Viewport &viewport,
+                      const int *handles, int count) const;
+    template <typename Canvas>
+    void drawCurves(Canvas &canvas, const Viewport &viewport,
+                    const int *handles, int count) const;
+    template <typename Canvas>
+    void drawPolylines(Canvas &canvas, const Viewport &viewport,
+                       const int *handles, int count) const;
+
+    /* Draws a path already mapped to the canvas, skipping repeated
+     * vertices and clipping edges to the canvas. */
+    template <typename Canvas>
+    static void drawMappedPath(Canvas &canvas, const Viewport &viewport,
+                               const QPointF *points, int n, bool closed,
+                               QRgb rgb, Algorithm alg);
+    template <typename Canvas>
+    static void drawMappedEdge(Canvas &canvas, QPointF p1, QPointF p2,
+                               QRgb rgb, Algorithm alg);
+    /* Maps the path's hull. Returns false if it falls outside the canvas;
+     * draws a dot and returns false if it covers at most one pixel. */
+    template <typename Canvas>
+    bool mapHull(Canvas &canvas, const Viewport &viewport,
+                 const PathRecord &record) const;
+    void mapPath(const Viewport &viewport, const PathRecord &record,
+                 QVector<QPointF> &mapped) const;
+
+    QVector<LineRecord> lines;
+    QVector<PathRecord> polygons;
+    QVector<EllipseRecord> ellipses;
+    QVector<PathRecord> curves;
+    QVector<PathRecord> polylines;
+    QVector<QPoint> vertices;
+
+    QVector<Slot> shapeSlots;   /* indexed by handle */
+    QVector<int> order;         /* handles in drawing order */
+    QVector<int> freeHandles;   /* of slots no longer listed */
+    int shapeCount;
+    int target;                 /* the slot add*() fill, or -1 */
+    bool appending;             /* target is a new slot for the end */
+    bool isPacked;              /* records are in order, with no garbage */
+    int garbageRecords;
+    int garbageVertices;
+
+    bool recording;
+    Changes log;
+    QHash<int, int> lastEdit;   /* handle to its last insert or update */
+};
+
+}
+
+#endif // SHAPESTORE_H
@@ -0,0 +1,384 @@
+#include "svgexporter.h"
+#include "fixedpoint.h"
+#include "trace.h"
+
+#include <QSaveFile>
+#include <QVarLengthArray>
+#include <QtMath>
+
+#include <cstring>
+
+namespace cg {
+
+namespace {
+
+const double FLATTEN_TOLERANCE = 0.25;  /* pixels */
+
+/* Whether the control polygon, which holds the curve, lies within the
+ * tolerance of its chord. */
+bool isFlat(const QPointF *controls, int n)
+{
+    QPointF chord = controls[n - 1] - controls[0];
+    double lengthSquared = QPointF::dotProduct(chord, chord);
+    for (int i = 1; i < n - 1; ++i) {
+        /* Measure to the chord segment, not its line: control points
+         * beyond its ends pull the curve past them. */
+        QPointF d = controls[i] - controls[0];
+        double t = lengthSquared > 0.0
+                ? qBound(0.0, QPointF::dotProduct(d, chord) / lengthSquared, 1.0)
+                : 0.0;
+        QPointF off = d - chord * t;
+        if (QPointF::dotProduct(off, off) > FLATTEN_TOLERANCE * FLATTEN_TOLERANCE)
+            return false;
+    }
+    return true;
+}
+
+}
+
+/* Buffers the output and formats numbers without going through
+ * QString. */
+class SvgExporter::Writer
+{
+public:
+    explicit Writer(QIODevice *device)
+        : device(device), used(0), failed(false) {}
+
+    Writer &operator<<(const char *text)
+    {
+        int n = static_cast<int>(std::strlen(text));
+        reserve(n);
+        if (n > BUFFER_SIZE) {
+            failed = failed || device->write(text, n) != n;
+            return *this;
+        }
+        std::memcpy(buffer + used, text, n);
+        used += n;
+        return *this;
+    }
+
+    Writer &operator<<(char c)
+    {
+        reserve(1);
+        buffer[used++] = c;
+        return *this;
+    }
+
+    Writer &operator<<(int value)
+    {
+        reserve(12);
+        if (value < 0) {
+            buffer[used++] = '-';
+            writeDigits(-static_cast<qint64>(value));
+        }
+        else {
+            writeDigits(value);
+        }
+        return *this;
+    }
+
+    /* Writes value with at most two decimals, which is finer than the
+     * eye can tell but not exactly the store's fixed point. */
+    Writer &operator<<(double value)
+    {
+        reserve(24);
+        qint64 hundredths = qRound64(value * 100);
+        if (hundredths < 0) {
+            buffer[used++] = '-';
+            hundredths = -hundredths;
+        }
+        writeDigits(hundredths / 100);
+        int fraction = static_cast<int>(hundredths % 100);
+        if (fraction) {
+            buffer[used++] = '.';
+            buffer[used++] = static_cast<char>('0' + fraction / 10);
+            if (fraction % 10)
+                buffer[used++] = static_cast<char>('0' + fraction % 10);
+        }
+        return *this;
+    }
+
+    Writer &operator<<(const QPointF &p)
+    {
+        return *this << p.x() << ',' << p.y();
+    }
+
+    /* Ends an element with its stroke color. */
+    void endElement(QRgb rgb)
+    {
+        static const char hex[] = "0123456789abcdef";
+        reserve(24);
+        *this << "\" stroke=\"#";
+        int channels[3] = { qRed(rgb), qGreen(rgb), qBlue(rgb) };
+        for (int channel : channels) {
+            buffer[used++] = hex[channel >> 4];
+            buffer[used++] = hex[channel & 0xf];
+        }
+        *this << "\"/>\n";
+    }
+
+    bool flush()
+    {
+        if (used > 0 && !failed) {
+            TRACE_SCOPE("write svg");
+            failed = device->write(buffer, used) != used;
+        }
+        used = 0;
+        return !failed;
+    }
+
+private:
+    enum { BUFFER_SIZE = 64 * 1024 };
+
+    void reserve(int n)
+    {
+        if (used + n > BUFFER_SIZE)
+            flush();
+    }
+
+    void writeDigits(qint64 value)
+    {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value);
+        while (n > 0)
+            buffer[used++] = digits[--n];
+    }
+
+    QIODevice *device;
+    char buffer[BUFFER_SIZE];
+    int used;
+    bool failed;
+};
+
+bool SvgExporter::save(const QString &fileName, const ShapeStore &store,
+                       const QSize &canvasSize, bool flipVertically)
+{
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    return write(&file, store, canvasSize, flipVertically) && file.commit();
+}
+
+bool SvgExporter::write(QIODevice *device, const ShapeStore &store,
+                        const QSize &canvasSize, bool flipVertically)
+{
+    TRACE_SCOPE("SvgExporter::write");
+    Writer writer(device);
+    int width = canvasSize.width(), height = canvasSize.height();
+
+    writer << "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+           << "<svg xmlns=\"http://www.w3.org/2000/svg\" width=\"" << width
+           << "\" height=\"" << height << "\" viewBox=\"0 0 " << width
+           << ' ' << height << "\">\n"
+           << "<rect width=\"100%\" height=\"100%\" fill=\"white\"/>\n"
+           << "<g fill=\"none\" stroke-width=\"1\" transform=\"";
+    /* Move integer coordinates to the centers of pixels; flipped, row y
+     * of the canvas becomes row height - 1 - y of the picture. */
+    if (flipVertically)
+        writer << "matrix(1 0 0 -1 0.5 " << height - 0.5 << ')';
+    else
+        writer << "translate(0.5 0.5)";
+    writer << "\">\n";
+
+    /* The records are read where they lie, one run of shapes of the same
+     * type at a time, in drawing order. */
+    const ShapeStore::Slot *slotOf = store.shapeSlots.constData();
+    const int *handle = store.order.constData();
+    const int *end = handle + store.order.size();
+    while (handle != end) {
+        const int *run = handle;
+        int kind = slotOf[*run].kind;
+        while (++handle != end && slotOf[*handle].kind == kind) {}
+
+        int count = static_cast<int>(handle - run);
+        switch (kind) {
+        case ShapeStore::LINE:
+            writeLines(writer, store, run, count); break;
+        case ShapeStore::POLYGON:
+            writePolygons(writer, store, run, count); break;
+        case ShapeStore::ELLIPSE:
+            writeEllipses(writer, store, run, count); break;
+        case ShapeStore::CURVE:
+            writeCurves(writer, store, run, count); break;
+        case ShapeStore::POLYLINE:
+            writePolylines(writer, store, run, count); break;
+        case ShapeStore::REMOVED:
+            break;
+        default:
+            Q_ASSERT(0); /* Should not reach here */ break;
+        }
+    }
+
+    writer << "</g>\n</svg>\n";
+    return writer.flush();
+}
+
+void SvgExporter::writeLines(Writer &writer, const ShapeStore &store,
+                             const int *handles, int count)
+{
+    const ShapeStore::Slot *slotOf = store.shapeSlots.constData();
+    for (int i = 0; i < count; ++i) {
+        const ShapeStore::LineRecord *record =
+                store.lines.constData() + slotOf[handles[i]].first;
+        QPointF p1 = fixed::toReal(record->p1), p2 = fixed::toReal(record->p2);
+        writer << "<line x1=\"" << p1.x() << "\" y1=\"" << p1.y()
+               << "\" x2=\"" << p2.x() << "\" y2=\"" << p2.y();
+        writer.endElement(record->rgb);
+    }
+}
+
+void SvgExporter::writePolygons(Writer &writer, const ShapeStore &store,
+                                const int *handles, int count)
+{
+    const ShapeStore::Slot *slotOf = store.shapeSlots.constData();
+    for (int i = 0; i < count; ++i) {
+        const ShapeStore::PathRecord *record =
+                store.polygons.constData() + slotOf[handles[i]].first;
+        writer << "<polygon points=\"";
+        writePoints(writer, store, *record);
+        writer.endElement(record->rgb);
+    }
+}
+
+void SvgExporter::writeEllipses(Writer &writer, const ShapeStore &store,
+                                const int *handles, int count)
+{
+    const ShapeStore::Slot *slotOf = store.shapeSlots.constData();
+    for (int i = 0; i < count; ++i) {
+        const ShapeStore::EllipseRecord *record =
+                store.ellipses.constData() + slotOf[handles[i]].first;
+        QPointF c = fixed::toReal(record->center);
+        writer << "<ellipse cx=\"" << c.x() << "\" cy=\"" << c.y()
+               << "\" rx=\"" << fixed::toReal(record->rx)
+               << "\" ry=\"" << fixed::toReal(record->ry);
+        if (record->theta != 0.0) {
+            writer << "\" transform=\"rotate(" << qRadiansToDegrees(record->theta)
+                   << ' ' << c.x() << ' ' << c.y() << ')';
+        }
+        writer.endElement(record->rgb);
+    }
+}
+
+void SvgExporter::writeCurves(Writer &writer, const ShapeStore &store,
+                              const int *handles, int count)
+{
+    QVarLengthArray<QPointF, 16> controls;
+    const ShapeStore::Slot *slotOf = store.shapeSlots.constData();
+    for (int i = 0; i < count; ++i) {
+        const ShapeStore::PathRecord *record =
+                store.curves.constData() + slotOf[handles[i]].first;
+        const QPoint *vertices = store.vertices.constData() + record->first;
+        controls.resize(record->count);
+        for (int j = 0; j < record->count; ++j)
+            controls[j] = fixed::toReal(vertices[j]);
+        writer << "<path d=\"";
+        if (record->alg == Algorithm::B_SPLINE)
+            writeBspline(writer, controls.constData(), record->count);
+        else
+            writeBezier(writer, controls.constData(), record->count);
+        writer.endElement(record->rgb);
+    }
+}
+
+void SvgExporter::writePolylines(Writer &writer, const ShapeStore &store,
+                                 const int *handles, int count)
+{
+    for (int i = 0; i < count; ++i) {
+        const ShapeStore::Slot &slot = store.shapeSlots.at(handles[i]);
+        const ShapeStore::PathRecord *record =
+                store.polylines.constData() + slot.first;
+        const ShapeStore::PathRecord *end = record + slot.count;
+        for (; record != end; ++record) {
+            writer << "<polyline points=\"";
+            writePoints(writer, store, *record);
+            writer.endElement(record->rgb);
+        }
+    }
+}
+
+void SvgExporter::writePoints(Writer &writer, const ShapeStore &store,
+                              const ShapeStore::PathRecord &record)
+{
+    const QPoint *points = store.vertices.constData() + record.first;
+    for (int i = 0; i < record.count; ++i) {
+        if (i > 0)
+            writer << ' ';
+        writer << fixed::toReal(points[i]);
+    }
+}
+
+void SvgExporter::writeBezier(Writer &writer, const QPointF *controls, int n)
+{
+    if (n <= 0)
+        return;
+
+    writer << 'M' << controls[0];
+    switch (n) {
+    case 1:
+        break;
+    case 2:
+        writer << " L" << controls[1];
+        break;
+    case 3:
+        writer << " Q" << controls[1] << ' ' << controls[2];
+        break;
+    case 4:
+        writer << " C" << controls[1] << ' ' << controls[2] << ' ' << controls[3];
+        break;
+    default:
+        /* SVG has no curves above the third degree. */
+        writer << " L";
+        flattenBezier(writer, controls, n, 0);
+        break;
+    }
+}
+
+void SvgExporter::flattenBezier(Writer &writer, const QPointF *controls,
+                                int n, int depth)
+{
+    if (depth == MAX_FLATTEN_DEPTH || isFlat(controls, n)) {
+        writer << ' ' << controls[n - 1];
+        return;
+    }
+
+    /* Split the curve in halves by de Casteljau's algorithm. */
+    QVarLengthArray<QPointF, 16> left(n), right(n), work(n);
+    for (int i = 0; i < n; ++i)
+        work[i] = controls[i];
+    for (int r = 0; r < n; ++r) {
+        left[r] = work[0];
+        right[n - 1 - r] = work[n - 1 - r];
+        for (int i = 0; i < n - 1 - r; ++i)
+            work[i] = (work[i] + work[i + 1]) * 0.5;
+    }
+    flattenBezier(writer, left.constData(), n, depth + 1);
+    flattenBezier(writer, right.constData(), n, depth + 1);
+}
+
+void SvgExporter::writeBspline(Writer &writer, const QPointF *controls, int n)
+{
+    if (n < 3) {
+        writeBezier(writer, controls, n);
+        return;
+    }
+
+    /* Curve draws clamped quadratic B-splines with uniform inner knots.
+     * Each of their n - 2 spans is the quadratic Bezier curve from the
+     * middle of one leg of the control polygon to the middle of the
+     * next, with the vertex between them as its control point; the
+     * first and last spans start and end at the ends instead. */
+    writer << 'M' << controls[0];
+    for (int i = 1; i < n - 1; ++i) {
+        writer << " Q" << controls[i] << ' ';
+        if (i == n - 2)
+            writer << controls[n - 1];
+        else
+            writer << (controls[i] + controls[i + 1]) * 0.5;
+    }
+}
+
+}
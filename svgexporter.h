@@ -0,0 +1,60 @@
+#ifndef SVGEXPORTER_H
+#define SVGEXPORTER_H
+
+#include "shapestore.h"
+
+#include <QPointF>
+#include <QSize>
+#include <QString>
+
+class QIODevice;
+
+namespace cg {
+
+/* Writes a scene as SVG.
+ *
+ * Shapes are read from the store where they lie and written in drawing
+ * order straight through a fixed-size buffer, so neither a document
+ * tree nor a copy of the store is built and memory does not grow with
+ * the scene. Lines, polygons, polylines and ellipses become the SVG
+ * elements of the same names. Bezier curves of up to four control
+ * points become path elements, and longer ones are flattened to within
+ * a quarter of a pixel. B-splines, which are quadratic and clamped,
+ * become exact quadratic paths. Whole coordinates are pixel centers, as
+ * on the canvas. flipVertically mirrors the picture top to bottom, as
+ * TiledCanvas::save() does. */
+class SvgExporter
+{
+public:
+    static bool save(const QString &fileName, const ShapeStore &store,
+                     const QSize &canvasSize, bool flipVertically = false);
+    static bool write(QIODevice *device, const ShapeStore &store,
+                      const QSize &canvasSize, bool flipVertically = false);
+
+private:
+    class Writer;
+
+    enum { MAX_FLATTEN_DEPTH = 16 };
+
+    static void writeLines(Writer &writer, const ShapeStore &store,
+                           const int *handles, int count);
+    static void writePolygons(Writer &writer, const ShapeStore &store,
+                              const int *handles, int count);
+    static void writeEllipses(Writer &writer, const ShapeStore &store,
+                              const int *handles, int count);
+    static void writeCurves(Writer &writer, const ShapeStore &store,
+                            const int *handles, int count);
+    static void writePolylines(Writer &writer, const ShapeStore &store,
+                               const int *handles, int count);
+    static void writePoints(Writer &writer, const ShapeStore &store,
+                            const ShapeStore::PathRecord &record);
+
+    static void writeBezier(Writer &writer, const QPointF *controls, int n);
+    static void flattenBezier(Writer &writer, const QPointF *controls,
+                              int n, int depth);
+    static void writeBspline(Writer &writer, const QPointF *controls, int n);
+};
+
+}
+
+#endif // SVGEXPORTER_H
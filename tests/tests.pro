@@ -0,0 +1,23 @@
+# Checks the regression corpus in materials/regression against its
+# golden manifest. It links the core library but is not installed, so
+# neither the corpus nor the check ships with the command line.
+QT = core gui
+
+TARGET = PainterCheck
+TEMPLATE = app
+CONFIG += console testcase
+CONFIG -= app_bundle
+
+include(../common.pri)
+include(../core/core.pri)
+
+# "make check" runs the check without arguments, which reads this
+# manifest and writes the outputs to regression in the build directory.
+DEFINES += GOLDEN_MANIFEST=\\\"$$PWD/../materials/regression/golden.txt\\\"
+
+SOURCES += \
+    ../checkmain.cpp \
+    ../regressioncheck.cpp
+
+HEADERS += \
+    ../regressioncheck.h
@@ -0,0 +1,384 @@
+#include "tiledcanvas.h"
+#include "trace.h"
+
+#include <QFile>
+#include <QByteArray>
+#include <QtEndian>
+
+namespace cg {
+
+TiledCanvas::TiledCanvas()
+    : w(0), h(0), columns(0), rows(0)
+{
+
+}
+
+TiledCanvas::TiledCanvas(int width, int height)
+    : w(width), h(height),
+      columns((width + TILE_SIZE - 1) / TILE_SIZE),
+      rows((height + TILE_SIZE - 1) / TILE_SIZE),
+      tiles(columns * rows)
+{
+
+}
+
+void TiledCanvas::clear()
+{
+    for (auto &tile : tiles) {
+        if (tile.isEmpty())
+            continue;
+        QVector<quint32> spare;
+        spare.swap(tile);
+        spareTiles.append(spare);
+    }
+}
+
+void TiledCanvas::reset(int width, int height)
+{
+    clear();
+    w = width;
+    h = height;
+    columns = (width + TILE_SIZE - 1) / TILE_SIZE;
+    rows = (height + TILE_SIZE - 1) / TILE_SIZE;
+    tiles = QVector<QVector<quint32>>(columns * rows);
+}
+
+QRgb TiledCanvas::pixel(int x, int y) const
+{
+    Q_ASSERT(x >= 0 && x < w);
+    Q_ASSERT(y >= 0 && y < h);
+    const quint32 *tile = constTileBits(x >> TILE_SHIFT, y >> TILE_SHIFT);
+    return tile[((y & (TILE_SIZE - 1)) << TILE_SHIFT) + (x & (TILE_SIZE - 1))];
+}
+
+const quint32 *TiledCanvas::constTileBits(int column, int row) const
+{
+    const QVector<quint32> &tile = tiles[row * columns + column];
+    return tile.isEmpty() ? whiteTile().constData() : tile.constData();
+}
+
+quint32 *TiledCanvas::tileBits(int column, int row)
+{
+    QVector<quint32> &tile = tiles[row * columns + column];
+    if (tile.isEmpty()) {
+        if (spareTiles.isEmpty()) {
+            tile = whiteTile();
+        }
+        else {
+            tile.swap(spareTiles.last());
+            spareTiles.removeLast();
+            std::fill(tile.begin(), tile.end(), 0xffffffffu);
+        }
+    }
+    return tile.data();
+}
+
+int TiledCanvas::allocatedTiles() const
+{
+    int count = 0;
+    for (const auto &tile : tiles)
+        if (!tile.isEmpty())
+            ++count;
+    return count;
+}
+
+qint64 TiledCanvas::sizeInBytes() const
+{
+    qint64 tileCount = allocatedTiles() + spareTiles.size();
+    return sizeof(TiledCanvas) + tiles.size() * sizeof(QVector<quint32>)
+            + tileCount * TILE_SIZE * TILE_SIZE * sizeof(quint32);
+}
+
+QImage TiledCanvas::toImage() const
+{
+    QImage image(w, h, QImage::Format_RGB32);
+    for (int y = 0; y < h; ++y) {
+        quint32 *line = reinterpret_cast<quint32 *>(image.scanLine(y));
+        const int rowOffset = (y & (TILE_SIZE - 1)) << TILE_SHIFT;
+        for (int column = 0; column < columns; ++column) {
+            const quint32 *src = constTileBits(column, y >> TILE_SHIFT) + rowOffset;
+            int x0 = column << TILE_SHIFT;
+            int n = qMin(static_cast<int>(TILE_SIZE), w - x0);
+            std::copy(src, src + n, line + x0);
+        }
+    }
+    return image;
+}
+
+QString TiledCanvas::suffixOf(ImageFormat format)
+{
+    switch (format) {
+    case BMP: return "bmp";
+    case PPM: return "ppm";
+    case RAW: return "rgb";
+    case QOI: return "qoi";
+    default: Q_ASSERT(0); /* Should not reach here */ return QString();
+    }
+}
+
+bool TiledCanvas::fitsIn(ImageFormat format) const
+{
+    if (format != BMP)
+        return true;
+    const qint64 headerSize = 14 + 40;
+    qint64 lineBytes = ((static_cast<qint64>(w) * 24 + 31) / 32) * 4;
+    return headerSize + lineBytes * h <= Q_INT64_C(0xffffffff);
+}
+
+namespace {
+
+/* Each encoder turns runs of pixels into bytes; writeLines() calls
+ * encode() for the runs of a line in order, then endLine(). A line
+ * never takes more than lineBytes, except that the first line of a
+ * band may also end a QOI run carried over from the band before, which
+ * takes one more byte. */
+
+class BgrEncoder
+{
+public:
+    explicit BgrEncoder(int width)
+        : lineBytes(((width * 24 + 31) / 32) * 4), padding(lineBytes - width * 3) {}
+
+    uchar *encode(const quint32 *src, int n, uchar *dst)
+    {
+        for (int x = 0; x < n; ++x) {
+            *dst++ = static_cast<uchar>(qBlue(src[x]));
+            *dst++ = static_cast<uchar>(qGreen(src[x]));
+            *dst++ = static_cast<uchar>(qRed(src[x]));
+        }
+        return dst;
+    }
+
+    uchar *endLine(uchar *dst)
+    {
+        return std::fill_n(dst, padding, 0);
+    }
+
+    const int lineBytes;
+
+private:
+    int padding;
+};
+
+class RgbEncoder
+{
+public:
+    explicit RgbEncoder(int width) : lineBytes(width * 3) {}
+
+    uchar *encode(const quint32 *src, int n, uchar *dst)
+    {
+        for (int x = 0; x < n; ++x) {
+            *dst++ = static_cast<uchar>(qRed(src[x]));
+            *dst++ = static_cast<uchar>(qGreen(src[x]));
+            *dst++ = static_cast<uchar>(qBlue(src[x]));
+        }
+        return dst;
+    }
+
+    uchar *endLine(uchar *dst) { return dst; }
+
+    const int lineBytes;
+};
+
+/* See https://qoiformat.org/qoi-specification.pdf. Runs carry over
+ * from one line to the next; finish() ends the last one. */
+class QoiEncoder
+{
+public:
+    explicit QoiEncoder(int width)
+        : lineBytes(width * 4), previous(0xff000000u), run(0)
+    {
+        std::fill_n(index, 64, 0u);     /* never matches an opaque pixel */
+    }
+
+    uchar *encode(const quint32 *src, int n, uchar *dst)
+    {
+        for (int x = 0; x < n; ++x) {
+            quint32 pixel = src[x] | 0xff000000u;
+            if (pixel == previous) {
+                if (++run == 62) {
+                    *dst++ = static_cast<uchar>(0xc0 | (run - 1));
+                    run = 0;
+                }
+                continue;
+            }
+            if (run > 0) {
+                *dst++ = static_cast<uchar>(0xc0 | (run - 1));
+                run = 0;
+            }
+
+            int r = qRed(pixel), g = qGreen(pixel), b = qBlue(pixel);
+            int slot = (r * 3 + g * 5 + b * 7 + 255 * 11) % 64;
+            if (index[slot] == pixel) {
+                *dst++ = static_cast<uchar>(slot);
+            }
+            else {
+                index[slot] = pixel;
+                /* Differences wrap around like the bytes they come from. */
+                int dr = static_cast<signed char>(r - qRed(previous));
+                int dg = static_cast<signed char>(g - qGreen(previous));
+                int db = static_cast<signed char>(b - qBlue(previous));
+                int drg = dr - dg, dbg = db - dg;
+                if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1
+                        && db >= -2 && db <= 1) {
+                    *dst++ = static_cast<uchar>(
+                                0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+                }
+                else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7
+                         && dbg >= -8 && dbg <= 7) {
+                    *dst++ = static_cast<uchar>(0x80 | (dg + 32));
+                    *dst++ = static_cast<uchar>((drg + 8) << 4 | (dbg + 8));
+                }
+                else {
+                    *dst++ = 0xfe;
+                    *dst++ = static_cast<uchar>(r);
+                    *dst++ = static_cast<uchar>(g);
+                    *dst++ = static_cast<uchar>(b);
+                }
+            }
+            previous = pixel;
+        }
+        return dst;
+    }
+
+    uchar *endLine(uchar *dst) { return dst; }
+
+    /* Ends the pending run and appends the end marker. */
+    QByteArray finish()
+    {
+        QByteArray tail;
+        if (run > 0)
+            tail.append(static_cast<char>(0xc0 | (run - 1)));
+        tail.append(7, '\0');
+        tail.append('\1');
+        return tail;
+    }
+
+    const int lineBytes;
+
+private:
+    quint32 index[64];
+    quint32 previous;
+    int run;
+};
+
+}
+
+template <typename Encoder>
+bool TiledCanvas::writeLines(QIODevice *device, Encoder &encoder,
+                             bool bottomUp) const
+{
+    /* One row of tiles is converted and written at a time. */
+    QByteArray band(encoder.lineBytes * TILE_SIZE + 1, '\0');
+    for (int i = 0; i < rows; ++i) {
+        int row = bottomUp ? rows - 1 - i : i;
+        int y0 = row << TILE_SHIFT;
+        int n = qMin(static_cast<int>(TILE_SIZE), h - y0);
+
+        uchar *begin = reinterpret_cast<uchar *>(band.data());
+        uchar *dst = begin;
+        {
+            TRACE_SCOPE("encode band");
+            for (int k = 0; k < n; ++k) {
+                int dy = bottomUp ? n - 1 - k : k;
+                for (int column = 0; column < columns; ++column) {
+                    const quint32 *src = constTileBits(column, row)
+                            + (dy << TILE_SHIFT);
+                    int m = qMin(static_cast<int>(TILE_SIZE),
+                                 w - (column << TILE_SHIFT));
+                    dst = encoder.encode(src, m, dst);
+                }
+                dst = encoder.endLine(dst);
+            }
+        }
+        TRACE_SCOPE("write band");
+        qint64 size = dst - begin;
+        if (device->write(band.constData(), size) != size)
+            return false;
+    }
+    return true;
+}
+
+bool TiledCanvas::write(QIODevice *device, ImageFormat format,
+                        bool flipVertically) const
+{
+    if (!fitsIn(format))
+        return false;
+
+    switch (format) {
+    case BMP: {
+        const int fileHeaderSize = 14, infoHeaderSize = 40;
+        BgrEncoder encoder(w);
+        const quint32 imageSize = static_cast<quint32>(encoder.lineBytes) * h;
+
+        QByteArray header(fileHeaderSize + infoHeaderSize, '\0');
+        uchar *p = reinterpret_cast<uchar *>(header.data());
+        p[0] = 'B';
+        p[1] = 'M';
+        qToLittleEndian<quint32>(fileHeaderSize + infoHeaderSize + imageSize, p + 2);
+        qToLittleEndian<quint32>(fileHeaderSize + infoHeaderSize, p + 10);
+        p += fileHeaderSize;
+        qToLittleEndian<quint32>(infoHeaderSize, p);
+        qToLittleEndian<qint32>(w, p + 4);
+        qToLittleEndian<qint32>(h, p + 8);      /* positive: bottom-up */
+        qToLittleEndian<quint16>(1, p + 12);    /* planes */
+        qToLittleEndian<quint16>(24, p + 14);   /* bits per pixel */
+        qToLittleEndian<quint32>(imageSize, p + 20);
+        qToLittleEndian<qint32>(2835, p + 24);  /* 72 dpi */
+        qToLittleEndian<qint32>(2835, p + 28);
+        if (device->write(header) != header.size())
+            return false;
+        return writeLines(device, encoder, !flipVertically);
+    }
+    case PPM: {
+        QByteArray header = "P6\n" + QByteArray::number(w) + ' '
+                + QByteArray::number(h) + "\n255\n";
+        if (device->write(header) != header.size())
+            return false;
+        RgbEncoder encoder(w);
+        return writeLines(device, encoder, flipVertically);
+    }
+    case RAW: {
+        RgbEncoder encoder(w);
+        return writeLines(device, encoder, flipVertically);
+    }
+    case QOI: {
+        QByteArray header(14, '\0');
+        uchar *p = reinterpret_cast<uchar *>(header.data());
+        std::copy_n("qoif", 4, p);
+        qToBigEndian<quint32>(w, p + 4);
+        qToBigEndian<quint32>(h, p + 8);
+        p[12] = 3;                              /* RGB */
+        p[13] = 0;                              /* sRGB */
+        if (device->write(header) != header.size())
+            return false;
+        QoiEncoder encoder(w);
+        if (!writeLines(device, encoder, flipVertically))
+            return false;
+        QByteArray tail = encoder.finish();
+        return device->write(tail) == tail.size();
+    }
+    default:
+        Q_ASSERT(0); /* Should not reach here */
+        return false;
+    }
+}
+
+bool TiledCanvas::save(const QString &fileName, ImageFormat format,
+                       bool flipVertically) const
+{
+    if (!fitsIn(format))
+        return false;
+    QFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+    return write(&file, format, flipVertically);
+}
+
+const QVector<quint32> &TiledCanvas::whiteTile()
+{
+    static const QVector<quint32> tile(TILE_SIZE * TILE_SIZE, 0xffffffffu);
+    return tile;
+}
+
+}
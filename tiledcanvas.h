@@ -0,0 +1,182 @@
+#ifndef TILEDCANVAS_H
+#define TILEDCANVAS_H
+
+#include <QVector>
+#include <QSize>
+#include <QRgb>
+#include <QImage>
+#include <QString>
+
+#include <algorithm>
+
+class QIODevice;
+
+namespace cg {
+
+/* A white canvas of any size, stored as square tiles.
+ *
+ * A tile is allocated on its first write; until then it reads as one
+ * shared white tile. Memory therefore grows with the area that has been
+ * drawn on rather than with the size of the canvas. Pixels are stored
+ * like QImage::Format_RGB32. */
+class TiledCanvas
+{
+public:
+    enum { TILE_SHIFT = 8, TILE_SIZE = 1 << TILE_SHIFT };
+
+    TiledCanvas();
+    TiledCanvas(int width, int height);
+
+    int width() const { return w; }
+    int height() const { return h; }
+    QSize size() const { return QSize(w, h); }
+    int tileColumns() const { return columns; }
+    int tileRows() const { return rows; }
+
+    /* Make every pixel white again and release all tiles. Released
+     * tiles are kept and reused by later writes, so a canvas cleared
+     * between saves or jobs doesn't allocate them again. */
+    void clear();
+    /* Clears the canvas and gives it a new size. */
+    void reset(int width, int height);
+
+    QRgb pixel(int x, int y) const;
+    const quint32 *constTileBits(int column, int row) const;
+    quint32 *tileBits(int column, int row);  /* allocates the tile */
+
+    int allocatedTiles() const;
+    qint64 sizeInBytes() const;
+
+    QImage toImage() const;
+
+    /* Formats the canvas can be written in:
+     * - BMP: 24-bit, uncompressed;
+     * - PPM: binary (P6) with 8-bit RGB;
+     * - RAW: bare 8-bit RGB rows, top row first, as video encoders read
+     *   rawvideo rgb24 frames;
+     * - QOI: the Quite OK Image format, lossless, with 3 channels. */
+    enum ImageFormat { BMP, PPM, RAW, QOI };
+
+    /* The file name suffix of format, like "bmp". */
+    static QString suffixOf(ImageFormat format);
+    /* Whether the canvas fits in format. The sizes in a BMP header are
+     * 32-bit, so a BMP can't be 4 GiB or larger. */
+    bool fitsIn(ImageFormat format) const;
+
+    /* Write the canvas one row of tiles at a time, converting straight
+     * from the tiles without building the whole image. flipVertically
+     * mirrors the picture top to bottom. A BMP stores its bottom row
+     * first, so writing the rows in canvas order (flipVertically) yields
+     * a mirrored picture. Both fail on a canvas that doesn't fit in
+     * format. */
+    bool write(QIODevice *device, ImageFormat format,
+               bool flipVertically = false) const;
+    bool save(const QString &fileName, ImageFormat format,
+              bool flipVertically = false) const;
+
+    bool writeBmp(QIODevice *device, bool flipVertically = false) const
+    { return write(device, BMP, flipVertically); }
+    bool saveBmp(const QString &fileName, bool flipVertically = false) const
+    { return save(fileName, BMP, flipVertically); }
+
+private:
+    static const QVector<quint32> &whiteTile();
+
+    /* Passes the pixels of each line to encoder, one tile wide run at a
+     * time, and writes out a row of tiles at once. */
+    template <typename Encoder>
+    bool writeLines(QIODevice *device, Encoder &encoder, bool bottomUp) const;
+
+    int w, h;
+    int columns, rows;
+    QVector<QVector<quint32>> tiles;    /* empty until first written */
+    QVector<QVector<quint32>> spareTiles;
+};
+
+/* A pixel sink (see pixelsink.h) writing into a TiledCanvas. The tile
+ * of the last write is cached, since consecutive pixels of a shape
+ * mostly share a tile. */
+class TiledSink
+{
+public:
+    TiledSink(TiledCanvas &canvas, QRgb rgb)
+        : canvas(canvas), width(canvas.width()), height(canvas.height()),
+          pixel(0xff000000u | rgb), cachedIndex(-1), cachedTile(nullptr)
+    {
+
+    }
+
+    void plot(int x, int y)
+    {
+        if (static_cast<unsigned>(x) < static_cast<unsigned>(width)
+                && static_cast<unsigned>(y) < static_cast<unsigned>(height))
+            *pixelAt(x, y) = pixel;
+    }
+
+    void hspan(int x0, int x1, int y)
+    {
+        if (static_cast<unsigned>(y) >= static_cast<unsigned>(height))
+            return;
+        x0 = qMax(x0, 0);
+        x1 = qMin(x1, width - 1);
+        while (x0 <= x1) {
+            /* Fill up to the end of the tile containing x0. */
+            int end = qMin(x1, x0 | (TiledCanvas::TILE_SIZE - 1));
+            quint32 *p = pixelAt(x0, y);
+            std::fill(p, p + (end - x0 + 1), pixel);
+            x0 = end + 1;
+        }
+    }
+
+    void vspan(int x, int y0, int y1)
+    {
+        if (static_cast<unsigned>(x) >= static_cast<unsigned>(width))
+            return;
+        y0 = qMax(y0, 0);
+        y1 = qMin(y1, height - 1);
+        while (y0 <= y1) {
+            int end = qMin(y1, y0 | (TiledCanvas::TILE_SIZE - 1));
+            quint32 *p = pixelAt(x, y0);
+            for (int y = y0; y <= end; ++y, p += TiledCanvas::TILE_SIZE)
+                *p = pixel;
+            y0 = end + 1;
+        }
+    }
+
+    void diagonal(int x, int y, int n, int yStep)
+    {
+        for (int k = 0; k < n; ++k)
+            plot(x + k, y + k * yStep);
+    }
+
+private:
+    quint32 *pixelAt(int x, int y)
+    {
+        int column = x >> TiledCanvas::TILE_SHIFT;
+        int row = y >> TiledCanvas::TILE_SHIFT;
+        int index = row * canvas.tileColumns() + column;
+        if (index != cachedIndex) {
+            cachedTile = canvas.tileBits(column, row);
+            cachedIndex = index;
+        }
+        const int mask = TiledCanvas::TILE_SIZE - 1;
+        return cachedTile + ((y & mask) << TiledCanvas::TILE_SHIFT) + (x & mask);
+    }
+
+    TiledCanvas &canvas;
+    int width, height;
+    quint32 pixel;
+    int cachedIndex;
+    quint32 *cachedTile;
+};
+
+template <typename Kernel>
+void withPixelSink(TiledCanvas &canvas, QRgb rgb, Kernel kernel)
+{
+    TiledSink sink(canvas, rgb);
+    kernel(sink);
+}
+
+}
+
+#endif // TILEDCANVAS_H
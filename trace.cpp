@@ -0,0 +1,160 @@
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QTextStream>
+#include <QVector>
+
+namespace cg {
+
+namespace {
+
+enum { RING_SIZE = 1 << 16 };   /* events per thread */
+
+struct Event {
+    const char *name;
+    qint64 begin, duration;     /* nanoseconds */
+};
+
+/* Written only by its own thread. head counts every event recorded, and
+ * is published after the event it covers is written. */
+struct Ring {
+    Event events[RING_SIZE];
+    std::atomic<quint64> head;
+    int tid;
+    const char *name;
+};
+
+/* Rings live as long as the process, so the events of threads that have
+ * finished are still written. */
+QMutex registryMutex;
+QVector<Ring *> rings;
+QString traceFile;
+QElapsedTimer timer;
+
+thread_local Ring *threadRing = nullptr;
+
+/* Registers the calling thread on its first event. That takes the lock
+ * once per thread; recording itself never does. */
+Ring *ringOfThread()
+{
+    if (!threadRing) {
+        Ring *ring = new Ring;
+        ring->head.store(0, std::memory_order_relaxed);
+        ring->name = nullptr;
+
+        QMutexLocker locker(&registryMutex);
+        ring->tid = rings.size() + 1;
+        rings.append(ring);
+        threadRing = ring;
+    }
+    return threadRing;
+}
+
+QString microseconds(qint64 nanoseconds)
+{
+    return QString::number(nanoseconds / 1000.0, 'f', 3);
+}
+
+}
+
+std::atomic<bool> Trace::enabled(false);
+
+void Trace::start(const QString &fileName)
+{
+    QMutexLocker locker(&registryMutex);
+    for (Ring *ring : rings)
+        ring->head.store(0, std::memory_order_relaxed);
+    traceFile = fileName;
+    timer.start();
+    enabled.store(true, std::memory_order_release);
+}
+
+QString Trace::startFromArguments(int &argc, char *argv[])
+{
+    QString fileName = qEnvironmentVariable("PAINTER_TRACE");
+    int kept = 0;
+    for (int i = 0; i < argc; ++i) {
+        if (QString(argv[i]) == "--trace" && i + 1 < argc)
+            fileName = argv[++i];
+        else
+            argv[kept++] = argv[i];
+    }
+    argc = kept;
+    argv[argc] = nullptr;
+
+    if (!fileName.isEmpty()) {
+        start(fileName);
+        setThreadName("main");
+    }
+    return fileName;
+}
+
+bool Trace::stop()
+{
+    if (!isEnabled())
+        return true;
+    enabled.store(false, std::memory_order_relaxed);
+
+    QMutexLocker locker(&registryMutex);
+    QSaveFile file(traceFile);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QTextStream out(&file);
+    out << "{\"traceEvents\":[";
+    bool first = true;
+    for (Ring *ring : rings) {
+        out << (first ? "\n" : ",\n");
+        first = false;
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+            << ring->tid << ",\"args\":{\"name\":\"";
+        if (ring->name)
+            out << ring->name;
+        else
+            out << "thread " << ring->tid;
+        out << "\"}}";
+
+        quint64 head = ring->head.load(std::memory_order_acquire);
+        quint64 count = qMin(head, static_cast<quint64>(RING_SIZE));
+        for (quint64 i = head - count; i < head; ++i) {
+            const Event &event = ring->events[i % RING_SIZE];
+            out << ",\n{\"name\":\"" << event.name
+                << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->tid
+                << ",\"ts\":" << microseconds(event.begin)
+                << ",\"dur\":" << microseconds(event.duration) << '}';
+        }
+    }
+    out << "\n]}\n";
+    out.flush();
+    return file.commit();
+}
+
+void Trace::setThreadName(const char *name)
+{
+    if (isEnabled())
+        ringOfThread()->name = name;
+}
+
+qint64 Trace::now()
+{
+    return timer.nsecsElapsed();
+}
+
+void Trace::record(const char *name, qint64 begin, qint64 end)
+{
+    if (!isEnabled())
+        return;
+
+    Ring *ring = ringOfThread();
+    quint64 head = ring->head.load(std::memory_order_relaxed);
+    Event &event = ring->events[head % RING_SIZE];
+    event.name = name;
+    event.begin = begin;
+    event.duration = end - begin;
+    ring->head.store(head + 1, std::memory_order_release);
+}
+
+}
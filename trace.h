@@ -0,0 +1,71 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QtGlobal>
+
+#include <atomic>
+
+namespace cg {
+
+/* Records a timeline of scopes as Chrome trace-event JSON, which
+ * chrome://tracing and Perfetto open.
+ *
+ * TRACE_SCOPE("name") times the rest of the enclosing block. Each thread
+ * records into a ring buffer of its own without taking a lock; once a
+ * ring is full its oldest events are overwritten. While tracing is off
+ * a scope costs one relaxed atomic load. Names must be string literals,
+ * which are kept by pointer and written without escaping.
+ *
+ * stop() reads the rings of every thread, so the traced threads should
+ * be idle by then. */
+class Trace
+{
+public:
+    static void start(const QString &fileName);
+    /* Takes "--trace <file>" out of the arguments and starts tracing
+     * into that file, or into $PAINTER_TRACE when it isn't given. The
+     * calling thread is named "main". Returns the file, or an empty
+     * string when nothing is traced. */
+    static QString startFromArguments(int &argc, char *argv[]);
+    /* Stops recording and writes the trace. Returns false if it can't
+     * be written. */
+    static bool stop();
+    static bool isEnabled() { return enabled.load(std::memory_order_relaxed); }
+
+    /* Names the calling thread in the timeline. */
+    static void setThreadName(const char *name);
+
+    /* Nanoseconds since start(). */
+    static qint64 now();
+    static void record(const char *name, qint64 begin, qint64 end);
+
+private:
+    static std::atomic<bool> enabled;
+};
+
+class TraceScope
+{
+public:
+    explicit TraceScope(const char *name)
+        : name(name), begin(Trace::isEnabled() ? Trace::now() : -1) {}
+    ~TraceScope()
+    {
+        if (begin >= 0)
+            Trace::record(name, begin, Trace::now());
+    }
+
+private:
+    Q_DISABLE_COPY(TraceScope)
+
+    const char *name;
+    qint64 begin;
+};
+
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) cg::TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
+
+#endif // TRACE_H
@@ -1,4 +1,5 @@
 #include "utils.h"
+#include "fixedpoint.h"
 
 #include <QtMath>
 
@@ -24,21 +25,61 @@ int crossProd(const QPoint &p1, const QPoint &p2)  {
     return p1.x() * p2.y() - p2.x() * p1.y();
 }
 
-QPoint scalePoint(const QPoint &p, const QPoint &center, double s)
+QPointF scalePoint(const QPointF &p, const QPointF &center, double s)
 {
-    int x = static_cast<int>(s * (p.x() - center.x()) + center.x());
-    int y = static_cast<int>(s * (p.y() - center.y()) + center.y());
-    return QPoint(x, y);
+    return center + s * (p - center);
 }
 
-QPoint rotatePoint(const QPoint &p, const QPoint &center, double r)
+QPointF rotatePoint(const QPointF &p, const QPointF &center, double r)
 {
     double cosTheta = qCos(r);
     double sinTheta = qSin(r);
-    QPoint v = p - center;
-    int x = static_cast<int>(center.x() + cosTheta * v.x() - sinTheta * v.y());
-    int y = static_cast<int>(center.y() + sinTheta * v.x() + cosTheta * v.y());
-    return QPoint(x, y);
+    QPointF v = p - center;
+    return QPointF(center.x() + cosTheta * v.x() - sinTheta * v.y(),
+                   center.y() + sinTheta * v.x() + cosTheta * v.y());
+}
+
+QVector<QPointF> toPointF(const QVector<QPoint> &points)
+{
+    QVector<QPointF> result;
+    result.reserve(points.size());
+    for (auto &p : points)
+        result.append(p);
+    return result;
+}
+
+QRectF boundingRect(const QPointF *points, int n)
+{
+    if (n <= 0)
+        return QRectF();
+
+    double left = points[0].x(), right = left;
+    double top = points[0].y(), bottom = top;
+    for (int i = 1; i < n; ++i) {
+        left = qMin(left, points[i].x());
+        right = qMax(right, points[i].x());
+        top = qMin(top, points[i].y());
+        bottom = qMax(bottom, points[i].y());
+    }
+    return QRectF(QPointF(left, top), QPointF(right, bottom));
+}
+
+bool contains(const QRectF &outer, const QRectF &inner)
+{
+    return outer.left() <= inner.left() && inner.right() <= outer.right()
+            && outer.top() <= inner.top() && inner.bottom() <= outer.bottom();
+}
+
+bool intersects(const QRectF &r1, const QRectF &r2)
+{
+    return r1.left() <= r2.right() && r2.left() <= r1.right()
+            && r1.top() <= r2.bottom() && r2.top() <= r1.bottom();
+}
+
+QRect pixelRect(const QRectF &r)
+{
+    return QRect(cg::fixed::roundToPixel(r.topLeft()),
+                 cg::fixed::roundToPixel(r.bottomRight()));
 }
 
 }
@@ -2,7 +2,10 @@
 #define UTILS_H
 
 #include <QPoint>
+#include <QPointF>
 #include <QRect>
+#include <QRectF>
+#include <QVector>
 
 namespace utils {
 
@@ -10,8 +13,17 @@ QRect getRectAroundPoint(const QPoint &point, int radius);
 bool isClose(const QPoint &p1, const QPoint &p2, int radius);
 int innerProd(const QPoint &p1, const QPoint &p2);
 int crossProd(const QPoint &p1, const QPoint &p2);
-QPoint scalePoint(const QPoint &p, const QPoint &center, double s);
-QPoint rotatePoint(const QPoint &p, const QPoint &center, double r);
+QPointF scalePoint(const QPointF &p, const QPointF &center, double s);
+QPointF rotatePoint(const QPointF &p, const QPointF &center, double r);
+QVector<QPointF> toPointF(const QVector<QPoint> &points);
+
+/* Rects of real coordinates here include their edges, so that a rect
+ * of no width or height still holds the segment it bounds. */
+QRectF boundingRect(const QPointF *points, int n);
+bool contains(const QRectF &outer, const QRectF &inner);
+bool intersects(const QRectF &r1, const QRectF &r2);
+/* The pixels the corners of r fall on. */
+QRect pixelRect(const QRectF &r);
 
 }
 
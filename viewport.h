@@ -0,0 +1,77 @@
+#ifndef VIEWPORT_H
+#define VIEWPORT_H
+
+#include "fixedpoint.h"
+
+#include <QPoint>
+#include <QPointF>
+#include <QRect>
+#include <QtMath>
+
+namespace cg {
+
+/* Maps canvas coordinates to screen coordinates by
+ * screen = (canvas - origin) * zoom, both measured from the top left
+ * edge of pixel 0. */
+class Viewport
+{
+public:
+    Viewport() : origin(0.0, 0.0), zoom(1.0) {}
+    Viewport(const QPointF &origin, double zoom)
+        : origin(origin), zoom(zoom) {}
+
+    QPointF getOrigin() const { return origin; }
+    double getZoom() const { return zoom; }
+    bool isIdentity() const { return zoom == 1.0 && origin.isNull(); }
+
+    /* Maps a point, whether it is a pixel or a real coordinate, to the
+     * pixel it falls on. Pixel centers map to pixel centers as in
+     * ShapeStore::drawScaled(), x becoming zoom * (x + 0.5) - 0.5, so
+     * panning by whole pixels at zoom 1 shifts the picture exactly. */
+    QPoint map(const QPointF &p) const
+    {
+        return fixed::roundToPixel(mapReal(p));
+    }
+
+    /* The same without rounding to a pixel. */
+    QPointF mapReal(const QPointF &p) const
+    {
+        return QPointF(zoom * (p.x() - origin.x() + 0.5) - 0.5,
+                       zoom * (p.y() - origin.y() + 0.5) - 0.5);
+    }
+
+    /* Maps the pixels a rect covers, so that no rect
+     * maps to less than one pixel. Pixel x covers x - 0.5 to x + 0.5. */
+    QRect map(const QRect &r) const
+    {
+        QPoint topLeft = mapEdge(r.topLeft());
+        QPoint bottomRight = mapEdge(r.bottomRight() + QPoint(1, 1))
+                - QPoint(1, 1);
+        return QRect(topLeft, QPoint(qMax(topLeft.x(), bottomRight.x()),
+                                     qMax(topLeft.y(), bottomRight.y())));
+    }
+
+    int map(double length) const { return qRound(length * zoom); }
+
+    /* Maps back to the pixel the center of a screen pixel falls in. */
+    QPoint unmap(const QPoint &p) const
+    {
+        return QPoint(qFloor((p.x() + 0.5) / zoom + origin.x()),
+                      qFloor((p.y() + 0.5) / zoom + origin.y()));
+    }
+
+private:
+    /* Maps the top left edge of a pixel to the screen pixel it is in. */
+    QPoint mapEdge(const QPoint &p) const
+    {
+        return QPoint(qFloor((p.x() - origin.x()) * zoom),
+                      qFloor((p.y() - origin.y()) * zoom));
+    }
+
+    QPointF origin;     /* the canvas point at the top left of the screen */
+    double zoom;
+};
+
+}
+
+#endif // VIEWPORT_H